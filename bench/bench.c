@@ -0,0 +1,384 @@
+// Benchmarks the runtime lookups of `tm_debug_utils_api` on synthetic symbol databases.
+// The plugin is compiled into the benchmark, so its state can be reset between configurations.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include "debug_utils_api.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Calls are timed in batches, since a single lookup takes about as long as reading the clock.
+#define TM_BENCH_BATCH_SIZE 64
+#define TM_BENCH_LOAD_ROUNDS 5
+// Number of hashes the hot lookups are drawn from, like the few hashes that show up in every log message.
+#define TM_BENCH_HOT_HASHES 256
+
+static const char *tm_bench_words[] = {
+	"tm", "entity", "component", "render", "graph", "shader", "asset", "texture", "buffer", "physics",
+	"transform", "camera", "light", "mesh", "material", "node", "plugin", "editor", "ui", "simulation",
+	"animation", "sound", "network", "task", "job", "queue", "type", "property", "creation", "truth",
+};
+
+static inline uint64_t tm_bench_random(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// Identifier like strings of one to six words, made unique by their index.
+static uint32_t tm_bench_string(uint64_t *state, uint32_t idx, char *buffer)
+{
+	uint32_t length = 0;
+	const uint32_t word_count = 1 + (uint32_t)(tm_bench_random(state) % 6);
+	for (uint32_t i = 0; i < word_count; ++i) {
+		const char *word = tm_bench_words[tm_bench_random(state) % TM_ARRAY_COUNT(tm_bench_words)];
+		const uint32_t word_length = (uint32_t)strlen(word);
+		memcpy(buffer + length, word, word_length);
+		length += word_length;
+		buffer[length++] = i + 1 < word_count ? '_' : '.';
+	}
+
+	return length + (uint32_t)sprintf(buffer + length, "%u", idx);
+}
+
+typedef struct tm_bench_entry_t
+{
+	uint64_t hash;
+	uint64_t offset;
+	uint32_t length;
+	TM_PAD(4);
+} tm_bench_entry_t;
+
+static int tm_bench_entry_compare(const void *a, const void *b)
+{
+	const uint64_t hash_a = ((const tm_bench_entry_t *)a)->hash, hash_b = ((const tm_bench_entry_t *)b)->hash;
+	return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+// Writes a version 2 database of `count` synthetic strings, laid out like the ones written by `symbols --generate`.
+static bool tm_bench_write_database(tm_allocator_i *a, const char *path, uint32_t count, bool compress)
+{
+	uint64_t state = count;
+	uint64_t strings_size = 0, strings_capacity = 64ull * count;
+	char *strings = tm_alloc(a, strings_capacity);
+	tm_bench_entry_t *entries = tm_alloc(a, count * sizeof(tm_bench_entry_t));
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint32_t length = tm_bench_string(&state, i, strings + strings_size);
+		entries[i] = (tm_bench_entry_t) { .hash = tm_murmur_hash_inline(strings + strings_size, (int)length, 0), .offset = strings_size, .length = length };
+		strings_size += length;
+	}
+
+	qsort(entries, count, sizeof(tm_bench_entry_t), tm_bench_entry_compare);
+	uint32_t unique = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!unique || entries[unique - 1].hash != entries[i].hash)
+			entries[unique++] = entries[i];
+	}
+
+	uint8_t code_lengths[256];
+	tm_huffman_tree_t encoding = { 0 };
+	if (compress) {
+		uint32_t frequencies[256] = { 0 };
+		for (uint64_t i = 0; i < strings_size; ++i)
+			++frequencies[(uint8_t)strings[i]];
+		tm_huffman_code_lengths(frequencies, code_lengths);
+		encoding = tm_huffman_tree_create_from_code_lengths(a, code_lengths);
+	}
+
+	const uint32_t flags = (compress ? TM_HDB_FLAGS_VERSION | TM_HDB_FLAGS_COMPRESSED | TM_HDB_FLAGS_CANONICAL : TM_HDB_FLAGS_VERSION) | TM_HDB_FLAGS_FILTER;
+	const uint64_t block_size = unique * tm_symbol_index__entry_size;
+	const uint64_t data_start = (sizeof(uint32_t) << 1) + block_size + (compress ? sizeof(code_lengths) : 0);
+	char *block = tm_alloc(a, block_size);
+	tm_symbol_index_t index;
+	tm_symbol_index_set_block(&index, block, unique);
+
+	// Codes are at most 12 bits, so two bytes per character and the slack for appending whole words is enough.
+	const uint64_t data_capacity = (strings_size << 1) + sizeof(uint64_t);
+	char *data = tm_alloc(a, data_capacity);
+	memset(data, 0, data_capacity);
+	uint64_t data_size = 0;
+	tm_symbol_filter_t filter = tm_symbol_filter_create(a, unique);
+	for (uint32_t i = 0; i < unique; ++i) {
+		const uint8_t *string = (const uint8_t *)strings + entries[i].offset;
+		((uint64_t *)index.hashes)[i] = entries[i].hash;
+		tm_symbol_filter_insert(&filter, entries[i].hash);
+		if (compress) {
+			((uint64_t *)index.string_starts)[i] = (data_start << 3) + data_size;
+			const uint64_t start_bits = data_size;
+			for (uint32_t j = 0; j < entries[i].length; ++j)
+				tm_binary_handler_append_bits(data, &data_size, tm_huffman_code__code_word(encoding.code_lut[string[j]]), tm_huffman_code__bit_count(encoding.code_lut[string[j]]));
+			((uint32_t *)index.string_lengths)[i] = (uint32_t)(data_size - start_bits);
+		} else {
+			((uint64_t *)index.string_starts)[i] = data_start + data_size;
+			((uint32_t *)index.string_lengths)[i] = entries[i].length;
+			memcpy(data + data_size, string, entries[i].length);
+			data_size += entries[i].length;
+		}
+	}
+
+	tm_file_o file = tm_os_api->file_io->open_output(path, false);
+	const uint64_t data_bytes = compress ? (data_size + 7) >> 3 : data_size;
+	bool written = file.valid;
+	if (file.valid) {
+		written = tm_os_api->file_io->write(file, &flags, sizeof(uint32_t))
+			&& tm_os_api->file_io->write(file, &unique, sizeof(uint32_t))
+			&& tm_os_api->file_io->write(file, block, block_size)
+			&& (!compress || tm_os_api->file_io->write(file, code_lengths, sizeof(code_lengths)))
+			&& tm_os_api->file_io->write(file, data, data_bytes)
+			&& tm_symbol_filter_write(file, data_start + data_bytes, &filter);
+		tm_os_api->file_io->close(file);
+	}
+
+	if (compress)
+		tm_huffman_tree_free(a, &encoding);
+	tm_symbol_filter_free(a, &filter);
+	tm_free(a, data, data_capacity);
+	tm_free(a, block, block_size);
+	tm_free(a, entries, count * sizeof(tm_bench_entry_t));
+	tm_free(a, strings, strings_capacity);
+	return written;
+}
+
+typedef struct tm_bench_settings_t
+{
+	const char *directory;
+	uint32_t samples;
+	bool json;
+	TM_PAD(3);
+} tm_bench_settings_t;
+
+typedef struct tm_bench_t
+{
+	const tm_bench_settings_t *settings;
+	uint32_t entry_count;
+	bool compressed;
+	TM_PAD(3);
+	// Nanoseconds per call of every measured batch.
+	double *timings;
+	uint32_t timing_count;
+	TM_PAD(4);
+	// Results are summed up here, so the compiler can't drop the calls.
+	uint64_t checksum;
+} tm_bench_t;
+
+static int tm_bench_double_compare(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Reports the percentiles of the recorded timings in a stable format, so results of different builds can be diffed.
+static void tm_bench_report(tm_bench_t *bench, const char *name, const char *unit)
+{
+	const uint32_t n = bench->timing_count;
+	if (!n)
+		return;
+
+	qsort(bench->timings, n, sizeof(double), tm_bench_double_compare);
+	double sum = 0;
+	for (uint32_t i = 0; i < n; ++i)
+		sum += bench->timings[i];
+
+	const double p50 = bench->timings[(n - 1) * 50 / 100];
+	const double p90 = bench->timings[(n - 1) * 90 / 100];
+	const double p99 = bench->timings[(n - 1) * 99 / 100];
+	const double max = bench->timings[n - 1];
+	const double mean = sum / n;
+	const double per_second = mean > 0 ? (!strcmp(unit, "ms") ? 1e3 : 1e9) / mean : 0.0;
+
+	if (bench->settings->json) {
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "{\"benchmark\":\"%s\",\"entries\":%u,\"compressed\":%s,\"unit\":\"%s\",\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f,\"mean\":%.1f,\"per_second\":%.0f}\n",
+			name, bench->entry_count, bench->compressed ? "true" : "false", unit, p50, p90, p99, max, mean, per_second);
+	} else {
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "%-26s %9u %-3s  p50 %10.1f %s  p90 %10.1f %s  p99 %10.1f %s  max %10.1f %s  %12.0f/s\n",
+			name, bench->entry_count, bench->compressed ? "c" : "u", p50, unit, p90, unit, p99, unit, max, unit, per_second);
+	}
+
+	bench->timing_count = 0;
+}
+
+static inline void tm_bench_record(tm_bench_t *bench, tm_clock_o start, uint32_t calls)
+{
+	bench->timings[bench->timing_count++] = tm_os_api->time->delta(tm_os_api->time->now(), start) * 1e9 / calls;
+}
+
+typedef enum tm_bench_lookup_t
+{
+	TM_BENCH_DECODE_HASH,
+	TM_BENCH_TRY_DECODE_HASH,
+	TM_BENCH_DECODE_HASH_TO_BUFFER,
+} tm_bench_lookup_t;
+
+static void tm_bench_lookups(tm_bench_t *bench, const uint64_t *hashes, tm_bench_lookup_t lookup)
+{
+	char buffer[256];
+	for (uint32_t batch = 0; batch + TM_BENCH_BATCH_SIZE <= bench->settings->samples; batch += TM_BENCH_BATCH_SIZE) {
+		const uint64_t *batch_hashes = hashes + batch;
+		const tm_clock_o start = tm_os_api->time->now();
+		if (lookup == TM_BENCH_DECODE_HASH_TO_BUFFER) {
+			for (uint32_t i = 0; i < TM_BENCH_BATCH_SIZE; ++i)
+				bench->checksum += tm_debug_utils_api->decode_hash_to_buffer(batch_hashes[i], buffer, sizeof(buffer));
+		} else {
+			TM_INIT_TEMP_ALLOCATOR(ta);
+			for (uint32_t i = 0; i < TM_BENCH_BATCH_SIZE; ++i) {
+				const char *s = lookup == TM_BENCH_DECODE_HASH ? tm_debug_utils_api->decode_hash(batch_hashes[i], ta) : tm_debug_utils_api->try_decode_hash(batch_hashes[i], ta);
+				bench->checksum += s ? (uint8_t)s[0] : 0;
+			}
+			TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+		}
+		tm_bench_record(bench, start, TM_BENCH_BATCH_SIZE);
+	}
+}
+
+static void tm_bench_configuration(tm_allocator_i *a, tm_bench_t *bench)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const tm_bench_settings_t *settings = bench->settings;
+	const char *directory = tm_temp_allocator_api->printf(ta, "%s/%u%s", settings->directory, bench->entry_count, bench->compressed ? "c" : "u");
+	const char *path = tm_temp_allocator_api->printf(ta, "%s/synthetic.hdb", directory);
+
+	// The databases only depend on their configuration, so they are kept for later runs.
+	if (!tm_os_api->file_system->stat(path).exists) {
+		tm_os_api->file_system->make_directory(directory);
+		if (!tm_bench_write_database(a, path, bench->entry_count, bench->compressed)) {
+			tm_logger_api->printf(TM_LOG_TYPE_ERROR, "debug-utils-bench: could not write '%s'\n", path);
+			TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+			return;
+		}
+	}
+
+	// Opening the database, building the decode table and the index over all databases.
+	for (uint32_t i = 0; i < TM_BENCH_LOAD_ROUNDS; ++i) {
+		private__unload();
+		const tm_clock_o start = tm_os_api->time->now();
+		tm_debug_utils_api->add_symbol_database(directory);
+		bench->timings[bench->timing_count++] = tm_os_api->time->delta(tm_os_api->time->now(), start) * 1e3;
+	}
+	tm_bench_report(bench, "load", "ms");
+
+	const private__symbols_t *symbols = private__symbols();
+	if (symbols->database_count != 1 || !symbols->databases[0].index.entry_count) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "debug-utils-bench: could not load '%s'\n", path);
+		private__unload();
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+		return;
+	}
+
+	// Hits are spread over the whole database, misses are random hashes that are all but certainly not in it.
+	uint64_t state = bench->entry_count;
+	const tm_symbol_index_t *index = &symbols->databases[0].index;
+	uint64_t *hits = tm_temp_alloc(ta, settings->samples * sizeof(uint64_t));
+	uint64_t *misses = tm_temp_alloc(ta, settings->samples * sizeof(uint64_t));
+	uint64_t *hot = tm_temp_alloc(ta, settings->samples * sizeof(uint64_t));
+	for (uint32_t i = 0; i < settings->samples; ++i) {
+		hits[i] = index->hashes[tm_bench_random(&state) % index->entry_count];
+		misses[i] = tm_bench_random(&state);
+	}
+	for (uint32_t i = 0; i < settings->samples; ++i)
+		hot[i] = hits[tm_bench_random(&state) % tm_min(TM_BENCH_HOT_HASHES, settings->samples)];
+
+	tm_bench_lookups(bench, hits, TM_BENCH_DECODE_HASH);
+	tm_bench_report(bench, "decode_hash_hit", "ns");
+	tm_bench_lookups(bench, hits, TM_BENCH_DECODE_HASH_TO_BUFFER);
+	tm_bench_report(bench, "decode_hash_to_buffer_hit", "ns");
+	tm_bench_lookups(bench, hot, TM_BENCH_DECODE_HASH);
+	tm_bench_report(bench, "decode_hash_hot", "ns");
+	tm_bench_lookups(bench, misses, TM_BENCH_DECODE_HASH);
+	tm_bench_report(bench, "decode_hash_miss", "ns");
+	tm_bench_lookups(bench, misses, TM_BENCH_TRY_DECODE_HASH);
+	tm_bench_report(bench, "try_decode_hash_miss", "ns");
+
+	// Inserts of new strings into an empty runtime database, the strings are formatted up front.
+	private__unload();
+	char **strings = tm_temp_alloc(ta, settings->samples * sizeof(char *));
+	for (uint32_t i = 0; i < settings->samples; ++i)
+		strings[i] = tm_temp_allocator_api->printf(ta, "runtime_string_%u", i);
+
+	for (uint32_t batch = 0; batch + TM_BENCH_BATCH_SIZE <= settings->samples; batch += TM_BENCH_BATCH_SIZE) {
+		const tm_clock_o start = tm_os_api->time->now();
+		for (uint32_t i = 0; i < TM_BENCH_BATCH_SIZE; ++i)
+			bench->checksum += tm_debug_utils_api->add_hash(strings[batch + i]);
+		tm_bench_record(bench, start, TM_BENCH_BATCH_SIZE);
+	}
+	tm_bench_report(bench, "add_hash", "ns");
+
+	private__unload();
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+static void print_usage()
+{
+	tm_logger_api->print(TM_LOG_TYPE_INFO,
+		"Usage debug-utils-bench [OPTIONS]...\n"
+		"Measures the runtime lookups of tm_debug_utils_api on synthetic symbol databases.\n"
+		"\n"
+		"	--sizes [NUMBER,...]\n"
+		"		Entry counts of the databases to benchmark, defaults to 10000,100000,1000000,10000000.\n"
+		"\n"
+		"	--samples [NUMBER]\n"
+		"		Number of calls measured per benchmark, defaults to 131072.\n"
+		"\n"
+		"	--dir [STRING]\n"
+		"		Directory the synthetic databases are written to and reused from, defaults to debug_utils_bench.\n"
+		"\n"
+		"	--json\n"
+		"		Reports every benchmark as a JSON object on its own line.\n");
+}
+
+int main(int argc, char **argv)
+{
+	tm_logger_api->add_logger(tm_logger_api->default_logger);
+
+	tm_bench_settings_t settings = { .directory = "debug_utils_bench", .samples = 128 * 1024 };
+	const char *sizes = "10000,100000,1000000,10000000";
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			print_usage();
+			return EXIT_SUCCESS;
+		}
+		else if (!strcmp(argv[i], "--json")) settings.json = true;
+		else if (!strcmp(argv[i], "--sizes") && i + 1 < argc) sizes = argv[++i];
+		else if (!strcmp(argv[i], "--samples") && i + 1 < argc) settings.samples = (uint32_t)strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--dir") && i + 1 < argc) settings.directory = argv[++i];
+		else {
+			tm_logger_api->printf(TM_LOG_TYPE_ERROR, "debug-utils-bench: unknown option '%s'\nTry 'debug-utils-bench --help' for available options.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	tm_allocator_i *a = tm_allocator_api->system;
+	tm_os_api->file_system->make_directory(settings.directory);
+
+	tm_bench_t bench = { .settings = &settings };
+	const uint32_t timing_capacity = tm_max(TM_BENCH_LOAD_ROUNDS, settings.samples / TM_BENCH_BATCH_SIZE);
+	bench.timings = tm_alloc(a, timing_capacity * sizeof(double));
+
+	if (!settings.json)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "%-26s %9s %-3s  (c = compressed, u = uncompressed, timings per call over batches of %u calls)\n", "benchmark", "entries", "", TM_BENCH_BATCH_SIZE);
+
+	for (const char *size = sizes; *size;) {
+		char *end;
+		bench.entry_count = (uint32_t)strtoul(size, &end, 10);
+		if (bench.entry_count) {
+			for (uint32_t compressed = 0; compressed < 2; ++compressed) {
+				bench.compressed = compressed;
+				tm_bench_configuration(a, &bench);
+			}
+		}
+
+		size = *end ? end + 1 : end;
+	}
+
+	if (!settings.json)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "checksum %llx\n", (unsigned long long)bench.checksum);
+
+	tm_free(a, bench.timings, timing_capacity * sizeof(double));
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
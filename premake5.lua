@@ -110,6 +110,7 @@ filter {"platforms:Linux"}
     toolset "clang"
     libdirs { "$(TM_SDK_DIR)/lib/" .. _ACTION .. "/%{cfg.buildcfg}"}
     includedirs { "$(TM_SDK_DIR)/headers" }
+    links { "rt" }                           -- shm_open() for sharing indices, only in libc itself since glibc 2.34.
     buildoptions {
         "-fms-extensions",                   -- Allow anonymous struct as C inheritance.
         "-g",                                -- Debugging.
@@ -176,3 +177,17 @@ project "symbols"
 	dependson { "debug-utils-static" }
     filter "platforms:Win64"
         targetdir "$(TM_SDK_DIR)/bin/%{cfg.buildcfg}"
+
+project "debug-utils-bench"
+    location "build/bench"
+    targetname "debug-utils-bench"
+    kind "ConsoleApp"
+    language "C++"
+	folder{ "bench" }
+	-- The benchmark compiles the plugin into itself, so it can reset it between configurations.
+	includedirs { "bench", "shared", "tm_debug_utils", "$(TM_SDK_DIR)" }
+	links { "foundation" }
+	defines { "TM_LINKS_FOUNDATION", "TM_LINKS_DEBUG_UTILS" }
+    sysincludedirs { "" }
+    filter "platforms:Win64"
+        targetdir "$(TM_SDK_DIR)/bin/%{cfg.buildcfg}"
@@ -38,4 +38,39 @@ static inline void tm_binary_handler_write_bits(char *dst, uint64_t *bit_offset,
 		bits >>= bit_count;
 		count -= bit_count;
 	}
+}
+
+// Same as `tm_binary_handler_write_bits()` for up to 56 bits, but writes them with a single 64 bit store.
+// The destination must be zeroed from `bit_offset` on and have 8 bytes of space after the last bit written.
+static inline void tm_binary_handler_append_bits(char *dst, uint64_t *bit_offset, uint64_t bits, uint32_t count)
+{
+	char *word_start = dst + (*bit_offset >> 3);
+	uint64_t word;
+	memcpy(&word, word_start, sizeof(uint64_t));
+	word |= bits << (*bit_offset & 7);
+	memcpy(word_start, &word, sizeof(uint64_t));
+	*bit_offset += count;
+}
+
+// Appends the value seven bits per byte, least significant bits first. All bytes but the last have their high bit set.
+static inline void tm_binary_handler_write_varint(char *dst, uint64_t *offset, uint64_t value)
+{
+	uint8_t *data = (uint8_t *)dst;
+	for (; value >= 0x80; value >>= 7)
+		data[(*offset)++] = (uint8_t)value | 0x80;
+	data[(*offset)++] = (uint8_t)value;
+}
+
+// Reads a value written by `tm_binary_handler_write_varint()` and returns the byte after it, or null if it doesn't end before `end`.
+static inline const uint8_t *tm_binary_handler_read_varint(const uint8_t *src, const uint8_t *end, uint64_t *value)
+{
+	*value = 0;
+	for (uint32_t shift = 0; src < end && shift < 64; shift += 7) {
+		const uint8_t byte = *src++;
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return src;
+	}
+
+	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,435 @@
+// A symbol database (.hdb) mapped into memory.
+// The index, the Huffman nodes and the string data are used in place from the mapping,
+// only version 1 databases need their index converted on the heap, as do symbol tables to be decoded from.
+typedef struct tm_symbol_database_t
+{
+	char *path;
+	tm_mapped_file_t file;
+	uint32_t flags;
+	// Set if `index` was converted from a version 1 database and has to be freed.
+	bool owns_index;
+	// Set if the nodes of `decoding` were created from canonical code lengths and have to be freed.
+	bool owns_decoding_nodes;
+	TM_PAD(2);
+	tm_symbol_index_t index;
+	tm_huffman_tree_t decoding;
+	// Empty unless the database was generated with a filter, points into the mapping.
+	tm_symbol_filter_t filter;
+	// Set if the strings are compressed with a symbol table, see `TM_HDB_FLAGS_FSST`.
+	tm_fsst_table_t *symbol_table;
+	// Empty unless the database was generated with a search index, points into the mapping.
+	tm_symbol_search_index_t search;
+} tm_symbol_database_t;
+
+static inline bool private__symbol_database_parse(tm_allocator_i *a, tm_symbol_database_t *db)
+{
+	const char *data = db->file.data;
+	const uint64_t size = db->file.size;
+
+	uint32_t entry_count;
+	uint64_t offset = sizeof(uint32_t) << 1;
+	if (size < offset)
+		return false;
+
+	memcpy(&db->flags, data, sizeof(uint32_t));
+	memcpy(&entry_count, data + sizeof(uint32_t), sizeof(uint32_t));
+
+	const uint32_t version = db->flags & TM_HDB_FLAGS_VERSION_MASK;
+	if (version == TM_HDB_FLAGS_VERSION_1) {
+		if (offset + entry_count * sizeof(tm_symbol_node_t) > size)
+			return false;
+
+		const tm_symbol_tree_t tree = { .nodes = (tm_symbol_node_t *)(data + offset), .node_count = entry_count };
+		db->index = tm_symbol_index_create(a, &tree);
+		db->owns_index = true;
+		offset += entry_count * sizeof(tm_symbol_node_t);
+	}
+	else if (version == TM_HDB_FLAGS_VERSION_2 || version == TM_HDB_FLAGS_VERSION_3) {
+		if (offset + entry_count * tm_symbol_index__entry_size > size)
+			return false;
+
+		tm_symbol_index_set_block(&db->index, data + offset, entry_count);
+		offset += entry_count * tm_symbol_index__entry_size;
+	}
+	else
+		return false;
+
+	// Front coded and FSST compressed strings are what sets version 3 apart.
+	if (!!(db->flags & (TM_HDB_FLAGS_FRONT_CODED | TM_HDB_FLAGS_FSST)) != (version == TM_HDB_FLAGS_VERSION_3))
+		return false;
+
+	if ((db->flags & TM_HDB_FLAGS_FSST) && (db->flags & (TM_HDB_FLAGS_COMPRESSED | TM_HDB_FLAGS_CANONICAL)))
+		return false;
+
+	if (db->flags & TM_HDB_FLAGS_CANONICAL) {
+		if (offset + 256 > size)
+			return false;
+
+		db->decoding = tm_huffman_tree_create_from_code_lengths(a, (const uint8_t *)data + offset);
+		if (!db->decoding.node_count)
+			return false;
+
+		db->owns_decoding_nodes = true;
+		tm_huffman_tree_create_decode_lut(a, &db->decoding);
+		offset += 256;
+	}
+	else if (db->flags & TM_HDB_FLAGS_COMPRESSED) {
+		if (offset + sizeof(uint32_t) > size)
+			return false;
+
+		memcpy(&db->decoding.node_count, data + offset, sizeof(uint32_t));
+		offset += sizeof(uint32_t);
+		if (offset + db->decoding.node_count * sizeof(tm_huffman_node_t) > size)
+			return false;
+
+		db->decoding.nodes = (tm_huffman_node_t *)(data + offset);
+		tm_huffman_tree_create_decode_lut(a, &db->decoding);
+		offset += db->decoding.node_count * sizeof(tm_huffman_node_t);
+	}
+	else if (db->flags & TM_HDB_FLAGS_FSST) {
+		db->symbol_table = tm_alloc(a, sizeof(tm_fsst_table_t));
+		const uint64_t table_size = tm_fsst_table_read(db->symbol_table, data + offset, size - offset);
+		if (!table_size)
+			return false;
+
+		offset += table_size;
+	}
+
+	if (db->flags & TM_HDB_FLAGS_SEARCH_INDEX) {
+		offset = tm_symbol_search_index_view(data, size, offset, entry_count, &db->search);
+		if (!offset)
+			return false;
+	}
+
+	if (db->flags & TM_HDB_FLAGS_FILTER)
+		return tm_symbol_filter_view(data, size, offset, &db->filter);
+
+	return true;
+}
+
+static inline bool tm_symbol_database_open(tm_allocator_i *a, const char *path, tm_symbol_database_t *db)
+{
+	*db = (tm_symbol_database_t) { 0 };
+	if (!tm_mapped_file_open(path, &db->file))
+		return false;
+
+	if (!private__symbol_database_parse(a, db)) {
+		if (db->owns_index)
+			tm_symbol_index_free(a, &db->index);
+		if (db->owns_decoding_nodes)
+			tm_huffman_tree_free(a, &db->decoding);
+		else if (db->decoding.decode_lut)
+			tm_free(a, db->decoding.decode_lut, sizeof(uint32_t) << TM_HUFFMAN_DECODE_LUT_BITS);
+		if (db->symbol_table)
+			tm_free(a, db->symbol_table, sizeof(tm_fsst_table_t));
+		tm_mapped_file_close(&db->file);
+		return false;
+	}
+
+	const size_t path_size = strlen(path) + 1;
+	db->path = tm_alloc(a, path_size);
+	memcpy(db->path, path, path_size);
+	return true;
+}
+
+static inline void tm_symbol_database_close(tm_allocator_i *a, tm_symbol_database_t *db)
+{
+	if (db->owns_index)
+		tm_symbol_index_free(a, &db->index);
+
+	// Unless they were created from code lengths the Huffman nodes live in the mapping.
+	if (db->owns_decoding_nodes)
+		tm_huffman_tree_free(a, &db->decoding);
+	else if (db->decoding.decode_lut)
+		tm_free(a, db->decoding.decode_lut, sizeof(uint32_t) << TM_HUFFMAN_DECODE_LUT_BITS);
+	if (db->symbol_table)
+		tm_free(a, db->symbol_table, sizeof(tm_fsst_table_t));
+
+	tm_free(a, db->path, strlen(db->path) + 1);
+	tm_mapped_file_close(&db->file);
+	*db = (tm_symbol_database_t) { 0 };
+}
+
+// Returns the byte offset of the string of an entry that isn't Huffman coded and sets `*string_end` to where it ends.
+// Both are clamped to the mapping, the index of a corrupt or truncated database can point past it.
+static inline uint64_t private__symbol_database_extent(const tm_symbol_database_t *db, uint32_t entry_idx, uint64_t *string_end)
+{
+	const uint64_t string_start = db->index.string_starts[entry_idx];
+	*string_end = tm_min(string_start + db->index.string_lengths[entry_idx], db->file.size);
+	return tm_min(string_start, *string_end);
+}
+
+// Returns the string of the entry if it's stored as is, otherwise null.
+static inline const char *tm_symbol_database_view(const tm_symbol_database_t *db, uint32_t entry_idx, uint32_t *length)
+{
+	if (db->decoding.node_count || (db->flags & (TM_HDB_FLAGS_FRONT_CODED | TM_HDB_FLAGS_FSST)))
+		return 0;
+
+	uint64_t string_end;
+	const uint64_t string_start = private__symbol_database_extent(db, entry_idx, &string_end);
+	*length = (uint32_t)(string_end - string_start);
+	return db->file.data + string_start;
+}
+
+// Decodes an entry of a front coded database, see `TM_HDB_FLAGS_FRONT_CODED`. Of the strings before the entry
+// in its block, only the characters that are passed on to the entry are decoded.
+static inline uint32_t private__symbol_database_decode_front_coded(const tm_symbol_database_t *db, uint32_t entry_idx, char *buffer, uint32_t buffer_size)
+{
+	const uint64_t string_start = db->index.string_starts[entry_idx];
+	const uint32_t string_length = db->index.string_lengths[entry_idx];
+	const uint32_t position = (uint32_t)(string_start & (TM_HDB_FRONT_CODING_BLOCK_SIZE - 1));
+	const uint8_t *data = (const uint8_t *)db->file.data + tm_min(string_start >> TM_HDB_FRONT_CODING_BLOCK_SHIFT, db->file.size);
+	const uint8_t *data_end = (const uint8_t *)db->file.data + db->file.size;
+
+	const uint32_t count = data < data_end ? *data++ : 0;
+	if (position >= count || count > TM_HDB_FRONT_CODING_BLOCK_SIZE)
+		return 0;
+
+	uint64_t shared[TM_HDB_FRONT_CODING_BLOCK_SIZE], sizes[TM_HDB_FRONT_CODING_BLOCK_SIZE];
+	for (uint32_t i = 0; i < count && data; ++i) {
+		data = tm_binary_handler_read_varint(data, data_end, shared + i);
+		data = data ? tm_binary_handler_read_varint(data, data_end, sizes + i) : 0;
+	}
+	if (!data)
+		return 0;
+
+	// Every string passes on the characters it shares with the next one, so going backwards the number of
+	// characters the entry needs from a string is the smallest number shared by the strings after it.
+	uint64_t needed[TM_HDB_FRONT_CODING_BLOCK_SIZE];
+	uint64_t limit = tm_min(string_length, buffer_size);
+	for (uint32_t i = position + 1; i-- > 0;) {
+		needed[i] = limit;
+		limit = tm_min(limit, shared[i]);
+	}
+
+	const bool huffman = db->decoding.node_count;
+	for (uint64_t i = 0, offset = 0; i <= position; offset += sizes[i++]) {
+		const uint64_t end = offset + sizes[i];
+		if ((huffman ? (end + 7) >> 3 : end) > (uint64_t)(data_end - data))
+			return 0;
+
+		if (shared[i] >= needed[i])
+			continue;
+
+		const uint32_t suffix_needed = (uint32_t)(needed[i] - shared[i]);
+		if (huffman)
+			tm_huffman_tree_decode_string(&db->decoding, (const char *)data, offset, end, buffer + shared[i], suffix_needed);
+		else if (db->symbol_table)
+			tm_fsst_decode(db->symbol_table, data + offset, sizes[i], buffer + shared[i], suffix_needed);
+		else
+			memcpy(buffer + shared[i], data + offset, tm_min(sizes[i], suffix_needed));
+	}
+
+	return string_length;
+}
+
+// Decodes the string of the entry into `buffer` without null terminating it and returns its length.
+// At most `buffer_size` characters are written, the returned length is that of the whole string.
+static inline uint32_t tm_symbol_database_decode(const tm_symbol_database_t *db, uint32_t entry_idx, char *buffer, uint32_t buffer_size)
+{
+	if (db->flags & TM_HDB_FLAGS_FRONT_CODED)
+		return private__symbol_database_decode_front_coded(db, entry_idx, buffer, buffer_size);
+
+	if (!db->decoding.node_count) {
+		uint64_t string_end;
+		const uint64_t string_start = private__symbol_database_extent(db, entry_idx, &string_end);
+		if (db->symbol_table)
+			return tm_fsst_decode(db->symbol_table, (const uint8_t *)db->file.data + string_start, string_end - string_start, buffer, buffer_size);
+
+		const uint32_t string_length = (uint32_t)(string_end - string_start);
+		if (buffer_size)
+			memcpy(buffer, db->file.data + string_start, tm_min(string_length, buffer_size));
+		return string_length;
+	}
+
+	const uint64_t string_start = db->index.string_starts[entry_idx];
+	const uint32_t string_length = db->index.string_lengths[entry_idx];
+	// Databases written before version 2 can lack the last partial byte of the string data, never read past the mapping.
+	const uint64_t string_end = tm_min(string_start + string_length, db->file.size << 3);
+	return tm_huffman_tree_decode_string(&db->decoding, db->file.data, tm_min(string_start, string_end), string_end, buffer, buffer_size);
+}
+
+// Returns the string of the entry, either in place or decoded into `*buffer`, which grows to fit it.
+static inline const char *private__symbol_database_string(tm_allocator_i *a, const tm_symbol_database_t *db, uint32_t entry_idx,
+	char **buffer, uint32_t *buffer_size, uint32_t *length)
+{
+	const char *view = tm_symbol_database_view(db, entry_idx, length);
+	if (view)
+		return view;
+
+	*length = tm_symbol_database_decode(db, entry_idx, *buffer, *buffer_size);
+	if (*length > *buffer_size) {
+		*buffer = tm_realloc(a, *buffer, *buffer_size, *length);
+		*buffer_size = *length;
+		tm_symbol_database_decode(db, entry_idx, *buffer, *buffer_size);
+	}
+	return *buffer;
+}
+
+// Compares the start of the string of the entry with the query like `memcmp()`, only decoding as many characters as the query has.
+// `buffer` needs room for `query_length` characters.
+static inline int private__symbol_database_compare_prefix(const tm_symbol_database_t *db, uint32_t entry_idx, const char *query, uint32_t query_length, char *buffer)
+{
+	uint32_t length;
+	const char *string = tm_symbol_database_view(db, entry_idx, &length);
+	if (!string) {
+		length = tm_symbol_database_decode(db, entry_idx, buffer, query_length);
+		string = buffer;
+	}
+
+	const int result = memcmp(string, query, tm_min(length, query_length));
+	return result ? result : length < query_length ? -1 : 0;
+}
+
+static inline bool private__symbol_database_contains(const char *string, uint32_t length, const char *query, uint32_t query_length)
+{
+	if (!query_length)
+		return true;
+
+	for (const char *s = string, *end = string + length; (uint32_t)(end - s) >= query_length; ++s) {
+		s = memchr(s, query[0], end - s - query_length + 1);
+		if (!s)
+			return false;
+		if (!memcmp(s, query, query_length))
+			return true;
+	}
+	return false;
+}
+
+// Called by `tm_symbol_database_find()` for every entry that matches.
+typedef void tm_symbol_database_match_f(void *user_data, const tm_symbol_database_t *db, uint32_t entry_idx);
+
+// Decoding a string to check it costs about as much as reading this many bytes of postings. Posting lists are
+// only intersected as long as that's cheaper than checking the strings that are left.
+#define private__symbol_database_check_cost 256
+
+// Finds the strings of a database with a search index that contain the query, see search_index.inl.
+static inline uint32_t private__symbol_database_find_substring(tm_allocator_i *a, const tm_symbol_database_t *db, const char *query, uint32_t query_length,
+	tm_symbol_database_match_f *match, void *user_data)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const uint32_t list_count = query_length - 2;
+	const uint8_t **lists = tm_temp_alloc(ta, list_count * sizeof(uint8_t *) * 2);
+	const uint8_t **list_ends = lists + list_count;
+	bool found = true;
+	for (uint32_t i = 0; i < list_count && found; ++i) {
+		found = tm_symbol_search_index_postings(&db->search, tm_symbol_search__trigram(query + i), lists + i, list_ends + i);
+
+		// The shortest lists are intersected first.
+		for (uint32_t j = i; found && j > 0 && list_ends[j] - lists[j] < list_ends[j - 1] - lists[j - 1]; --j) {
+			const uint8_t *list = lists[j], *list_end = list_ends[j];
+			lists[j] = lists[j - 1];
+			list_ends[j] = list_ends[j - 1];
+			lists[j - 1] = list;
+			list_ends[j - 1] = list_end;
+		}
+	}
+
+	// (carray) Positions in `sorted` of the strings that contain all trigrams intersected so far.
+	uint32_t *candidates = 0;
+	uint64_t position = 0;
+	for (const uint8_t *p = found ? lists[0] : 0; p && p < list_ends[0];) {
+		uint64_t delta;
+		p = tm_binary_handler_read_varint(p, list_ends[0], &delta);
+		position += delta;
+		if (p && position < db->index.entry_count)
+			tm_carray_temp_push(candidates, (uint32_t)position, ta);
+	}
+
+	for (uint32_t i = 1; i < list_count && tm_carray_size(candidates); ++i) {
+		if ((uint64_t)(list_ends[i] - lists[i]) > tm_carray_size(candidates) * private__symbol_database_check_cost)
+			break;
+
+		uint64_t kept = 0, candidate = 0;
+		position = 0;
+		for (const uint8_t *p = lists[i]; p && p < list_ends[i] && candidate < tm_carray_size(candidates);) {
+			uint64_t delta;
+			p = tm_binary_handler_read_varint(p, list_ends[i], &delta);
+			position += delta;
+			while (candidate < tm_carray_size(candidates) && candidates[candidate] < position)
+				++candidate;
+			if (candidate < tm_carray_size(candidates) && candidates[candidate] == position)
+				candidates[kept++] = candidates[candidate++];
+		}
+		tm_carray_shrink(candidates, kept);
+	}
+
+	uint32_t match_count = 0;
+	char *buffer = 0;
+	uint32_t buffer_size = 0;
+	for (uint64_t i = 0; i < tm_carray_size(candidates); ++i) {
+		const uint32_t entry_idx = db->search.sorted[candidates[i]];
+		uint32_t length;
+		if (entry_idx >= db->index.entry_count)
+			continue;
+
+		const char *string = private__symbol_database_string(a, db, entry_idx, &buffer, &buffer_size, &length);
+		if (private__symbol_database_contains(string, length, query, query_length)) {
+			match(user_data, db, entry_idx);
+			++match_count;
+		}
+	}
+
+	tm_free(a, buffer, buffer_size);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return match_count;
+}
+
+// Calls `match` for every entry whose string starts with the query or, if `substring` is set, contains it and returns their number.
+// With a search index the entries are found without decoding all strings and are visited in the order of their strings,
+// otherwise every string is checked in index order.
+static inline uint32_t tm_symbol_database_find(tm_allocator_i *a, const tm_symbol_database_t *db, const char *query, uint32_t query_length, bool substring,
+	tm_symbol_database_match_f *match, void *user_data)
+{
+	const uint32_t count = db->index.entry_count;
+	const bool indexed = db->flags & TM_HDB_FLAGS_SEARCH_INDEX;
+	// Shorter queries have no trigrams to look up.
+	if (indexed && substring && query_length >= 3)
+		return private__symbol_database_find_substring(a, db, query, query_length, match, user_data);
+
+	char *buffer = tm_alloc(a, query_length + 1ull);
+	uint32_t buffer_size = query_length + 1, first = 0, last = count;
+	if (indexed && !substring) {
+		// Lower and upper bound of the strings starting with the query.
+		for (uint32_t end = count; first < end;) {
+			const uint32_t middle = first + ((end - first) >> 1);
+			const uint32_t entry_idx = tm_min(db->search.sorted[middle], count - 1);
+			if (private__symbol_database_compare_prefix(db, entry_idx, query, query_length, buffer) < 0)
+				first = middle + 1;
+			else
+				end = middle;
+		}
+		for (uint32_t start = first; start < last;) {
+			const uint32_t middle = start + ((last - start) >> 1);
+			const uint32_t entry_idx = tm_min(db->search.sorted[middle], count - 1);
+			if (private__symbol_database_compare_prefix(db, entry_idx, query, query_length, buffer) <= 0)
+				start = middle + 1;
+			else
+				last = middle;
+		}
+	}
+
+	uint32_t match_count = 0;
+	for (uint32_t i = first; i < last; ++i) {
+		const uint32_t entry_idx = indexed ? db->search.sorted[i] : i;
+		if (entry_idx >= count)
+			continue;
+
+		bool matches = true;
+		if (substring) {
+			uint32_t length;
+			const char *string = private__symbol_database_string(a, db, entry_idx, &buffer, &buffer_size, &length);
+			matches = private__symbol_database_contains(string, length, query, query_length);
+		}
+		else if (!indexed)
+			matches = !private__symbol_database_compare_prefix(db, entry_idx, query, query_length, buffer);
+
+		if (matches) {
+			match(user_data, db, entry_idx);
+			++match_count;
+		}
+	}
+
+	tm_free(a, buffer, buffer_size);
+	return match_count;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include <xmmintrin.h>
+
+// Split block Bloom filter over a set of hashes, used to reject hashes that aren't in a database without searching it.
+// Every hash sets two bits in each of the four words of a single 32 byte block, so a lookup reads one cache line.
+// With 16 bits per hash about 0.13% of the hashes that aren't in the set pass the filter.
+//
+// Generated databases store their filter at the end of the file (see `TM_HDB_FLAGS_FILTER`):
+//   padding to the block size, uint64_t blocks[block_count * TM_SYMBOL_FILTER_BLOCK_WORDS], uint64_t block_count
+
+#define TM_SYMBOL_FILTER_BLOCK_WORDS 4
+#define tm_symbol_filter__block_size (TM_SYMBOL_FILTER_BLOCK_WORDS * sizeof(uint64_t))
+#define TM_SYMBOL_FILTER_BITS_PER_HASH 16
+
+typedef struct tm_symbol_filter_t
+{
+	// `block_count` blocks aligned to the block size, pointing either into a database or into `allocation`.
+	const uint64_t *blocks;
+	uint64_t block_count;
+	void *allocation;
+} tm_symbol_filter_t;
+
+static inline uint64_t tm_symbol_filter_block_count(uint64_t hash_count)
+{
+	return tm_max(1, (hash_count * TM_SYMBOL_FILTER_BITS_PER_HASH + tm_symbol_filter__block_size * 8 - 1) / (tm_symbol_filter__block_size * 8));
+}
+
+// The upper half of the hash picks the block, the lower half the bits within it.
+static inline uint64_t tm_symbol_filter_block(uint64_t block_count, uint64_t hash)
+{
+	return ((hash >> 32) * block_count) >> 32;
+}
+
+static inline void tm_symbol_filter_masks(uint64_t hash, uint64_t masks[TM_SYMBOL_FILTER_BLOCK_WORDS])
+{
+	static const uint32_t salts[TM_SYMBOL_FILTER_BLOCK_WORDS * 2] = {
+		0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+	};
+
+	const uint32_t key = (uint32_t)hash;
+	for (uint32_t i = 0; i < TM_SYMBOL_FILTER_BLOCK_WORDS; ++i)
+		masks[i] = (1ull << ((key * salts[i * 2]) >> 27)) | (1ull << (32 + ((key * salts[i * 2 + 1]) >> 27)));
+}
+
+// Allocates an empty filter for `hash_count` hashes.
+static inline tm_symbol_filter_t tm_symbol_filter_create(tm_allocator_i *a, uint64_t hash_count)
+{
+	tm_symbol_filter_t filter = { .block_count = tm_symbol_filter_block_count(hash_count) };
+	const uint64_t size = (filter.block_count + 1) * tm_symbol_filter__block_size;
+	filter.allocation = tm_alloc(a, size);
+	memset(filter.allocation, 0, size);
+	filter.blocks = (const uint64_t *)(((uintptr_t)filter.allocation + tm_symbol_filter__block_size - 1) & ~(uintptr_t)(tm_symbol_filter__block_size - 1));
+	return filter;
+}
+
+static inline void tm_symbol_filter_free(tm_allocator_i *a, tm_symbol_filter_t *filter)
+{
+	if (filter->allocation)
+		tm_free(a, filter->allocation, (filter->block_count + 1) * tm_symbol_filter__block_size);
+
+	*filter = (tm_symbol_filter_t) { 0 };
+}
+
+// Only for filters created with `tm_symbol_filter_create()`.
+static inline void tm_symbol_filter_insert(tm_symbol_filter_t *filter, uint64_t hash)
+{
+	uint64_t masks[TM_SYMBOL_FILTER_BLOCK_WORDS];
+	tm_symbol_filter_masks(hash, masks);
+
+	uint64_t *block = (uint64_t *)filter->blocks + tm_symbol_filter_block(filter->block_count, hash) * TM_SYMBOL_FILTER_BLOCK_WORDS;
+	for (uint32_t i = 0; i < TM_SYMBOL_FILTER_BLOCK_WORDS; ++i)
+		block[i] |= masks[i];
+}
+
+// Returns false if the hash is definitely not in the set. An empty filter (no blocks) passes every hash.
+static inline bool tm_symbol_filter_contains(const tm_symbol_filter_t *filter, uint64_t hash)
+{
+	if (!filter->block_count)
+		return true;
+
+	uint64_t masks[TM_SYMBOL_FILTER_BLOCK_WORDS];
+	tm_symbol_filter_masks(hash, masks);
+
+	const uint64_t *block = filter->blocks + tm_symbol_filter_block(filter->block_count, hash) * TM_SYMBOL_FILTER_BLOCK_WORDS;
+	uint64_t missing = 0;
+	for (uint32_t i = 0; i < TM_SYMBOL_FILTER_BLOCK_WORDS; ++i)
+		missing |= masks[i] & ~block[i];
+
+	return !missing;
+}
+
+static inline void tm_symbol_filter_prefetch(const tm_symbol_filter_t *filter, uint64_t hash)
+{
+	if (filter->block_count)
+		_mm_prefetch((const char *)(filter->blocks + tm_symbol_filter_block(filter->block_count, hash) * TM_SYMBOL_FILTER_BLOCK_WORDS), _MM_HINT_T0);
+}
+
+// Size of the filter stored after `data_end` bytes of database, including the padding and the block count.
+static inline uint64_t tm_symbol_filter_file_size(uint64_t data_end, uint64_t block_count)
+{
+	const uint64_t padding = (tm_symbol_filter__block_size - data_end % tm_symbol_filter__block_size) % tm_symbol_filter__block_size;
+	return padding + block_count * tm_symbol_filter__block_size + sizeof(uint64_t);
+}
+
+// Writes the filter after the `data_end` bytes of database already written to the file.
+static inline bool tm_symbol_filter_write(tm_file_o file, uint64_t data_end, const tm_symbol_filter_t *filter)
+{
+	static const char zeros[tm_symbol_filter__block_size] = { 0 };
+	const uint64_t padding = tm_symbol_filter_file_size(data_end, filter->block_count) - filter->block_count * tm_symbol_filter__block_size - sizeof(uint64_t);
+	const uint64_t blocks_offset = data_end + padding;
+	return (!padding || tm_os_api->file_io->write_at(file, data_end, zeros, padding))
+		&& tm_os_api->file_io->write_at(file, blocks_offset, filter->blocks, filter->block_count * tm_symbol_filter__block_size)
+		&& tm_os_api->file_io->write_at(file, blocks_offset + filter->block_count * tm_symbol_filter__block_size, &filter->block_count, sizeof(uint64_t));
+}
+
+// Points the filter at the blocks stored at the end of a mapped database of `size` bytes.
+// Returns false unless they fit between `data_end`, the end of the data known to precede them, and the end of the file.
+static inline bool tm_symbol_filter_view(const char *data, uint64_t size, uint64_t data_end, tm_symbol_filter_t *filter)
+{
+	uint64_t block_count;
+	if (size < data_end + sizeof(uint64_t))
+		return false;
+
+	memcpy(&block_count, data + size - sizeof(uint64_t), sizeof(uint64_t));
+	if (!block_count || block_count > (size - data_end) / tm_symbol_filter__block_size)
+		return false;
+
+	const uint64_t blocks_offset = size - sizeof(uint64_t) - block_count * tm_symbol_filter__block_size;
+	if (blocks_offset < data_end || blocks_offset % tm_symbol_filter__block_size)
+		return false;
+
+	*filter = (tm_symbol_filter_t) { .blocks = (const uint64_t *)(data + blocks_offset), .block_count = block_count };
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,337 @@
+// Compression with a table of up to 255 symbols of one to eight bytes, in the style of FSST (Fast Static Symbol Table).
+// Every byte of a compressed string is the code of a symbol, or `TM_FSST_ESCAPE` followed by a byte that has no symbol,
+// so decoding takes one table lookup and one copy per symbol and every string can be decoded on its own.
+// The table is trained on a sample of the strings when the database is generated, see `tm_fsst_train()`.
+//
+// Databases with `TM_HDB_FLAGS_FSST` store the table after the index:
+//   uint8_t symbol_count, uint8_t lengths[symbol_count], the bytes of the symbols one after another
+
+#define TM_FSST_MAX_SYMBOL_LENGTH 8
+#define TM_FSST_MAX_SYMBOLS 255
+#define TM_FSST_ESCAPE 255
+// Bytes of strings the table is trained on.
+#define TM_FSST_SAMPLE_SIZE (64 * 1024)
+#define TM_FSST_TRAINING_ROUNDS 5
+
+typedef struct tm_fsst_table_t
+{
+	// The bytes of every symbol, zero past its length, so a symbol is decoded with a single eight byte copy.
+	uint64_t symbols[256];
+	uint8_t lengths[256];
+	uint32_t symbol_count;
+	TM_PAD(4);
+} tm_fsst_table_t;
+
+// Reads a table stored in a database, returns the number of bytes read or zero if they don't describe a valid table.
+static inline uint64_t tm_fsst_table_read(tm_fsst_table_t *table, const char *data, uint64_t size)
+{
+	memset(table, 0, sizeof(tm_fsst_table_t));
+	if (!size)
+		return 0;
+
+	// A count byte can't exceed `TM_FSST_MAX_SYMBOLS`, so the escape code never has a symbol.
+	table->symbol_count = (uint8_t)data[0];
+	uint64_t offset = 1 + table->symbol_count;
+	if (offset > size)
+		return 0;
+
+	for (uint32_t i = 0; i < table->symbol_count; ++i) {
+		const uint8_t length = (uint8_t)data[1 + i];
+		if (!length || length > TM_FSST_MAX_SYMBOL_LENGTH || offset + length > size)
+			return 0;
+
+		table->lengths[i] = length;
+		memcpy(table->symbols + i, data + offset, length);
+		offset += length;
+	}
+
+	return offset;
+}
+
+static inline uint64_t tm_fsst_table_size(const tm_fsst_table_t *table)
+{
+	uint64_t size = 1 + table->symbol_count;
+	for (uint32_t i = 0; i < table->symbol_count; ++i)
+		size += table->lengths[i];
+
+	return size;
+}
+
+// Writes the table the way `tm_fsst_table_read()` reads it, `data` needs `tm_fsst_table_size()` bytes.
+static inline void tm_fsst_table_write(const tm_fsst_table_t *table, char *data)
+{
+	data[0] = (char)table->symbol_count;
+	uint64_t offset = 1 + table->symbol_count;
+	for (uint32_t i = 0; i < table->symbol_count; ++i) {
+		data[1 + i] = (char)table->lengths[i];
+		memcpy(data + offset, table->symbols + i, table->lengths[i]);
+		offset += table->lengths[i];
+	}
+}
+
+// Decodes the `size` code bytes at `src` into `buffer` and returns the number of characters.
+// At most `buffer_size` characters are written.
+static inline uint32_t tm_fsst_decode(const tm_fsst_table_t *table, const uint8_t *src, uint64_t size, char *buffer, uint32_t buffer_size)
+{
+	const uint8_t *end = src + size;
+	uint32_t length = 0;
+
+	// Symbols are copied whole as long as there's room for eight more characters.
+	while (src < end && length + TM_FSST_MAX_SYMBOL_LENGTH <= buffer_size) {
+		const uint8_t code = *src++;
+		if (code != TM_FSST_ESCAPE) {
+			memcpy(buffer + length, table->symbols + code, sizeof(uint64_t));
+			length += table->lengths[code];
+		}
+		else if (src < end)
+			buffer[length++] = (char)*src++;
+	}
+
+	while (src < end) {
+		const uint8_t code = *src++;
+		const char *symbol = (const char *)(table->symbols + code);
+		uint32_t symbol_length = table->lengths[code];
+		if (code == TM_FSST_ESCAPE) {
+			if (src == end)
+				break;
+			symbol = (const char *)src++;
+			symbol_length = 1;
+		}
+
+		if (length < buffer_size)
+			memcpy(buffer + length, symbol, tm_min(symbol_length, buffer_size - length));
+		length += symbol_length;
+	}
+
+	return length;
+}
+
+// Finds the code in the `size` code bytes at `src` that starts `char_offset` characters into the decoded string.
+// Returns false if `char_offset` is in the middle of a symbol.
+static inline bool tm_fsst_code_offset(const tm_fsst_table_t *table, const uint8_t *src, uint64_t size, uint64_t char_offset, uint64_t *code_offset)
+{
+	uint64_t offset = 0, chars = 0;
+	while (chars < char_offset && offset < size) {
+		const uint8_t code = src[offset++];
+		chars += code == TM_FSST_ESCAPE ? 1 : table->lengths[code];
+		offset += code == TM_FSST_ESCAPE;
+	}
+
+	*code_offset = offset;
+	return chars == char_offset;
+}
+
+// The codes of the symbols sorted by their first byte and longest first within each, for finding the longest symbol
+// a string starts with.
+typedef struct tm_fsst_encoder_t
+{
+	const tm_fsst_table_t *table;
+	// The codes of the symbols starting with byte `b` are `codes[first[b]]` up to `codes[first[b + 1]]`.
+	uint16_t first[257];
+	uint8_t codes[256];
+	TM_PAD(6);
+} tm_fsst_encoder_t;
+
+static inline void tm_fsst_encoder_create(const tm_fsst_table_t *table, tm_fsst_encoder_t *encoder)
+{
+	memset(encoder, 0, sizeof(tm_fsst_encoder_t));
+	encoder->table = table;
+
+	for (uint32_t i = 0; i < table->symbol_count; ++i)
+		++encoder->first[(uint8_t)table->symbols[i] + 1];
+	for (uint32_t b = 0; b < 256; ++b)
+		encoder->first[b + 1] += encoder->first[b];
+
+	uint16_t next[256];
+	memcpy(next, encoder->first, sizeof(next));
+	for (uint32_t i = 0; i < table->symbol_count; ++i) {
+		const uint8_t b = (uint8_t)table->symbols[i];
+		uint32_t j = next[b]++;
+		// Insertion sort by length within the byte, the lists are short.
+		for (; j > encoder->first[b] && table->lengths[encoder->codes[j - 1]] < table->lengths[i]; --j)
+			encoder->codes[j] = encoder->codes[j - 1];
+		encoder->codes[j] = (uint8_t)i;
+	}
+}
+
+// Returns the code of the longest symbol the string starts with and sets `length` to its length,
+// or returns `TM_FSST_ESCAPE` with a length of one if there is none.
+static inline uint32_t tm_fsst_encoder_match(const tm_fsst_encoder_t *encoder, const uint8_t *string, uint32_t remaining, uint32_t *length)
+{
+	uint64_t word = 0;
+	memcpy(&word, string, tm_min(remaining, sizeof(uint64_t)));
+
+	const tm_fsst_table_t *table = encoder->table;
+	for (uint32_t i = encoder->first[string[0]]; i < encoder->first[string[0] + 1]; ++i) {
+		const uint8_t code = encoder->codes[i];
+		const uint32_t symbol_length = table->lengths[code];
+		const uint64_t mask = symbol_length == sizeof(uint64_t) ? ~0ull : (1ull << (symbol_length << 3)) - 1;
+		if (symbol_length <= remaining && (word & mask) == table->symbols[code]) {
+			*length = symbol_length;
+			return code;
+		}
+	}
+
+	*length = 1;
+	return TM_FSST_ESCAPE;
+}
+
+// Encodes the string into `dst`, which needs two bytes per character, and returns the number of code bytes.
+// With a null `dst` only the number of code bytes is returned.
+static inline uint32_t tm_fsst_encode(const tm_fsst_encoder_t *encoder, const uint8_t *string, uint32_t length, uint8_t *dst)
+{
+	uint32_t size = 0;
+	for (uint32_t i = 0; i < length;) {
+		uint32_t symbol_length;
+		const uint32_t code = tm_fsst_encoder_match(encoder, string + i, length - i, &symbol_length);
+		if (dst) {
+			dst[size] = (uint8_t)code;
+			if (code == TM_FSST_ESCAPE)
+				dst[size + 1] = string[i];
+		}
+
+		size += code == TM_FSST_ESCAPE ? 2 : 1;
+		i += symbol_length;
+	}
+
+	return size;
+}
+
+// Strings the table is trained on.
+typedef struct tm_fsst_sample_t
+{
+	uint8_t bytes[TM_FSST_SAMPLE_SIZE];
+	uint32_t lengths[TM_FSST_SAMPLE_SIZE];
+	uint32_t size;
+	uint32_t count;
+} tm_fsst_sample_t;
+
+// Adds the string if it fits in what's left of the sample.
+static inline void tm_fsst_sample_add(tm_fsst_sample_t *sample, const char *string, uint32_t length)
+{
+	if (!length || length > TM_FSST_SAMPLE_SIZE - sample->size)
+		return;
+
+	memcpy(sample->bytes + sample->size, string, length);
+	sample->lengths[sample->count++] = length;
+	sample->size += length;
+}
+
+// A symbol that could be added to the table and the bytes it would have saved in the last round.
+typedef struct private__fsst_candidate_t
+{
+	uint64_t symbol;
+	uint64_t gain;
+	uint32_t length;
+	TM_PAD(4);
+} private__fsst_candidate_t;
+
+static int private__fsst_candidate_symbol_compare(const void *a, const void *b)
+{
+	const private__fsst_candidate_t *candidate_a = a, *candidate_b = b;
+	if (candidate_a->length != candidate_b->length)
+		return candidate_a->length < candidate_b->length ? -1 : 1;
+	return (candidate_a->symbol > candidate_b->symbol) - (candidate_a->symbol < candidate_b->symbol);
+}
+
+// Highest gain first, ties are broken by symbol so the table only depends on the sample.
+static int private__fsst_candidate_gain_compare(const void *a, const void *b)
+{
+	const private__fsst_candidate_t *candidate_a = a, *candidate_b = b;
+	if (candidate_a->gain != candidate_b->gain)
+		return candidate_a->gain > candidate_b->gain ? -1 : 1;
+	return private__fsst_candidate_symbol_compare(a, b);
+}
+
+// Candidates are the symbols of the table, codes 0-255, and the single bytes, codes 256-511.
+#define private__fsst_candidate_codes 512
+
+// Starting from an empty table, every round encodes the sample with the current table and builds the next table from
+// the symbols, single bytes and concatenations of adjacent symbols that would have saved the most bytes.
+static inline void tm_fsst_train(tm_allocator_i *a, const tm_fsst_sample_t *sample, tm_fsst_table_t *table)
+{
+	memset(table, 0, sizeof(tm_fsst_table_t));
+
+	const uint64_t pair_counts_size = private__fsst_candidate_codes * private__fsst_candidate_codes * sizeof(uint32_t);
+	uint32_t *pair_counts = tm_alloc(a, pair_counts_size);
+	uint32_t counts[private__fsst_candidate_codes];
+	const uint64_t candidates_capacity = private__fsst_candidate_codes + sample->size;
+	private__fsst_candidate_t *candidates = tm_alloc(a, candidates_capacity * sizeof(private__fsst_candidate_t));
+
+	for (uint32_t round = 0; round < TM_FSST_TRAINING_ROUNDS; ++round) {
+		tm_fsst_encoder_t encoder;
+		tm_fsst_encoder_create(table, &encoder);
+		memset(counts, 0, sizeof(counts));
+		memset(pair_counts, 0, pair_counts_size);
+
+		const uint8_t *string = sample->bytes;
+		for (uint32_t i = 0; i < sample->count; string += sample->lengths[i++]) {
+			uint32_t previous = private__fsst_candidate_codes;
+			for (uint32_t offset = 0; offset < sample->lengths[i];) {
+				uint32_t length;
+				uint32_t code = tm_fsst_encoder_match(&encoder, string + offset, sample->lengths[i] - offset, &length);
+				if (code == TM_FSST_ESCAPE)
+					code = 256 + string[offset];
+				// The first byte is a candidate of its own, in case the longer symbol doesn't make it into the next table.
+				else if (length > 1)
+					++counts[256 + string[offset]];
+
+				++counts[code];
+				if (previous < private__fsst_candidate_codes)
+					++pair_counts[previous * private__fsst_candidate_codes + code];
+				previous = code;
+				offset += length;
+			}
+		}
+
+		uint64_t candidate_count = 0;
+		for (uint32_t code = 0; code < private__fsst_candidate_codes; ++code) {
+			const uint32_t length = code < 256 ? table->lengths[code] : 1;
+			if (counts[code] && length)
+				candidates[candidate_count++] = (private__fsst_candidate_t) { .symbol = code < 256 ? table->symbols[code] : code - 256, .gain = (uint64_t)counts[code] * length, .length = length };
+		}
+
+		// Every pair was counted at a position of the sample, so there are fewer pairs than bytes in the sample.
+		for (uint32_t first = 0; first < private__fsst_candidate_codes; ++first) {
+			const uint32_t first_length = first < 256 ? table->lengths[first] : 1;
+			if (!counts[first] || first_length == TM_FSST_MAX_SYMBOL_LENGTH)
+				continue;
+
+			const uint64_t first_symbol = first < 256 ? table->symbols[first] : first - 256;
+			for (uint32_t second = 0; second < private__fsst_candidate_codes; ++second) {
+				const uint32_t count = pair_counts[first * private__fsst_candidate_codes + second];
+				if (!count || candidate_count == candidates_capacity)
+					continue;
+
+				const uint32_t second_length = second < 256 ? table->lengths[second] : 1;
+				const uint64_t second_symbol = second < 256 ? table->symbols[second] : second - 256;
+				const uint32_t length = tm_min(first_length + second_length, TM_FSST_MAX_SYMBOL_LENGTH);
+				uint64_t symbol = first_symbol | second_symbol << (first_length << 3);
+				if (length < TM_FSST_MAX_SYMBOL_LENGTH)
+					symbol &= (1ull << (length << 3)) - 1;
+				candidates[candidate_count++] = (private__fsst_candidate_t) { .symbol = symbol, .gain = (uint64_t)count * length, .length = length };
+			}
+		}
+
+		// The same symbol can be a candidate several times, their gains are summed.
+		qsort(candidates, candidate_count, sizeof(private__fsst_candidate_t), private__fsst_candidate_symbol_compare);
+		uint64_t unique_count = 0;
+		for (uint64_t i = 0; i < candidate_count; ++i) {
+			if (unique_count && !private__fsst_candidate_symbol_compare(candidates + unique_count - 1, candidates + i))
+				candidates[unique_count - 1].gain += candidates[i].gain;
+			else
+				candidates[unique_count++] = candidates[i];
+		}
+
+		qsort(candidates, unique_count, sizeof(private__fsst_candidate_t), private__fsst_candidate_gain_compare);
+		memset(table, 0, sizeof(tm_fsst_table_t));
+		table->symbol_count = (uint32_t)tm_min(unique_count, TM_FSST_MAX_SYMBOLS);
+		for (uint32_t i = 0; i < table->symbol_count; ++i) {
+			table->symbols[i] = candidates[i].symbol;
+			table->lengths[i] = (uint8_t)candidates[i].length;
+		}
+	}
+
+	tm_free(a, candidates, candidates_capacity * sizeof(private__fsst_candidate_t));
+	tm_free(a, pair_counts, pair_counts_size);
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <xmmintrin.h>
+
+// Open addressing hash table that maps every hash of a set of databases to its (database, entry) pair.
+// Hashes are murmur hashes already, so their low bits are used as the slot directly.
+typedef struct tm_symbol_global_slot_t
+{
+	uint64_t hash;
+	// Index of the database + 1, zero marks an empty slot.
+	uint32_t database;
+	uint32_t entry_idx;
+} tm_symbol_global_slot_t;
+
+typedef struct tm_symbol_global_index_t
+{
+	tm_symbol_global_slot_t *slots;
+	uint64_t mask;
+	uint32_t entry_count;
+	// Number of hashes that were found in more than one database, only the first one is kept.
+	uint32_t duplicate_count;
+	// Rejects most hashes that aren't in any database before any slot is probed.
+	// A single database's own filter is used as is, otherwise one is built over all databases.
+	tm_symbol_filter_t filter;
+} tm_symbol_global_index_t;
+
+static inline void tm_symbol_global_index_insert(tm_symbol_global_index_t *index, uint64_t hash, uint32_t database, uint32_t entry_idx)
+{
+	for (uint64_t slot = hash & index->mask;; slot = (slot + 1) & index->mask) {
+		tm_symbol_global_slot_t *s = index->slots + slot;
+		if (!s->database) {
+			*s = (tm_symbol_global_slot_t) { .hash = hash, .database = database + 1, .entry_idx = entry_idx };
+			++index->entry_count;
+			return;
+		}
+
+		if (s->hash == hash) {
+			++index->duplicate_count;
+			return;
+		}
+	}
+}
+
+// Number of hashes in all databases, counting duplicates.
+static inline uint64_t tm_symbol_global_index_total(const tm_symbol_database_t *databases, uint32_t database_count)
+{
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < database_count; ++i)
+		total += databases[i].index.entry_count;
+	return total;
+}
+
+// Number of slots of an index over `total` hashes. Keep the load factor at or below 50% so most lookups resolve in a single probe.
+static inline uint64_t tm_symbol_global_index_capacity(uint64_t total)
+{
+	uint64_t capacity = 16;
+	while (capacity < total << 1)
+		capacity <<= 1;
+	return capacity;
+}
+
+// A single database's own filter is used as is, otherwise one is built over all databases.
+static inline bool tm_symbol_global_index_builds_filter(const tm_symbol_database_t *databases, uint32_t database_count)
+{
+	return database_count != 1 || !databases[0].filter.block_count;
+}
+
+// Inserts the hashes of all databases into an index with empty slots and, if `build_filter` is set, an empty filter.
+// Databases earlier in the array take precedence for duplicate hashes.
+static inline void tm_symbol_global_index_fill(tm_symbol_global_index_t *index, const tm_symbol_database_t *databases, uint32_t database_count, bool build_filter)
+{
+	for (uint32_t i = 0; i < database_count; ++i) {
+		const tm_symbol_index_t *db_index = &databases[i].index;
+		for (uint32_t j = 0; j < db_index->entry_count; ++j) {
+			tm_symbol_global_index_insert(index, db_index->hashes[j], i, j);
+			if (build_filter)
+				tm_symbol_filter_insert(&index->filter, db_index->hashes[j]);
+		}
+	}
+}
+
+// Builds the index over all databases, databases earlier in the array take precedence for duplicate hashes.
+static inline tm_symbol_global_index_t tm_symbol_global_index_create(tm_allocator_i *a, const tm_symbol_database_t *databases, uint32_t database_count)
+{
+	const uint64_t total = tm_symbol_global_index_total(databases, database_count);
+	const uint64_t capacity = tm_symbol_global_index_capacity(total);
+
+	tm_symbol_global_index_t index = { .mask = capacity - 1 };
+	index.slots = tm_alloc(a, capacity * sizeof(tm_symbol_global_slot_t));
+	memset(index.slots, 0, capacity * sizeof(tm_symbol_global_slot_t));
+
+	const bool build_filter = tm_symbol_global_index_builds_filter(databases, database_count);
+	index.filter = build_filter ? tm_symbol_filter_create(a, total) : databases[0].filter;
+
+	tm_symbol_global_index_fill(&index, databases, database_count, build_filter);
+	return index;
+}
+
+// Adds the number of slots that were probed to `probes`.
+static inline bool tm_symbol_global_index_try_search(const tm_symbol_global_index_t *index, uint64_t hash, uint32_t *database, uint32_t *entry_idx, uint32_t *probes)
+{
+	if (!index->slots)
+		return false;
+
+	// The first slot is requested before the filter is checked, so a hit waits for both in parallel.
+	_mm_prefetch((const char *)(index->slots + (hash & index->mask)), _MM_HINT_T0);
+	if (!tm_symbol_filter_contains(&index->filter, hash))
+		return false;
+
+	for (uint64_t slot = hash & index->mask;; slot = (slot + 1) & index->mask) {
+		const tm_symbol_global_slot_t *s = index->slots + slot;
+		++*probes;
+		if (!s->database)
+			return false;
+
+		if (s->hash == hash) {
+			*database = s->database - 1;
+			*entry_idx = s->entry_idx;
+			return true;
+		}
+	}
+}
+
+// Starts loading the filter block and the slot of the hash into the cache, so a later search doesn't stall on them.
+static inline void tm_symbol_global_index_prefetch(const tm_symbol_global_index_t *index, uint64_t hash)
+{
+	if (index->slots) {
+		tm_symbol_filter_prefetch(&index->filter, hash);
+		_mm_prefetch((const char *)(index->slots + (hash & index->mask)), _MM_HINT_T0);
+	}
+}
+
+static inline void tm_symbol_global_index_free(tm_allocator_i *a, tm_symbol_global_index_t *index)
+{
+	if (index->slots)
+		tm_free(a, index->slots, (index->mask + 1) * sizeof(tm_symbol_global_slot_t));
+
+	tm_symbol_filter_free(a, &index->filter);
+	*index = (tm_symbol_global_index_t) { 0 };
+}
\ No newline at end of file
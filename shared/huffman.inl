@@ -14,12 +14,29 @@ typedef struct tm_huffman_tree_t
 	uint32_t node_count;
 	TM_PAD(4);
 	tm_huffman_node_t *nodes;
-	uint32_t code_lut[0xFF];
+	// Optional table for `tm_huffman_tree_decode_string()`, see `tm_huffman_tree_create_decode_lut()`.
+	uint32_t *decode_lut;
+	uint32_t code_lut[256];
 } tm_huffman_tree_t;
 
 #define tm_huffman_code__bit_count(code)	((code) >> 24)
 #define tm_huffman_code__code_word(code)	((code) & 0x00FFFFFF)
 
+// Number of bits resolved by a single probe of the decode table.
+#define TM_HUFFMAN_DECODE_LUT_BITS 12
+
+// Longest code `tm_huffman_tree_create()` generates, so every code resolves with a single decode table probe.
+#define TM_HUFFMAN_MAX_CODE_LENGTH TM_HUFFMAN_DECODE_LUT_BITS
+
+// Longest code that fits in the code word of `code_lut`.
+#define TM_HUFFMAN_MAX_CODE_WORD_LENGTH 24
+
+// Decode table entries store the character in the low byte and the length of its code in the second byte.
+// Codes longer than the table have a length of zero and store the node to continue the tree walk from instead.
+#define tm_huffman_lut__data(entry)			((char)((entry) & 0xFF))
+#define tm_huffman_lut__bit_count(entry)	(((entry) >> 8) & 0xFF)
+#define tm_huffman_lut__node(entry)			((entry) >> 16)
+
 typedef struct private__huffman_heap_node_t
 {
 	uint8_t data;
@@ -71,55 +88,42 @@ static inline private__huffman_heap_node_t *private__huffman_node_create(tm_temp
 	return result;
 }
 
-static inline uint32_t private__huffman_convert_heap_to_tree(tm_huffman_tree_t *tree, const private__huffman_heap_node_t *root, uint32_t *idx)
+static inline void private__huffman_count_code_lengths(const private__huffman_heap_node_t *root, uint32_t depth, uint32_t *length_counts)
 {
-	const uint32_t i = (*idx)++;
-
-	tree->nodes[i] = (tm_huffman_node_t) {
-		.data = root->data,
-		.left = root->left ? private__huffman_convert_heap_to_tree(tree, root->left, idx) : 0,
-		.right = root->right ? private__huffman_convert_heap_to_tree(tree, root->right, idx) : 0
-	};
-
-	return i;
+	if (root->left) {
+		private__huffman_count_code_lengths(root->left, depth + 1, length_counts);
+		private__huffman_count_code_lengths(root->right, depth + 1, length_counts);
+	}
+	else
+		++length_counts[tm_max(depth, 1)];
 }
 
-static inline void private__huffman_set_code_word(tm_huffman_tree_t *tree, const private__huffman_heap_node_t *root, uint32_t depth, uint32_t code)
+static inline int private__huffman_symbol_compare(const void *a, const void *b)
 {
-	if (root->data)
-		tree->code_lut[root->data] = ((depth - 1) << 24) | code;
-
-	if (root->left)
-		private__huffman_set_code_word(tree, root->left, depth + 1, code);
-
-	if (root->right)
-		private__huffman_set_code_word(tree, root->right, depth + 1, code | (1 << (depth - 1)));
+	const uint64_t key_a = *(const uint64_t *)a;
+	const uint64_t key_b = *(const uint64_t *)b;
+	return (key_a < key_b) - (key_a > key_b);
 }
 
-static inline tm_huffman_tree_t tm_huffman_tree_create(tm_allocator_i *a, const char **strings)
+// Computes the code length of every byte, limited to `TM_HUFFMAN_MAX_CODE_LENGTH` bits. Unused bytes get a length of zero.
+static inline void tm_huffman_code_lengths(const uint32_t frequencies[256], uint8_t code_lengths[256])
 {
 	TM_INIT_TEMP_ALLOCATOR(ta);
-	const uint32_t string_count = (uint32_t)tm_carray_size(strings);
-	if (string_count == 0)
-		return (tm_huffman_tree_t) { 0 };
-
-	// Calculate character frequency.
-	// This needs to be done with unsigned strings in order to handle unicode characters.
-	uint32_t frequencies[0xFF] = { 0 };
-	for (uint32_t i = 0, j = 0; i < string_count; ++i, j = 0) {
-		const uint8_t *uni_str = (const uint8_t *)strings[i];
-		for (uint8_t c = *uni_str; c != '\0'; c = uni_str[++j])
-			++frequencies[c];
-	}
+	memset(code_lengths, 0, 256);
 
 	// Create temporary heap.
 	private__huffman_heap_t heap = { 0 };
-	for (uint32_t i = 0; i < TM_ARRAY_COUNT(frequencies); ++i)
+	for (uint32_t i = 0; i < 256; ++i)
 		heap.capacity += frequencies[i] > 0;
 
+	if (!heap.capacity) {
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+		return;
+	}
+
 	heap.size = heap.capacity;
 	heap.data = tm_temp_alloc(ta, heap.capacity * sizeof(private__huffman_heap_node_t *));
-	for (uint32_t i = 0, j = 0; i < TM_ARRAY_COUNT(frequencies); ++i) {
+	for (uint32_t i = 0, j = 0; i < 256; ++i) {
 		if (frequencies[i])
 			heap.data[j++] = private__huffman_node_create(ta, (uint8_t)i, frequencies[i]);
 	}
@@ -145,19 +149,121 @@ static inline tm_huffman_tree_t tm_huffman_tree_create(tm_allocator_i *a, const
 		heap.data[i] = top;
 	}
 
-	uint32_t i = 0;
-	const private__huffman_heap_node_t *root = private__huffman_get_min(&heap);
+	uint32_t length_counts[257] = { 0 };
+	private__huffman_count_code_lengths(private__huffman_get_min(&heap), 0, length_counts);
+
+	// Move the leaves that are too deep up the tree, while keeping the code complete.
+	// Each pair of leaves at the deepest level is replaced by one leaf there and two children of a shallower leaf.
+	for (uint32_t i = 256; i > TM_HUFFMAN_MAX_CODE_LENGTH; --i) {
+		while (length_counts[i]) {
+			uint32_t j = i - 2;
+			while (!length_counts[j])
+				--j;
+
+			length_counts[i] -= 2;
+			length_counts[i - 1] += 1;
+			length_counts[j + 1] += 2;
+			length_counts[j] -= 1;
+		}
+	}
+
+	// Hand out the lengths shortest first, ordered by descending frequency and then by byte value.
+	uint64_t symbols[256];
+	uint32_t symbol_count = 0;
+	for (uint32_t i = 0; i < 256; ++i) {
+		if (frequencies[i])
+			symbols[symbol_count++] = ((uint64_t)frequencies[i] << 8) | (255 - i);
+	}
+
+	qsort(symbols, symbol_count, sizeof(uint64_t), private__huffman_symbol_compare);
+	for (uint32_t length = 1, i = 0; length <= TM_HUFFMAN_MAX_CODE_LENGTH; ++length) {
+		for (uint32_t j = 0; j < length_counts[length]; ++j, ++i)
+			code_lengths[255 - (symbols[i] & 0xFF)] = (uint8_t)length;
+	}
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Creates the canonical code for the specified code lengths, as stored in compressed databases.
+// Returns an empty tree if the lengths don't describe a valid prefix code.
+static inline tm_huffman_tree_t tm_huffman_tree_create_from_code_lengths(tm_allocator_i *a, const uint8_t code_lengths[256])
+{
+	tm_huffman_tree_t tree = { 0 };
+	TM_INIT_TEMP_ALLOCATOR(ta);
 
-	// Create result tree and lookup.
-	tm_huffman_tree_t tree = { .node_count = (heap.capacity << 1) - 1 };
-	tree.nodes = tm_alloc(a, tree.node_count * sizeof(tm_huffman_node_t));
-	private__huffman_convert_heap_to_tree(&tree, root, &i);
-	private__huffman_set_code_word(&tree, root, 1, 0);
+	// Every code adds at most one node per bit.
+	const uint32_t node_capacity = 1 + 256 * TM_HUFFMAN_MAX_CODE_WORD_LENGTH;
+	tm_huffman_node_t *nodes = tm_temp_alloc(ta, node_capacity * sizeof(tm_huffman_node_t));
+	memset(nodes, 0, sizeof(tm_huffman_node_t));
+	uint32_t node_count = 1;
+
+	// Canonical codes are assigned in order of length and then byte value. They are stored with their first bit
+	// lowest, since that is the order in which they are read, so the codes are reversed.
+	uint32_t code = 0;
+	for (uint32_t length = 1; length <= TM_HUFFMAN_MAX_CODE_WORD_LENGTH; ++length, code <<= 1) {
+		for (uint32_t c = 1; c < 256; ++c) {
+			if (code_lengths[c] != length)
+				continue;
+
+			if (code >> length) {
+				TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+				return tree;
+			}
+
+			uint32_t code_word = 0;
+			for (uint32_t bit = 0; bit < length; ++bit)
+				code_word |= ((code >> bit) & 1) << (length - 1 - bit);
+			tree.code_lut[c] = (length << 24) | code_word;
+			++code;
+
+			uint32_t node_idx = 0;
+			for (uint32_t bit = 0; bit < length; ++bit) {
+				uint32_t *child = (code_word >> bit) & 1 ? &nodes[node_idx].right : &nodes[node_idx].left;
+				if (!*child) {
+					nodes[node_count] = (tm_huffman_node_t) { 0 };
+					*child = node_count++;
+				}
+
+				node_idx = *child;
+			}
+
+			nodes[node_idx].data = (char)c;
+		}
+	}
+
+	if (node_count > 1) {
+		tree.node_count = node_count;
+		tree.nodes = tm_alloc(a, node_count * sizeof(tm_huffman_node_t));
+		memcpy(tree.nodes, nodes, node_count * sizeof(tm_huffman_node_t));
+	}
 
 	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
 	return tree;
 }
 
+// Counts the bytes of all strings.
+// This needs to be done with unsigned strings in order to handle unicode characters.
+static inline void tm_huffman_count_frequencies(const char **strings, uint32_t frequencies[256])
+{
+	const size_t string_count = tm_carray_size(strings);
+	for (size_t i = 0, j = 0; i < string_count; ++i, j = 0) {
+		const uint8_t *uni_str = (const uint8_t *)strings[i];
+		for (uint8_t c = *uni_str; c != '\0'; c = uni_str[++j])
+			++frequencies[c];
+	}
+}
+
+// Creates a canonical, length limited code for the characters in `strings`.
+static inline tm_huffman_tree_t tm_huffman_tree_create(tm_allocator_i *a, const char **strings)
+{
+	uint32_t frequencies[256] = { 0 };
+	tm_huffman_count_frequencies(strings, frequencies);
+
+	uint8_t code_lengths[256];
+	tm_huffman_code_lengths(frequencies, code_lengths);
+	return tm_huffman_tree_create_from_code_lengths(a, code_lengths);
+}
+
 static inline char tm_huffman_tree_decode(const tm_huffman_tree_t *tree, const char *src, uint64_t *bit_offset)
 {
 	uint32_t cur_idx = 0;
@@ -174,9 +280,113 @@ static inline char tm_huffman_tree_decode(const tm_huffman_tree_t *tree, const c
 	return 0;
 }
 
+// Builds the table used by `tm_huffman_tree_decode_string()` to decode up to `TM_HUFFMAN_DECODE_LUT_BITS` bits at once.
+static inline void tm_huffman_tree_create_decode_lut(tm_allocator_i *a, tm_huffman_tree_t *tree)
+{
+	if (!tree->node_count || tree->decode_lut)
+		return;
+
+	tree->decode_lut = tm_alloc(a, sizeof(uint32_t) << TM_HUFFMAN_DECODE_LUT_BITS);
+	memset(tree->decode_lut, 0, sizeof(uint32_t) << TM_HUFFMAN_DECODE_LUT_BITS);
+
+	// Depth first walk with an explicit stack, codes are read starting at their lowest bit.
+	struct { uint32_t node; uint32_t depth; uint32_t code; } stack[TM_HUFFMAN_DECODE_LUT_BITS + 1];
+	uint32_t stack_size = 1;
+	stack[0].node = stack[0].depth = stack[0].code = 0;
+
+	while (stack_size) {
+		const uint32_t node_idx = stack[--stack_size].node;
+		const uint32_t depth = stack[stack_size].depth;
+		const uint32_t code = stack[stack_size].code;
+		const tm_huffman_node_t *node = tree->nodes + node_idx;
+
+		if (node->data) {
+			const uint32_t entry = (uint8_t)node->data | (depth << 8);
+			for (uint32_t i = code; i < (1u << TM_HUFFMAN_DECODE_LUT_BITS); i += 1u << depth)
+				tree->decode_lut[i] = entry;
+		}
+		else if (depth == TM_HUFFMAN_DECODE_LUT_BITS)
+			tree->decode_lut[code] = node_idx << 16;
+		else {
+			stack[stack_size].node = node->left;
+			stack[stack_size].depth = depth + 1;
+			stack[stack_size++].code = code;
+			stack[stack_size].node = node->right;
+			stack[stack_size].depth = depth + 1;
+			stack[stack_size++].code = code | (1 << depth);
+		}
+	}
+}
+
+// Decodes all characters in the bit range [bit_start, bit_end) of `src` into `buffer` and returns the number of characters.
+// At most `buffer_size` characters are written. Requires the table from `tm_huffman_tree_create_decode_lut()`.
+// Reads the source a 64-bit word at a time, but never past the byte containing `bit_end`.
+static inline uint32_t tm_huffman_tree_decode_string(const tm_huffman_tree_t *tree, const char *src, uint64_t bit_start, uint64_t bit_end, char *buffer, uint32_t buffer_size)
+{
+	const uint8_t *data = (const uint8_t *)src + (bit_start >> 3);
+	const uint8_t *data_end = (const uint8_t *)src + ((bit_end + 7) >> 3);
+	uint64_t bits_left = bit_end - bit_start;
+
+	uint64_t bits = 0;
+	uint32_t bit_count = 0;
+	uint32_t skip = bit_start & 7;
+	uint32_t length = 0;
+
+	while (bits_left) {
+		if (data + sizeof(uint64_t) <= data_end) {
+			uint64_t word;
+			memcpy(&word, data, sizeof(uint64_t));
+			bits |= word << bit_count;
+			data += (63 - bit_count) >> 3;
+			bit_count |= 56;
+		} else {
+			for (; bit_count <= 56 && data < data_end; bit_count += 8)
+				bits |= (uint64_t)*data++ << bit_count;
+		}
+
+		if (skip) {
+			bits >>= skip;
+			bit_count -= skip;
+			skip = 0;
+		}
+
+		// At least 56 bits are buffered unless the end is near, so resolve as many codes as fit before refilling.
+		// Once all data is buffered the bits above `bit_count` are zero, which doesn't change the decoded codes.
+		while (bits_left && (bit_count >= TM_HUFFMAN_DECODE_LUT_BITS || data == data_end)) {
+			const uint32_t entry = tree->decode_lut[bits & ((1u << TM_HUFFMAN_DECODE_LUT_BITS) - 1)];
+			uint32_t code_length = tm_huffman_lut__bit_count(entry);
+			char c = tm_huffman_lut__data(entry);
+
+			if (!code_length) {
+				if (bit_count < 32 && data < data_end)
+					break;
+
+				uint32_t node_idx = tm_huffman_lut__node(entry);
+				code_length = TM_HUFFMAN_DECODE_LUT_BITS;
+				while (!tree->nodes[node_idx].data)
+					node_idx = (bits >> code_length++) & 1 ? tree->nodes[node_idx].right : tree->nodes[node_idx].left;
+
+				c = tree->nodes[node_idx].data;
+			}
+
+			if (length < buffer_size)
+				buffer[length] = c;
+			++length;
+
+			bits >>= code_length;
+			bit_count -= code_length;
+			bits_left -= tm_min(code_length, bits_left);
+		}
+	}
+
+	return length;
+}
+
 static inline void tm_huffman_tree_free(tm_allocator_i *a, tm_huffman_tree_t *tree)
 {
 	tm_free(a, tree->nodes, tree->node_count * sizeof(tm_huffman_node_t));
+	if (tree->decode_lut)
+		tm_free(a, tree->decode_lut, sizeof(uint32_t) << TM_HUFFMAN_DECODE_LUT_BITS);
 }
 
 static inline void private__tree_node_dump(const tm_huffman_tree_t *tree, uint32_t root, char *buffer, uint32_t bit)
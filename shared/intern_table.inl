@@ -0,0 +1,337 @@
+#include <foundation/atomics.inl>
+
+#include <xmmintrin.h>
+
+// Concurrent table of interned strings, used for the runtime database.
+// Lookups are wait-free and never see a partially written entry, inserts are lock-free and can run
+// concurrently with each other and with lookups. Nothing is ever moved or freed until the table is freed,
+// so the returned strings stay valid for the lifetime of the table.
+
+// Size of the blocks string bytes are bump allocated from, longer strings get a block of their own.
+#define TM_STRING_ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct tm_string_arena_block_t
+{
+	struct tm_string_arena_block_t *next;
+	uint64_t size;
+	// Can go past `size` when concurrent allocations overflow the block, the excess is never handed out.
+	atomic_uint64_t used;
+} tm_string_arena_block_t;
+
+typedef struct tm_string_arena_t
+{
+	// (tm_string_arena_block_t *) Block allocations are made from, links to all previous blocks.
+	atomic_uint64_t current;
+} tm_string_arena_t;
+
+static inline char *tm_string_arena_alloc(tm_string_arena_t *arena, tm_allocator_i *a, uint64_t size)
+{
+	for (;;) {
+		tm_string_arena_block_t *block = (tm_string_arena_block_t *)atomic_load_uint64_t(&arena->current);
+		if (block) {
+			const uint64_t offset = atomic_fetch_add_uint64_t(&block->used, size);
+			if (offset + size <= block->size)
+				return (char *)(block + 1) + offset;
+		}
+
+		const uint64_t block_size = tm_max(TM_STRING_ARENA_BLOCK_SIZE, size);
+		tm_string_arena_block_t *new_block = tm_alloc(a, sizeof(tm_string_arena_block_t) + block_size);
+		new_block->next = block;
+		new_block->size = block_size;
+		atomic_store_uint64_t(&new_block->used, size);
+
+		// If another thread replaced the block first, allocate from its block instead.
+		uint64_t expected = (uint64_t)block;
+		if (atomic_compare_exchange_strong_uint64_t(&arena->current, &expected, (uint64_t)new_block))
+			return (char *)(new_block + 1);
+
+		tm_free(a, new_block, sizeof(tm_string_arena_block_t) + block_size);
+	}
+}
+
+static inline void tm_string_arena_free(tm_string_arena_t *arena, tm_allocator_i *a)
+{
+	tm_string_arena_block_t *block = (tm_string_arena_block_t *)atomic_load_uint64_t(&arena->current);
+	while (block) {
+		tm_string_arena_block_t *next = block->next;
+		tm_free(a, block, sizeof(tm_string_arena_block_t) + block->size);
+		block = next;
+	}
+
+	atomic_store_uint64_t(&arena->current, 0);
+}
+
+// The table never rehashes, instead it grows by adding segments of twice the size of the previous one.
+// Segment `i` holds `1 << (TM_INTERN_TABLE_FIRST_SEGMENT_BITS + i)` slots.
+#define TM_INTERN_TABLE_FIRST_SEGMENT_BITS 10
+// The last segment would have 2^41 slots, so the table can't run out of segments in practice.
+#define TM_INTERN_TABLE_MAX_SEGMENTS 32
+
+typedef struct tm_intern_slot_t
+{
+	// Zero marks an empty slot, so the (astronomically unlikely) zero hash can't be interned.
+	atomic_uint64_t hash;
+	// (const char *) Published after `length`, zero while the inserting thread is still copying the string.
+	atomic_uint64_t string;
+	uint32_t length;
+	TM_PAD(4);
+} tm_intern_slot_t;
+
+typedef struct tm_intern_segment_t
+{
+	// Number of slots reserved by inserts, a segment is full once half of its slots are reserved.
+	atomic_uint64_t reserved;
+	uint64_t mask;
+	tm_intern_slot_t slots[1];
+} tm_intern_segment_t;
+
+// Filter over the hashes of all segments, see filter.inl. Its words are only accessed atomically, since inserts
+// set bits while lookups test them. Filters that were replaced are kept until the table is freed, like the segments.
+typedef struct tm_intern_filter_t
+{
+	tm_symbol_filter_t filter;
+	struct tm_intern_filter_t *previous;
+} tm_intern_filter_t;
+
+typedef struct tm_intern_table_t
+{
+	// (tm_intern_segment_t *) Segments are never removed, only the last one is inserted into.
+	atomic_uint64_t segments[TM_INTERN_TABLE_MAX_SEGMENTS];
+	atomic_uint32_t segment_count;
+	TM_PAD(4);
+	// (tm_intern_filter_t *) Rebuilt for the capacity of all segments whenever a segment is added, so a lookup
+	// of a hash that isn't in the table reads a single block instead of a slot in every segment.
+	atomic_uint64_t filter;
+	// (tm_intern_filter_t *) Filter that is being rebuilt, inserts set their bits in it too.
+	atomic_uint64_t building;
+	tm_string_arena_t arena;
+} tm_intern_table_t;
+
+static inline uint64_t private__intern_segment_size(uint32_t segment_idx)
+{
+	return sizeof(tm_intern_segment_t) + ((1ull << (TM_INTERN_TABLE_FIRST_SEGMENT_BITS + segment_idx)) - 1) * sizeof(tm_intern_slot_t);
+}
+
+static inline void private__intern_filter_insert(tm_intern_filter_t *filter, uint64_t hash)
+{
+	uint64_t masks[TM_SYMBOL_FILTER_BLOCK_WORDS];
+	tm_symbol_filter_masks(hash, masks);
+
+	atomic_uint64_t *block = (atomic_uint64_t *)filter->filter.blocks + tm_symbol_filter_block(filter->filter.block_count, hash) * TM_SYMBOL_FILTER_BLOCK_WORDS;
+	for (uint32_t i = 0; i < TM_SYMBOL_FILTER_BLOCK_WORDS; ++i) {
+		uint64_t word = atomic_load_uint64_t(&block[i]);
+		while ((word & masks[i]) != masks[i] && !atomic_compare_exchange_strong_uint64_t(&block[i], &word, word | masks[i]))
+			;
+	}
+}
+
+// Returns false if the hash is definitely not in the table, a table without a filter may hold any hash.
+static inline bool private__intern_filter_contains(const tm_intern_table_t *table, uint64_t hash)
+{
+	const tm_intern_filter_t *filter = (const tm_intern_filter_t *)atomic_load_uint64_t((atomic_uint64_t *)&table->filter);
+	if (!filter)
+		return true;
+
+	uint64_t masks[TM_SYMBOL_FILTER_BLOCK_WORDS];
+	tm_symbol_filter_masks(hash, masks);
+
+	atomic_uint64_t *block = (atomic_uint64_t *)filter->filter.blocks + tm_symbol_filter_block(filter->filter.block_count, hash) * TM_SYMBOL_FILTER_BLOCK_WORDS;
+	uint64_t missing = 0;
+	for (uint32_t i = 0; i < TM_SYMBOL_FILTER_BLOCK_WORDS; ++i)
+		missing |= masks[i] & ~atomic_load_uint64_t(&block[i]);
+
+	return !missing;
+}
+
+// Sets the bits of the hash in the filter and in the one being rebuilt, must be called after the hash is stored in its slot.
+// The rebuilding thread publishes its filter in `building` before it scans the slots, so either the scan sees the hash or
+// this sees the filter. Checking `building` before `filter` makes sure a rebuild that finishes in between isn't missed.
+static inline void private__intern_filter_add(tm_intern_table_t *table, uint64_t hash)
+{
+	tm_intern_filter_t *building = (tm_intern_filter_t *)atomic_load_uint64_t(&table->building);
+	if (building)
+		private__intern_filter_insert(building, hash);
+
+	tm_intern_filter_t *filter = (tm_intern_filter_t *)atomic_load_uint64_t(&table->filter);
+	if (filter && filter != building)
+		private__intern_filter_insert(filter, hash);
+}
+
+// Builds a filter for the capacity of the first `segment_count` segments, unless another thread is already building one.
+// Inserts keep setting bits in the previous filter until the new one is published, so no hash is ever missing from it.
+static inline void private__intern_filter_rebuild(tm_intern_table_t *table, tm_allocator_i *a, uint32_t segment_count)
+{
+	// Segments are at most half full, so they hold fewer hashes than half the slots of the last one, doubled.
+	const uint64_t capacity = (1ull << (TM_INTERN_TABLE_FIRST_SEGMENT_BITS + segment_count - 1));
+	tm_intern_filter_t *filter = tm_alloc(a, sizeof(tm_intern_filter_t));
+	*filter = (tm_intern_filter_t) { .filter = tm_symbol_filter_create(a, capacity) };
+
+	uint64_t expected = 0;
+	if (!atomic_compare_exchange_strong_uint64_t(&table->building, &expected, (uint64_t)filter)) {
+		tm_symbol_filter_free(a, &filter->filter);
+		tm_free(a, filter, sizeof(tm_intern_filter_t));
+		return;
+	}
+
+	for (uint32_t i = 0; i < segment_count; ++i) {
+		const tm_intern_segment_t *segment = (const tm_intern_segment_t *)atomic_load_uint64_t(&table->segments[i]);
+		for (uint64_t slot = 0; slot <= segment->mask; ++slot) {
+			const uint64_t hash = atomic_load_uint64_t((atomic_uint64_t *)&segment->slots[slot].hash);
+			if (hash)
+				private__intern_filter_insert(filter, hash);
+		}
+	}
+
+	filter->previous = (tm_intern_filter_t *)atomic_load_uint64_t(&table->filter);
+	atomic_store_uint64_t(&table->filter, (uint64_t)filter);
+	atomic_store_uint64_t(&table->building, 0);
+}
+
+static inline bool private__intern_segment_find(const tm_intern_segment_t *segment, uint64_t hash, const char **string, uint32_t *length)
+{
+	for (uint64_t slot = hash & segment->mask;; slot = (slot + 1) & segment->mask) {
+		tm_intern_slot_t *s = (tm_intern_slot_t *)segment->slots + slot;
+		const uint64_t slot_hash = atomic_load_uint64_t(&s->hash);
+		if (!slot_hash)
+			return false;
+
+		if (slot_hash == hash) {
+			*string = (const char *)atomic_load_uint64_t(&s->string);
+			if (!*string)
+				return false;
+
+			*length = s->length;
+			return true;
+		}
+	}
+}
+
+static inline bool tm_intern_table_find(const tm_intern_table_t *table, uint64_t hash, const char **string, uint32_t *length)
+{
+	tm_intern_table_t *t = (tm_intern_table_t *)table;
+	if (!hash || !private__intern_filter_contains(table, hash))
+		return false;
+
+	// Newer segments are larger and hold most of the entries, so search them first.
+	for (uint32_t i = atomic_load_uint32_t(&t->segment_count); i--;) {
+		const tm_intern_segment_t *segment = (const tm_intern_segment_t *)atomic_load_uint64_t(&t->segments[i]);
+		if (private__intern_segment_find(segment, hash, string, length))
+			return true;
+	}
+
+	return false;
+}
+
+// Starts loading the slots of the hash in all segments into the cache, so a later insert or search doesn't stall on them.
+static inline void tm_intern_table_prefetch(const tm_intern_table_t *table, uint64_t hash)
+{
+	tm_intern_table_t *t = (tm_intern_table_t *)table;
+	for (uint32_t i = atomic_load_uint32_t(&t->segment_count); i--;) {
+		const tm_intern_segment_t *segment = (const tm_intern_segment_t *)atomic_load_uint64_t(&t->segments[i]);
+		_mm_prefetch((const char *)(segment->slots + (hash & segment->mask)), _MM_HINT_T0);
+	}
+}
+
+// Makes segment `segment_count` the one inserted into, unless another thread already did.
+static inline void private__intern_table_grow(tm_intern_table_t *table, tm_allocator_i *a, uint32_t segment_count)
+{
+	if (!atomic_load_uint64_t(&table->segments[segment_count])) {
+		const uint64_t size = private__intern_segment_size(segment_count);
+		tm_intern_segment_t *segment = tm_alloc(a, size);
+		memset(segment, 0, size);
+		segment->mask = (1ull << (TM_INTERN_TABLE_FIRST_SEGMENT_BITS + segment_count)) - 1;
+
+		uint64_t expected = 0;
+		if (atomic_compare_exchange_strong_uint64_t(&table->segments[segment_count], &expected, (uint64_t)segment))
+			private__intern_filter_rebuild(table, a, segment_count + 1);
+		else
+			tm_free(a, segment, size);
+	}
+
+	uint32_t expected = segment_count;
+	atomic_compare_exchange_strong_uint32_t(&table->segment_count, &expected, segment_count + 1);
+}
+
+// Interns a copy of the string under `hash`, does nothing if the hash is already in the table. Returns true if the string was interned.
+// Two threads racing to insert the same hash while the table grows can both succeed, in which case
+// one copy shadows the other, which is harmless since both are the same string.
+static inline bool tm_intern_table_insert(tm_intern_table_t *table, tm_allocator_i *a, uint64_t hash, const char *string, uint32_t length)
+{
+	if (!hash)
+		return false;
+
+	for (;;) {
+		const uint32_t segment_count = atomic_load_uint32_t(&table->segment_count);
+		const char *existing;
+		uint32_t existing_length;
+		// Hashes that pass the filter may already be in one of the full segments.
+		const bool maybe_interned = private__intern_filter_contains(table, hash);
+		for (uint32_t i = 0; maybe_interned && i + 1 < segment_count; ++i) {
+			const tm_intern_segment_t *segment = (const tm_intern_segment_t *)atomic_load_uint64_t(&table->segments[i]);
+			if (private__intern_segment_find(segment, hash, &existing, &existing_length))
+				return false;
+		}
+
+		tm_intern_segment_t *segment = segment_count ? (tm_intern_segment_t *)atomic_load_uint64_t(&table->segments[segment_count - 1]) : 0;
+		if (!segment || atomic_fetch_add_uint64_t(&segment->reserved, 1) >= (segment->mask + 1) >> 1) {
+			private__intern_table_grow(table, a, segment_count);
+			continue;
+		}
+
+		// The reservation guarantees a free slot, so the probe always terminates.
+		for (uint64_t slot = hash & segment->mask;; slot = (slot + 1) & segment->mask) {
+			tm_intern_slot_t *s = segment->slots + slot;
+			uint64_t expected = 0;
+			if (atomic_compare_exchange_strong_uint64_t(&s->hash, &expected, hash)) {
+				private__intern_filter_add(table, hash);
+				char *copy = tm_string_arena_alloc(&table->arena, a, length);
+				memcpy(copy, string, length);
+				s->length = length;
+				atomic_store_uint64_t(&s->string, (uint64_t)copy);
+				return true;
+			}
+
+			if (expected == hash)
+				return false;
+		}
+	}
+}
+
+typedef void tm_intern_table_visit_f(void *user_data, uint64_t hash, const char *string, uint32_t length);
+
+// Calls `visit` for every string in the table, strings inserted while it runs may or may not be visited.
+// A hash inserted twice while the table grew is visited once for each copy.
+static inline void tm_intern_table_visit(const tm_intern_table_t *table, tm_intern_table_visit_f *visit, void *user_data)
+{
+	tm_intern_table_t *t = (tm_intern_table_t *)table;
+	const uint32_t segment_count = atomic_load_uint32_t(&t->segment_count);
+	for (uint32_t i = 0; i < segment_count; ++i) {
+		tm_intern_segment_t *segment = (tm_intern_segment_t *)atomic_load_uint64_t(&t->segments[i]);
+		for (uint64_t slot = 0; slot <= segment->mask; ++slot) {
+			tm_intern_slot_t *s = segment->slots + slot;
+			const uint64_t hash = atomic_load_uint64_t(&s->hash);
+			const char *string = hash ? (const char *)atomic_load_uint64_t(&s->string) : 0;
+			if (string)
+				visit(user_data, hash, string, s->length);
+		}
+	}
+}
+
+// Not thread safe, no other thread may use the table while or after it's freed.
+static inline void tm_intern_table_free(tm_intern_table_t *table, tm_allocator_i *a)
+{
+	const uint32_t segment_count = atomic_load_uint32_t(&table->segment_count);
+	for (uint32_t i = 0; i < segment_count; ++i)
+		tm_free(a, (void *)atomic_load_uint64_t(&table->segments[i]), private__intern_segment_size(i));
+
+	tm_intern_filter_t *filter = (tm_intern_filter_t *)atomic_load_uint64_t(&table->filter);
+	while (filter) {
+		tm_intern_filter_t *previous = filter->previous;
+		tm_symbol_filter_free(a, &filter->filter);
+		tm_free(a, filter, sizeof(tm_intern_filter_t));
+		filter = previous;
+	}
+
+	tm_string_arena_free(&table->arena, a);
+	*table = (tm_intern_table_t) { 0 };
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+// Journal of the strings added to the runtime database of `tm_debug_utils_api`, see `set_runtime_journal()`.
+// The plugin appends to it and replays it when it's loaded, `symbols --compact-journal` moves its strings into a database:
+//   uint32_t magic, uint32_t version, records of (uint64_t hash, uint32_t length, char string[length])
+// The hash doubles as the checksum of its record: a record whose string doesn't hash to it, or that doesn't fit in the file,
+// was only partially written when its process stopped. Several processes may append to the same journal, so the journal
+// is never truncated. Instead every batch of records starts with a sync record, `TM_HDB_JOURNAL_SYNC_HASH` with a length
+// of zero, and readers skip from a partially written record to the next sync record. Version 1 journals have no sync records.
+
+#define TM_HDB_JOURNAL_MAGIC 0x4a424448
+#define TM_HDB_JOURNAL_VERSION 2
+#define TM_HDB_JOURNAL_HEADER_SIZE (sizeof(uint32_t) << 1)
+#define TM_HDB_JOURNAL_RECORD_HEADER_SIZE (sizeof(uint64_t) + sizeof(uint32_t))
+// "HDBJSYNC", strings of length zero hash to zero, which no record uses.
+#define TM_HDB_JOURNAL_SYNC_HASH 0x434e59534a424448ull
+
+static inline void tm_symbol_journal_write_header(char *dest)
+{
+	const uint32_t magic = TM_HDB_JOURNAL_MAGIC, version = TM_HDB_JOURNAL_VERSION;
+	memcpy(dest, &magic, sizeof(uint32_t));
+	memcpy(dest + sizeof(uint32_t), &version, sizeof(uint32_t));
+}
+
+static inline bool tm_symbol_journal_valid_header(const char *data, uint64_t size)
+{
+	uint32_t magic = 0, version = 0;
+	if (size >= TM_HDB_JOURNAL_HEADER_SIZE) {
+		memcpy(&magic, data, sizeof(uint32_t));
+		memcpy(&version, data + sizeof(uint32_t), sizeof(uint32_t));
+	}
+	return magic == TM_HDB_JOURNAL_MAGIC && version >= 1 && version <= TM_HDB_JOURNAL_VERSION;
+}
+
+// Writes the record to `dest`, which has room for `TM_HDB_JOURNAL_RECORD_HEADER_SIZE + length` bytes.
+static inline void tm_symbol_journal_write_record(char *dest, uint64_t hash, const char *string, uint32_t length)
+{
+	memcpy(dest, &hash, sizeof(uint64_t));
+	memcpy(dest + sizeof(uint64_t), &length, sizeof(uint32_t));
+	memcpy(dest + TM_HDB_JOURNAL_RECORD_HEADER_SIZE, string, length);
+}
+
+// Writes the sync record that starts a batch to `dest`, which has room for `TM_HDB_JOURNAL_RECORD_HEADER_SIZE` bytes.
+static inline void tm_symbol_journal_write_sync(char *dest)
+{
+	const uint64_t hash = TM_HDB_JOURNAL_SYNC_HASH;
+	memset(dest, 0, TM_HDB_JOURNAL_RECORD_HEADER_SIZE);
+	memcpy(dest, &hash, sizeof(uint64_t));
+}
+
+// Appends a batch of records to the journal at `path`, creating it if there is none. The file is opened for every batch,
+// so once a journal is renamed to be compacted, the next batch starts a new journal at the path.
+static inline bool tm_symbol_journal_append(const char *path, const char *records, uint64_t size)
+{
+	const tm_file_o file = tm_os_api->file_io->open_output(path, true);
+	if (!file.valid)
+		return false;
+
+	// Processes that create the journal at the same time both write a header, readers skip the second one like a partial record.
+	char header[TM_HDB_JOURNAL_HEADER_SIZE], sync[TM_HDB_JOURNAL_RECORD_HEADER_SIZE];
+	tm_symbol_journal_write_header(header);
+	tm_symbol_journal_write_sync(sync);
+	const bool written = (tm_os_api->file_io->size(file) || tm_os_api->file_io->write(file, header, sizeof(header)))
+		&& tm_os_api->file_io->write(file, sync, sizeof(sync)) && (!size || tm_os_api->file_io->write(file, records, size));
+	tm_os_api->file_io->close(file);
+	return written;
+}
+
+// Returns the offset of the first sync record at or after `offset`, or `size` if there is none.
+static inline uint64_t tm_symbol_journal_find_sync(const char *data, uint64_t size, uint64_t offset)
+{
+	char sync[TM_HDB_JOURNAL_RECORD_HEADER_SIZE];
+	tm_symbol_journal_write_sync(sync);
+	for (; offset + TM_HDB_JOURNAL_RECORD_HEADER_SIZE <= size; ++offset) {
+		if (!memcmp(data + offset, sync, TM_HDB_JOURNAL_RECORD_HEADER_SIZE))
+			return offset;
+	}
+	return size;
+}
+
+// Reads the next record at or after `*offset` of a journal with a valid header and moves `*offset` past it. Sync records are
+// skipped, and so are partially written records, whose bytes are added to `*skipped`. Returns false at the end of the journal.
+static inline bool tm_symbol_journal_next(const char *data, uint64_t size, uint64_t *offset, uint64_t *skipped, uint64_t *hash, const char **string, uint32_t *length)
+{
+	while (*offset + TM_HDB_JOURNAL_RECORD_HEADER_SIZE <= size) {
+		memcpy(hash, data + *offset, sizeof(uint64_t));
+		memcpy(length, data + *offset + sizeof(uint64_t), sizeof(uint32_t));
+		if (*hash == TM_HDB_JOURNAL_SYNC_HASH && !*length) {
+			*offset += TM_HDB_JOURNAL_RECORD_HEADER_SIZE;
+			continue;
+		}
+
+		*string = data + *offset + TM_HDB_JOURNAL_RECORD_HEADER_SIZE;
+		if (size - *offset - TM_HDB_JOURNAL_RECORD_HEADER_SIZE >= *length && *hash && tm_murmur_hash_inline(*string, (int)*length, 0) == *hash) {
+			*offset += TM_HDB_JOURNAL_RECORD_HEADER_SIZE + *length;
+			return true;
+		}
+
+		const uint64_t sync = tm_symbol_journal_find_sync(data, size, *offset + 1);
+		*skipped += sync - *offset;
+		*offset = sync;
+	}
+
+	if (*offset < size)
+		*skipped += size - *offset;
+	*offset = size;
+	return false;
+}
\ No newline at end of file
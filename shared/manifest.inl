@@ -0,0 +1,84 @@
+// Sharded databases are written by `symbols -g --shards N` as N databases `NAME.0.hdb` to `NAME.(N-1).hdb`, shard `i` holding the
+// entries whose hashes have `i` in their top bits, and a manifest `NAME.hdbm` that tells readers which shard to search for a hash:
+//   uint32_t magic, uint32_t shard_bits, shard_count * (uint64_t file_size, uint32_t entry_count, uint32_t padding)
+// The shards are regular databases, readers that don't know about manifests load them like any other database.
+
+#define TM_HDB_MANIFEST_MAGIC 0x4d424448
+#define TM_HDB_MANIFEST_MAX_SHARD_BITS 8
+
+typedef struct tm_symbol_manifest_shard_t
+{
+	uint64_t file_size;
+	uint32_t entry_count;
+	TM_PAD(4);
+} tm_symbol_manifest_shard_t;
+
+typedef struct tm_symbol_manifest_t
+{
+	uint32_t shard_bits;
+	TM_PAD(4);
+	tm_symbol_manifest_shard_t shards[1 << TM_HDB_MANIFEST_MAX_SHARD_BITS];
+} tm_symbol_manifest_t;
+
+static inline uint32_t tm_symbol_manifest_shard(uint32_t shard_bits, uint64_t hash)
+{
+	return shard_bits ? (uint32_t)(hash >> (64 - shard_bits)) : 0;
+}
+
+static inline uint64_t tm_symbol_manifest_size(uint32_t shard_bits)
+{
+	return (sizeof(uint32_t) << 1) + ((uint64_t)sizeof(tm_symbol_manifest_shard_t) << shard_bits);
+}
+
+static inline bool tm_symbol_manifest_read(const char *path, tm_symbol_manifest_t *manifest)
+{
+	tm_mapped_file_t file;
+	if (!tm_mapped_file_open(path, &file))
+		return false;
+
+	uint32_t magic = 0;
+	if (file.size >= sizeof(uint32_t) << 1) {
+		memcpy(&magic, file.data, sizeof(uint32_t));
+		memcpy(&manifest->shard_bits, file.data + sizeof(uint32_t), sizeof(uint32_t));
+	}
+
+	const bool valid = magic == TM_HDB_MANIFEST_MAGIC && manifest->shard_bits && manifest->shard_bits <= TM_HDB_MANIFEST_MAX_SHARD_BITS
+		&& file.size == tm_symbol_manifest_size(manifest->shard_bits);
+	if (valid)
+		memcpy(manifest->shards, file.data + (sizeof(uint32_t) << 1), (uint64_t)sizeof(tm_symbol_manifest_shard_t) << manifest->shard_bits);
+
+	tm_mapped_file_close(&file);
+	return valid;
+}
+
+// Returns the path of the shard next to the manifest at `manifest_path`, which ends with ".hdbm".
+static inline const char *tm_symbol_manifest_shard_path(tm_temp_allocator_i *ta, const char *manifest_path, uint32_t shard)
+{
+	return tm_temp_allocator_api->printf(ta, "%.*s.%u.hdb", (int)(strlen(manifest_path) - 5), manifest_path, shard);
+}
+
+// Checks that the database is the shard the manifest describes, shards that were generated again on their own
+// would send lookups of their hashes to the wrong shard. Generated databases are sorted by hash, so only their
+// first and last hash need to be checked.
+static inline bool tm_symbol_manifest_matches(const tm_symbol_manifest_t *manifest, uint32_t shard, const tm_symbol_database_t *db)
+{
+	const uint32_t count = db->index.entry_count;
+	return manifest->shards[shard].file_size == db->file.size && manifest->shards[shard].entry_count == count
+		&& (!count || (tm_symbol_manifest_shard(manifest->shard_bits, db->index.hashes[0]) == shard
+			&& tm_symbol_manifest_shard(manifest->shard_bits, db->index.hashes[count - 1]) == shard));
+}
+
+// Returns the path of the manifest a shard at `path` belongs to, if there is one.
+static inline const char *tm_symbol_manifest_of_shard(tm_temp_allocator_i *ta, const char *path)
+{
+	// Shards are named `NAME.SHARD.hdb`.
+	const size_t length = strlen(path);
+	size_t digits_start = length - 4;
+	while (digits_start > 0 && path[digits_start - 1] >= '0' && path[digits_start - 1] <= '9')
+		--digits_start;
+	if (digits_start == length - 4 || digits_start < 2 || path[digits_start - 1] != '.')
+		return 0;
+
+	const char *manifest_path = tm_temp_allocator_api->printf(ta, "%.*s.hdbm", (int)(digits_start - 1), path);
+	return tm_os_api->file_system->stat(manifest_path).exists ? manifest_path : 0;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#if defined(TM_OS_WINDOWS)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only view of a whole file. The pages are shared with the OS file cache, so every process
+// mapping the same file uses the same physical memory.
+typedef struct tm_mapped_file_t
+{
+	const char *data;
+	uint64_t size;
+#if defined(TM_OS_WINDOWS)
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} tm_mapped_file_t;
+
+static inline bool tm_mapped_file_open(const char *path, tm_mapped_file_t *file)
+{
+	*file = (tm_mapped_file_t) { 0 };
+
+#if defined(TM_OS_WINDOWS)
+	// Sharing deletion lets `symbols.exe` rename a new version over the file while it's mapped.
+	file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file->file, &size) || !size.QuadPart) {
+		CloseHandle(file->file);
+		return false;
+	}
+
+	file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	file->data = file->mapping ? MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!file->data) {
+		if (file->mapping)
+			CloseHandle(file->mapping);
+		CloseHandle(file->file);
+		return false;
+	}
+
+	file->size = (uint64_t)size.QuadPart;
+#else
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return false;
+	}
+
+	// The mapping keeps its own reference to the file, so the descriptor isn't needed anymore.
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	file->data = data;
+	file->size = (uint64_t)st.st_size;
+#endif
+
+	return true;
+}
+
+static inline void tm_mapped_file_close(tm_mapped_file_t *file)
+{
+	if (!file->data)
+		return;
+
+#if defined(TM_OS_WINDOWS)
+	UnmapViewOfFile(file->data);
+	CloseHandle(file->mapping);
+	CloseHandle(file->file);
+#else
+	munmap((void *)file->data, file->size);
+#endif
+
+	*file = (tm_mapped_file_t) { 0 };
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+// Index for finding the strings of a database that start with or contain a query without decoding all of them.
+// Databases generated with `symbols -g --search-index` store it between their header and their strings (see `TM_HDB_FLAGS_SEARCH_INDEX`):
+//   padding to 8 bytes, uint64_t size, uint64_t trigram_count, uint64_t posting_starts[trigram_count + 1],
+//   uint32_t trigrams[trigram_count], uint32_t sorted[entry_count], uint8_t postings[]
+// `size` counts the bytes after it. `sorted` lists the entries in the order of their strings, so the strings starting with
+// a prefix are a range of it that's found by binary search. For every trigram, three consecutive bytes of a string, in
+// increasing order, the postings starting at `posting_starts[i]` list the positions in `sorted` of the strings containing
+// it as varint deltas. A substring query only decodes the strings that contain the trigrams of the query.
+
+#define tm_symbol_search__trigram(s)	(((uint32_t)(uint8_t)(s)[0] << 16) | ((uint32_t)(uint8_t)(s)[1] << 8) | (uint32_t)(uint8_t)(s)[2])
+
+typedef struct tm_symbol_search_index_t
+{
+	const uint64_t *posting_starts;
+	const uint32_t *trigrams;
+	const uint32_t *sorted;
+	const uint8_t *postings;
+	uint64_t trigram_count;
+	uint64_t postings_size;
+} tm_symbol_search_index_t;
+
+// Size of the arrays of a search index before the postings, including the trigram count.
+static inline uint64_t tm_symbol_search_index_arrays_size(uint64_t trigram_count, uint32_t entry_count)
+{
+	return sizeof(uint64_t) + (trigram_count + 1) * sizeof(uint64_t) + trigram_count * sizeof(uint32_t) + entry_count * sizeof(uint32_t);
+}
+
+// Points the search index at the section following the first `offset` bytes of a mapped database of `size` bytes.
+// Returns the offset after the section, or zero if it doesn't fit in the file.
+static inline uint64_t tm_symbol_search_index_view(const char *data, uint64_t size, uint64_t offset, uint32_t entry_count, tm_symbol_search_index_t *search)
+{
+	offset = (offset + sizeof(uint64_t) - 1) & ~(uint64_t)(sizeof(uint64_t) - 1);
+	uint64_t section_size, trigram_count;
+	if (offset > size || size - offset < sizeof(uint64_t) << 1)
+		return 0;
+
+	memcpy(&section_size, data + offset, sizeof(uint64_t));
+	memcpy(&trigram_count, data + offset + sizeof(uint64_t), sizeof(uint64_t));
+	offset += sizeof(uint64_t);
+	// There are only 2^24 trigrams, which also keeps the size of the arrays from overflowing.
+	if (section_size > size - offset || trigram_count > (1u << 24) || tm_symbol_search_index_arrays_size(trigram_count, entry_count) > section_size)
+		return 0;
+
+	search->posting_starts = (const uint64_t *)(data + offset + sizeof(uint64_t));
+	search->trigrams = (const uint32_t *)(search->posting_starts + trigram_count + 1);
+	search->sorted = search->trigrams + trigram_count;
+	search->postings = (const uint8_t *)(search->sorted + entry_count);
+	search->trigram_count = trigram_count;
+	search->postings_size = section_size - tm_symbol_search_index_arrays_size(trigram_count, entry_count);
+	return offset + section_size;
+}
+
+// Finds the postings of the trigram, returns false if no string contains it.
+static inline bool tm_symbol_search_index_postings(const tm_symbol_search_index_t *search, uint32_t trigram, const uint8_t **postings, const uint8_t **postings_end)
+{
+	uint64_t first = 0, last = search->trigram_count;
+	while (first < last) {
+		const uint64_t middle = first + ((last - first) >> 1);
+		if (search->trigrams[middle] < trigram)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	if (first == search->trigram_count || search->trigrams[first] != trigram)
+		return false;
+
+	const uint64_t start = search->posting_starts[first], end = search->posting_starts[first + 1];
+	if (start > end || end > search->postings_size)
+		return false;
+
+	*postings = search->postings + start;
+	*postings_end = search->postings + end;
+	return true;
+}
\ No newline at end of file
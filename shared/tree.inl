@@ -1,12 +1,42 @@
+#include <stdlib.h>
+
 #define TM_SYMBOL_TREE_GROWTH 32
 
 enum
 {
-	TM_HDB_FLAGS_VERSION = 0x1,
+	// Version 1 stores the `tm_symbol_node_t` array of a `tm_symbol_tree_t` as is.
+	TM_HDB_FLAGS_VERSION_1 = 0x1,
+	// Version 2 stores a `tm_symbol_index_t`: the hashes, string starts and string lengths in three
+	// separate arrays that are sorted by hash.
+	TM_HDB_FLAGS_VERSION_2 = 0x2,
+	// Version 3 is laid out like version 2, but its strings are front coded or FSST compressed, which version 2 readers can't decode.
+	TM_HDB_FLAGS_VERSION_3 = 0x3,
+	TM_HDB_FLAGS_VERSION = TM_HDB_FLAGS_VERSION_2,
 	TM_HDB_FLAGS_VERSION_MASK = 0xFFFF,
-	TM_HDB_FLAGS_COMPRESSED = 0x10000
+	TM_HDB_FLAGS_COMPRESSED = 0x10000,
+	// Compressed with a canonical, length limited Huffman code, the header stores the 256 code lengths
+	// instead of the nodes of the Huffman tree.
+	TM_HDB_FLAGS_CANONICAL = 0x20000,
+	// A `tm_symbol_filter_t` over all hashes is stored at the end of the file, see filter.inl.
+	TM_HDB_FLAGS_FILTER = 0x40000,
+	// Only in version 3. The strings are sorted and stored in blocks of `TM_HDB_FRONT_CODING_BLOCK_SIZE`, each string as the number of
+	// characters it shares with the previous one and the rest of its characters:
+	//   uint8_t count, count * (varint shared, varint suffix_size), suffixes
+	// Suffix sizes are in bits if the strings are also compressed, the suffixes then start at the byte after the sizes.
+	// The string start of an entry is the offset of its block shifted by `TM_HDB_FRONT_CODING_BLOCK_SHIFT`,
+	// plus its position in the block, its string length the number of characters.
+	TM_HDB_FLAGS_FRONT_CODED = 0x80000,
+	// Only in version 3. The strings are compressed with a symbol table, see fsst.inl, which is stored after the index.
+	// String starts and lengths are in bytes of codes unless the strings are front coded, their suffix sizes are then in bytes of codes.
+	TM_HDB_FLAGS_FSST = 0x100000,
+	// A `tm_symbol_search_index_t` is stored between the header and the strings, see search_index.inl.
+	// String starts are offsets into the file, so readers that don't know about it can still read the strings.
+	TM_HDB_FLAGS_SEARCH_INDEX = 0x200000
 };
 
+#define TM_HDB_FRONT_CODING_BLOCK_SHIFT 4
+#define TM_HDB_FRONT_CODING_BLOCK_SIZE (1u << TM_HDB_FRONT_CODING_BLOCK_SHIFT)
+
 typedef struct tm_symbol_node_t
 {
 	uint64_t hash;
@@ -119,4 +149,66 @@ static inline void tm_symbol_tree_free(tm_allocator_i *a, tm_symbol_tree_t *tree
 	tree->nodes = 0;
 	tree->node_capacity = 0;
 	tree->node_count = 0;
-}
\ No newline at end of file
+}
+
+static inline int private__symbol_node_compare(const void *a, const void *b)
+{
+	const uint64_t hash_a = ((const tm_symbol_node_t *)a)->hash;
+	const uint64_t hash_b = ((const tm_symbol_node_t *)b)->hash;
+	return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+// Writes the nodes of the tree into the specified arrays, sorted by hash.
+static inline void tm_symbol_tree_flatten(const tm_symbol_tree_t *tree, uint64_t *hashes, uint64_t *string_starts, uint32_t *string_lengths)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	tm_symbol_node_t *sorted = tm_temp_alloc(ta, tree->node_count * sizeof(tm_symbol_node_t));
+	memcpy(sorted, tree->nodes, tree->node_count * sizeof(tm_symbol_node_t));
+	qsort(sorted, tree->node_count, sizeof(tm_symbol_node_t), private__symbol_node_compare);
+
+	for (uint32_t i = 0; i < tree->node_count; ++i) {
+		hashes[i] = sorted[i].hash;
+		string_starts[i] = sorted[i].string_start;
+		string_lengths[i] = sorted[i].string_length;
+	}
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Read only lookup structure stored in version 2 databases.
+// Entries are sorted by hash and split into separate arrays so a search only touches the hashes.
+typedef struct tm_symbol_index_t
+{
+	const uint64_t *hashes;
+	const uint64_t *string_starts;
+	const uint32_t *string_lengths;
+	uint32_t entry_count;
+	TM_PAD(4);
+} tm_symbol_index_t;
+
+#define tm_symbol_index__entry_size (sizeof(uint64_t) * 2 + sizeof(uint32_t))
+
+// Points the index arrays into a single block of `entry_count * tm_symbol_index__entry_size` bytes,
+// laid out the same way as in a version 2 database.
+static inline void tm_symbol_index_set_block(tm_symbol_index_t *index, const void *block, uint32_t entry_count)
+{
+	index->hashes = (const uint64_t *)block;
+	index->string_starts = index->hashes + entry_count;
+	index->string_lengths = (const uint32_t *)(index->string_starts + entry_count);
+	index->entry_count = entry_count;
+}
+
+static inline tm_symbol_index_t tm_symbol_index_create(tm_allocator_i *a, const tm_symbol_tree_t *tree)
+{
+	tm_symbol_index_t index = { 0 };
+	void *block = tm_alloc(a, tree->node_count * tm_symbol_index__entry_size);
+	tm_symbol_index_set_block(&index, block, tree->node_count);
+	tm_symbol_tree_flatten(tree, (uint64_t *)index.hashes, (uint64_t *)index.string_starts, (uint32_t *)index.string_lengths);
+	return index;
+}
+
+static inline void tm_symbol_index_free(tm_allocator_i *a, tm_symbol_index_t *index)
+{
+	tm_free(a, (void *)index->hashes, index->entry_count * tm_symbol_index__entry_size);
+	*index = (tm_symbol_index_t) { 0 };
+}
@@ -0,0 +1,402 @@
+// Minimum amount of encoded data each benchmark decodes, small databases are decoded repeatedly.
+#define TM_BENCHMARK_MIN_BITS (1ull << 30)
+
+static uint32_t tm_symbols_benchmark_rounds(uint64_t bits_per_round)
+{
+	return bits_per_round ? (uint32_t)tm_max(1, TM_BENCHMARK_MIN_BITS / bits_per_round) : 0;
+}
+
+static void tm_symbols_benchmark_report(const char *name, const char *method, uint64_t bytes, double seconds, double baseline_seconds)
+{
+	const double mb_per_second = seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0;
+	if (mb_per_second >= 1024.0)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: %s: %-12s %9.2f GB/s", name, method, mb_per_second / 1024.0);
+	else
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: %s: %-12s %9.1f MB/s", name, method, mb_per_second);
+	if (baseline_seconds > 0 && seconds > 0)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, " (%.2fx)", baseline_seconds / seconds);
+	tm_logger_api->print(TM_LOG_TYPE_INFO, "\n");
+}
+
+// Decodes every string of a compressed database with the bit serial tree walk and with the decode table.
+static void tm_symbols_benchmark_huffman(const tm_symbol_database_t *db, const char *name)
+{
+	const tm_symbol_index_t *index = &db->index;
+	const tm_huffman_tree_t *tree = &db->decoding;
+
+	uint64_t total_bits = 0;
+	uint32_t max_length = 0;
+	for (uint32_t i = 0; i < index->entry_count; ++i) {
+		total_bits += index->string_lengths[i];
+		max_length = tm_max(max_length, index->string_lengths[i]);
+	}
+
+	const uint32_t rounds = tm_symbols_benchmark_rounds(total_bits);
+	if (!rounds)
+		return;
+
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	char *buffer = tm_temp_alloc(ta, max_length + 1ull);
+
+	// The checksums keep the decoders from being optimized away and verify they agree.
+	uint64_t tree_checksum = 0, lut_checksum = 0, decoded_bytes = 0;
+
+	const tm_clock_o tree_start = tm_os_api->time->now();
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (uint32_t i = 0; i < index->entry_count; ++i) {
+			const uint64_t start = index->string_starts[i];
+			const char *src = db->file.data + (start >> 3);
+			const uint64_t end = (start & 7) + index->string_lengths[i];
+			for (uint64_t offset = start & 7; offset < end;)
+				tree_checksum += (uint8_t)tm_huffman_tree_decode(tree, src, &offset);
+		}
+	}
+	const double tree_seconds = tm_os_api->time->delta(tm_os_api->time->now(), tree_start);
+
+	const tm_clock_o lut_start = tm_os_api->time->now();
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (uint32_t i = 0; i < index->entry_count; ++i) {
+			const uint64_t start = index->string_starts[i];
+			const uint32_t length = tm_huffman_tree_decode_string(tree, db->file.data, start, start + index->string_lengths[i], buffer, max_length);
+			for (uint32_t j = 0; j < length; ++j)
+				lut_checksum += (uint8_t)buffer[j];
+			decoded_bytes += length;
+		}
+	}
+	const double lut_seconds = tm_os_api->time->delta(tm_os_api->time->now(), lut_start);
+
+	tm_symbols_benchmark_report(name, "tree walk", decoded_bytes, tree_seconds, 0);
+	tm_symbols_benchmark_report(name, "table", decoded_bytes, lut_seconds, tree_seconds);
+	if (tree_checksum != lut_checksum)
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: %s: decoders disagree!\n", name);
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Compresses the strings of a database both with a Huffman code and with an FSST symbol table, trained the way the generator
+// does, and compares their compression ratio and how fast whole strings decode.
+static void tm_symbols_benchmark_codecs(tm_allocator_i *a, const tm_symbol_database_t *db, const char *name)
+{
+	const uint32_t count = db->index.entry_count;
+	if (!count)
+		return;
+
+	uint64_t *offsets = tm_alloc(a, (count + 1ull) * sizeof(uint64_t));
+	uint64_t capacity = 64 * 1024, size = 0;
+	char *strings = tm_alloc(a, capacity);
+	for (uint32_t i = 0; i < count; ++i) {
+		offsets[i] = size;
+		uint32_t length = tm_symbol_database_decode(db, i, strings + size, (uint32_t)tm_min(capacity - size, UINT32_MAX));
+		if (size + length > capacity) {
+			const uint64_t new_capacity = tm_max(capacity << 1, size + length);
+			strings = tm_realloc(a, strings, capacity, new_capacity);
+			capacity = new_capacity;
+			length = tm_symbol_database_decode(db, i, strings + size, length);
+		}
+		size += length;
+	}
+	offsets[count] = size;
+
+	const uint32_t rounds = tm_symbols_benchmark_rounds(size << 3);
+	uint32_t max_length = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		max_length = tm_max(max_length, (uint32_t)(offsets[i + 1] - offsets[i]));
+
+	// Huffman codes are at most 12 bits and FSST codes at most two bytes per character.
+	const uint64_t encoded_capacity = (size << 1) + sizeof(uint64_t);
+	char *huffman_data = tm_alloc(a, encoded_capacity);
+	uint8_t *fsst_data = tm_alloc(a, encoded_capacity);
+	uint64_t *huffman_starts = tm_alloc(a, (count + 1ull) * sizeof(uint64_t));
+	uint64_t *fsst_starts = tm_alloc(a, (count + 1ull) * sizeof(uint64_t));
+	char *buffer = tm_alloc(a, max_length + 1ull);
+	memset(huffman_data, 0, encoded_capacity);
+
+	uint32_t frequencies[256] = { 0 };
+	for (uint64_t i = 0; i < size; ++i)
+		++frequencies[(uint8_t)strings[i]];
+	uint8_t code_lengths[256];
+	tm_huffman_code_lengths(frequencies, code_lengths);
+	tm_huffman_tree_t huffman = tm_huffman_tree_create_from_code_lengths(a, code_lengths);
+	tm_huffman_tree_create_decode_lut(a, &huffman);
+
+	tm_fsst_sample_t *sample = tm_alloc(a, sizeof(tm_fsst_sample_t));
+	sample->size = sample->count = 0;
+	for (uint32_t i = 0; i < count && sample->size < TM_FSST_SAMPLE_SIZE; ++i)
+		tm_fsst_sample_add(sample, strings + offsets[i], (uint32_t)(offsets[i + 1] - offsets[i]));
+	tm_fsst_table_t table;
+	tm_fsst_train(a, sample, &table);
+	tm_free(a, sample, sizeof(tm_fsst_sample_t));
+	tm_fsst_encoder_t encoder;
+	tm_fsst_encoder_create(&table, &encoder);
+
+	uint64_t huffman_bits = 0, fsst_size = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint8_t *string = (const uint8_t *)strings + offsets[i];
+		const uint32_t length = (uint32_t)(offsets[i + 1] - offsets[i]);
+		huffman_starts[i] = huffman_bits;
+		private__symbols_encode(huffman.code_lut, string, length, huffman_data, &huffman_bits);
+		fsst_starts[i] = fsst_size;
+		fsst_size += tm_fsst_encode(&encoder, string, length, fsst_data + fsst_size);
+	}
+	huffman_starts[count] = huffman_bits;
+	fsst_starts[count] = fsst_size;
+
+	const uint64_t huffman_size = (huffman_bits + 7) >> 3, table_size = tm_fsst_table_size(&table);
+	printf_loud("dbgutils: %s: %llu bytes of strings, huffman %.1f%%, fsst %.1f%% (table %llu bytes)\n", name, (unsigned long long)size,
+		size ? 100.0 * (huffman_size + 256) / size : 0.0, size ? 100.0 * (fsst_size + table_size) / size : 0.0, (unsigned long long)table_size);
+
+	// The checksums keep the decoders from being optimized away and verify they agree.
+	uint64_t huffman_checksum = 0, fsst_checksum = 0;
+
+	const tm_clock_o huffman_start = tm_os_api->time->now();
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t length = tm_huffman_tree_decode_string(&huffman, huffman_data, huffman_starts[i], huffman_starts[i + 1], buffer, max_length);
+			huffman_checksum += length ? (uint8_t)buffer[length - 1] + length : 0;
+		}
+	}
+	const double huffman_seconds = tm_os_api->time->delta(tm_os_api->time->now(), huffman_start);
+
+	const tm_clock_o fsst_start = tm_os_api->time->now();
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t length = tm_fsst_decode(&table, fsst_data + fsst_starts[i], fsst_starts[i + 1] - fsst_starts[i], buffer, max_length);
+			fsst_checksum += length ? (uint8_t)buffer[length - 1] + length : 0;
+		}
+	}
+	const double fsst_seconds = tm_os_api->time->delta(tm_os_api->time->now(), fsst_start);
+
+	if (rounds) {
+		tm_symbols_benchmark_report(name, "huffman", size * rounds, huffman_seconds, 0);
+		tm_symbols_benchmark_report(name, "fsst", size * rounds, fsst_seconds, huffman_seconds);
+	}
+	if (huffman_checksum != fsst_checksum)
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: %s: decoders disagree!\n", name);
+
+	tm_huffman_tree_free(a, &huffman);
+	tm_free(a, buffer, max_length + 1ull);
+	tm_free(a, fsst_starts, (count + 1ull) * sizeof(uint64_t));
+	tm_free(a, huffman_starts, (count + 1ull) * sizeof(uint64_t));
+	tm_free(a, fsst_data, encoded_capacity);
+	tm_free(a, huffman_data, encoded_capacity);
+	tm_free(a, strings, capacity);
+	tm_free(a, offsets, (count + 1ull) * sizeof(uint64_t));
+}
+
+static void tm_symbols_benchmark_file(tm_allocator_i *a, const char *path)
+{
+	tm_symbol_database_t db;
+	if (!tm_symbol_database_open(a, path, &db)) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: could not open '%s'!\n", path);
+		return;
+	}
+
+	const char *name = tm_path_api->split(path, NULL);
+	printf_loud("dbgutils: %s: %u entries\n", name, db.index.entry_count);
+
+	// The Huffman benchmark decodes whole strings at their string starts, which front coded databases don't have.
+	if (db.decoding.node_count && !(db.flags & TM_HDB_FLAGS_FRONT_CODED))
+		tm_symbols_benchmark_huffman(&db, name);
+	tm_symbols_benchmark_codecs(a, &db, name);
+
+	tm_symbol_database_close(a, &db);
+}
+
+// A source file kept in memory for the scanner benchmark.
+typedef struct tm_symbols_benchmark_source_t
+{
+	tm_symbols_scanner_t scanner;
+	const char *data;
+	uint64_t size;
+} tm_symbols_benchmark_source_t;
+
+// Scans all source files with the scalar and the vectorized scanner.
+static void tm_symbols_benchmark_scan(tm_allocator_i *a, const tm_symbols_benchmark_source_t *sources)
+{
+	const uint64_t source_count = tm_carray_size(sources);
+	uint64_t total_bytes = 0;
+	for (uint64_t i = 0; i < source_count; ++i)
+		total_bytes += sources[i].size;
+
+	const uint32_t rounds = tm_symbols_benchmark_rounds(total_bytes << 3);
+	if (!rounds)
+		return;
+
+	printf_loud("dbgutils: sources: %llu files, %llu bytes\n", (unsigned long long)source_count, (unsigned long long)total_bytes);
+
+	// The checksums keep the scanners from being optimized away and verify they find the same strings.
+	tm_symbols_span_t *spans = 0;
+	uint64_t scalar_checksum = 0, simd_checksum = 0;
+
+	const tm_clock_o scalar_start = tm_os_api->time->now();
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (uint64_t i = 0; i < source_count; ++i) {
+			tm_carray_shrink(spans, 0);
+			tm_symbols_scan_scalar(a, sources[i].data, sources[i].size, &spans);
+			for (uint64_t j = 0; j < tm_carray_size(spans); ++j)
+				scalar_checksum += spans[j].start * 31 + spans[j].length;
+		}
+	}
+	const double scalar_seconds = tm_os_api->time->delta(tm_os_api->time->now(), scalar_start);
+
+	const tm_clock_o simd_start = tm_os_api->time->now();
+	for (uint32_t round = 0; round < rounds; ++round) {
+		for (uint64_t i = 0; i < source_count; ++i) {
+			tm_carray_shrink(spans, 0);
+			tm_symbols_scan(a, sources[i].data, sources[i].size, &spans);
+			for (uint64_t j = 0; j < tm_carray_size(spans); ++j)
+				simd_checksum += spans[j].start * 31 + spans[j].length;
+		}
+	}
+	const double simd_seconds = tm_os_api->time->delta(tm_os_api->time->now(), simd_start);
+
+	tm_symbols_benchmark_report("sources", "scalar scan", total_bytes * rounds, scalar_seconds, 0);
+	tm_symbols_benchmark_report("sources", "simd scan", total_bytes * rounds, simd_seconds, scalar_seconds);
+	if (scalar_checksum != simd_checksum)
+		tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: sources: scanners disagree!\n");
+
+	tm_carray_free(spans, a);
+}
+
+// Benchmarks every database under `input` and collects the source files into `sources`.
+static void private__benchmark_file_or_dir(tm_allocator_i *a, const char *input, tm_symbols_benchmark_source_t **sources)
+{
+	tm_file_stat_t stat = tm_os_api->file_system->stat(input);
+	if (!stat.exists)
+		return;
+	else if (stat.is_directory) {
+		TM_INIT_TEMP_ALLOCATOR(ta);
+		tm_strings_t *entries = tm_os_api->file_system->directory_entries(input, ta);
+		char *s = (char *)entries + sizeof(tm_strings_t);
+		for (uint32_t i = 0; i < entries->count; ++i) {
+			char *cur = s;
+			s += strlen(s) + 1;
+
+			if (cur[0] == '.') continue;
+			if (!strcmp(input, "."))
+				private__benchmark_file_or_dir(a, cur, sources);
+			else {
+				char *joined = tm_temp_allocator_api->printf(ta, "%s/%s", input, cur);
+				private__benchmark_file_or_dir(a, joined, sources);
+			}
+		}
+
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	}
+	else {
+		const char *ext = 0;
+		tm_path_api->split(input, &ext);
+		if (!strcmp(ext, ".hdb"))
+			tm_symbols_benchmark_file(a, input);
+
+		const char *valid_extensions[] = { ".c", ".cpp", ".h", ".hpp", ".inl", ".inc" };
+		for (size_t i = 0; i < TM_ARRAY_COUNT(valid_extensions); ++i) {
+			if (!strcmp(ext, valid_extensions[i])) {
+				tm_symbols_benchmark_source_t source = { 0 };
+				source.data = tm_symbols_scanner_read_file(a, &source.scanner, input, &source.size);
+				if (source.data)
+					tm_carray_push(*sources, source, a);
+				else
+					tm_symbols_scanner_free(a, &source.scanner);
+				break;
+			}
+		}
+	}
+}
+
+static void tm_symbols_benchmark_file_or_dir(tm_allocator_i *a, const char *input)
+{
+	tm_symbols_benchmark_source_t *sources = 0;
+	private__benchmark_file_or_dir(a, input, &sources);
+	tm_symbols_benchmark_scan(a, sources);
+
+	for (uint64_t i = 0; i < tm_carray_size(sources); ++i)
+		tm_symbols_scanner_free(a, &sources[i].scanner);
+	tm_carray_free(sources, a);
+}
+
+// Size of the fixed corpus of `tm_symbols_benchmark_round_trip()`, every 64th string is longer than the decode buffers.
+#define TM_ROUND_TRIP_STRING_COUNT 4096
+
+// Pieces of the round trip corpus. Strings made of them share prefixes and end other strings, which front coding and
+// suffix sharing exploit, and contain multi byte characters and the byte FSST uses to escape literals.
+static const char *tm_symbols_round_trip_words[] = {
+	"tm_", "entity", "component", "TM_TT_TYPE__", "render_graph", "foundation/", ".inl", "physics", "shader", "_", "/", "0",
+	"\xc3\xa9", "\xe2\x82\xac", "\xff",
+};
+
+// Writes the strings of a fixed corpus with every combination of --compression and --strings to `directory`, loads them
+// and checks that `decode_hash()` returns the source string of every hash. Every combination appends its name to the
+// strings, so the hashes of one database don't shadow the others. Returns false if any string doesn't round trip.
+static bool tm_symbols_benchmark_round_trip(tm_allocator_i *a, const char *directory)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	bool succeeded = true;
+	for (uint32_t compression = 0; compression < TM_ARRAY_COUNT(tm_symbols_compression_names); ++compression) {
+		for (uint32_t strings = 0; strings < TM_ARRAY_COUNT(tm_symbols_strings_names); ++strings) {
+			const char *tag = tm_temp_allocator_api->printf(ta, "@%s/%s", tm_symbols_compression_names[compression], tm_symbols_strings_names[strings]);
+			const uint32_t tag_length = (uint32_t)strlen(tag);
+
+			uint64_t state = 0x9e3779b97f4a7c15ull;
+			tm_symbols_entry_t *entries = tm_temp_alloc(ta, TM_ROUND_TRIP_STRING_COUNT * sizeof(tm_symbols_entry_t));
+			tm_symbols_entry_t *scratch = tm_temp_alloc(ta, TM_ROUND_TRIP_STRING_COUNT * sizeof(tm_symbols_entry_t));
+			for (uint32_t i = 0; i < TM_ROUND_TRIP_STRING_COUNT; ++i) {
+				char string[1024];
+				uint32_t length = 0;
+				const uint32_t word_count = i % 64 ? 1 + (uint32_t)(state % 6) : 64;
+				for (uint32_t word = 0; word < word_count; ++word) {
+					state = state * 6364136223846793005ull + 1442695040888963407ull;
+					const char *piece = tm_symbols_round_trip_words[(state >> 33) % TM_ARRAY_COUNT(tm_symbols_round_trip_words)];
+					const uint32_t piece_length = (uint32_t)strlen(piece);
+					memcpy(string + length, piece, piece_length);
+					length += piece_length;
+				}
+				memcpy(string + length, tag, tag_length);
+				length += tag_length;
+
+				char *copy = tm_temp_alloc(ta, length + 1ull);
+				memcpy(copy, string, length);
+				copy[length] = '\0';
+				entries[i] = (tm_symbols_entry_t) { .hash = tm_murmur_hash_inline(copy, (int)length, 0), .string = copy, .length = length };
+			}
+
+			// The same string can be drawn more than once, the databases store every hash once.
+			tm_symbols_entry_t *sorted = private__symbols_sort_entries(entries, scratch, TM_ROUND_TRIP_STRING_COUNT);
+			uint32_t count = 0;
+			for (uint32_t i = 0; i < TM_ROUND_TRIP_STRING_COUNT; ++i) {
+				if (!count || sorted[count - 1].hash != sorted[i].hash)
+					sorted[count++] = sorted[i];
+			}
+
+			const char *output_path = tm_temp_allocator_api->printf(ta, "%s/round_trip_%s_%s", directory, tm_symbols_compression_names[compression], tm_symbols_strings_names[strings]);
+			const tm_symbols_generate_settings_t settings = {
+				.output_path = output_path,
+				.strings = (tm_symbols_strings_t)strings,
+				.compression = (tm_symbols_compression_t)compression,
+				.search_index = true,
+			};
+			private__symbols_save_database(a, sorted, count, &settings);
+			const char *path = tm_temp_allocator_api->printf(ta, "%s.hdb", output_path);
+			tm_debug_utils_api->add_symbol_database(path);
+
+			uint32_t differing = 0;
+			for (uint32_t i = 0; i < count; ++i) {
+				const char *decoded = tm_debug_utils_api->decode_hash(sorted[i].hash, ta);
+				if (!decoded || strlen(decoded) != sorted[i].length || memcmp(decoded, sorted[i].string, sorted[i].length))
+					++differing;
+			}
+			tm_os_api->file_system->remove_file(path);
+
+			if (differing) {
+				tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: round trip: %s %s: %u of %u strings differ!\n",
+					tm_symbols_compression_names[compression], tm_symbols_strings_names[strings], differing, count);
+				succeeded = false;
+			}
+			else
+				printf_loud("dbgutils: round trip: %s %s: %u strings\n", tm_symbols_compression_names[compression], tm_symbols_strings_names[strings], count);
+		}
+	}
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return succeeded;
+}
\ No newline at end of file
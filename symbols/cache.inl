@@ -0,0 +1,199 @@
+// Sidecar file (.hdb.cache) that remembers the string literals of every source file searched by the generator,
+// so files that didn't change since the last run don't have to be read or scanned again.
+//
+// File layout, all integers little endian and unaligned:
+//   uint32_t magic, uint32_t version, uint64_t file_count
+//   for every file:
+//     uint64_t size, uint64_t modified_time, uint64_t content_hash, uint64_t literals_size
+//     uint32_t path_length, uint32_t literal_count, char path[path_length], char literals[literals_size]
+// where `literals` holds `literal_count` times (uint32_t length, char string[length]).
+
+#define TM_SYMBOLS_CACHE_MAGIC 0x48434d54
+// Bump whenever the scanner changes which literals it finds, so old caches are ignored.
+#define TM_SYMBOLS_CACHE_VERSION 1
+
+#define tm_symbols_cache__file_header_size (sizeof(uint64_t) * 4 + sizeof(uint32_t) * 2)
+
+typedef struct tm_symbols_cache_file_t
+{
+	const char *path;
+	const char *literals;
+	uint64_t literals_size;
+	uint64_t size;
+	uint64_t modified_time;
+	uint64_t content_hash;
+	uint32_t path_length;
+	uint32_t literal_count;
+} tm_symbols_cache_file_t;
+
+typedef struct tm_symbols_cache_t
+{
+	// The strings of `files` point into the mapping.
+	tm_mapped_file_t file;
+	// carray
+	tm_symbols_cache_file_t *files;
+	// Open addressing table of file indices + 1 by path hash, zero marks an empty slot.
+	uint32_t *slots;
+	uint64_t mask;
+} tm_symbols_cache_t;
+
+static inline uint64_t private__symbols_cache_path_hash(const char *path, uint32_t path_length)
+{
+	return tm_murmur_hash_inline(path, (int)path_length, 0);
+}
+
+static bool private__symbols_cache_parse(tm_allocator_i *a, tm_symbols_cache_t *cache)
+{
+	const char *data = cache->file.data;
+	const uint64_t size = cache->file.size;
+
+	uint32_t magic, version;
+	uint64_t file_count, offset = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+	if (size < offset)
+		return false;
+
+	memcpy(&magic, data, sizeof(uint32_t));
+	memcpy(&version, data + sizeof(uint32_t), sizeof(uint32_t));
+	memcpy(&file_count, data + sizeof(uint32_t) * 2, sizeof(uint64_t));
+	if (magic != TM_SYMBOLS_CACHE_MAGIC || version != TM_SYMBOLS_CACHE_VERSION)
+		return false;
+
+	for (uint64_t i = 0; i < file_count; ++i) {
+		if (offset + tm_symbols_cache__file_header_size > size)
+			return false;
+
+		tm_symbols_cache_file_t file;
+		memcpy(&file.size, data + offset, sizeof(uint64_t));
+		memcpy(&file.modified_time, data + offset + 8, sizeof(uint64_t));
+		memcpy(&file.content_hash, data + offset + 16, sizeof(uint64_t));
+		memcpy(&file.literals_size, data + offset + 24, sizeof(uint64_t));
+		memcpy(&file.path_length, data + offset + 32, sizeof(uint32_t));
+		memcpy(&file.literal_count, data + offset + 36, sizeof(uint32_t));
+		offset += tm_symbols_cache__file_header_size;
+
+		if (offset + file.path_length + file.literals_size > size)
+			return false;
+
+		file.path = data + offset;
+		file.literals = file.path + file.path_length;
+		offset += file.path_length + file.literals_size;
+		tm_carray_push(cache->files, file, a);
+	}
+
+	const uint64_t capacity = tm_max(16, tm_carray_size(cache->files) << 1);
+	uint64_t slot_count = 16;
+	while (slot_count < capacity)
+		slot_count <<= 1;
+
+	cache->slots = tm_alloc(a, slot_count * sizeof(uint32_t));
+	memset(cache->slots, 0, slot_count * sizeof(uint32_t));
+	cache->mask = slot_count - 1;
+
+	for (uint32_t i = 0; i < tm_carray_size(cache->files); ++i) {
+		uint64_t slot = private__symbols_cache_path_hash(cache->files[i].path, cache->files[i].path_length) & cache->mask;
+		while (cache->slots[slot])
+			slot = (slot + 1) & cache->mask;
+		cache->slots[slot] = i + 1;
+	}
+
+	return true;
+}
+
+static void tm_symbols_cache_close(tm_allocator_i *a, tm_symbols_cache_t *cache)
+{
+	tm_carray_free(cache->files, a);
+	if (cache->slots)
+		tm_free(a, cache->slots, (cache->mask + 1) * sizeof(uint32_t));
+	tm_mapped_file_close(&cache->file);
+	*cache = (tm_symbols_cache_t) { 0 };
+}
+
+// Opens the cache at `path`, returns false if it doesn't exist or was written by a different version.
+static bool tm_symbols_cache_open(tm_allocator_i *a, const char *path, tm_symbols_cache_t *cache)
+{
+	*cache = (tm_symbols_cache_t) { 0 };
+	if (!tm_mapped_file_open(path, &cache->file))
+		return false;
+
+	if (!private__symbols_cache_parse(a, cache)) {
+		tm_symbols_cache_close(a, cache);
+		return false;
+	}
+
+	return true;
+}
+
+static const tm_symbols_cache_file_t *tm_symbols_cache_find(const tm_symbols_cache_t *cache, const char *path)
+{
+	if (!cache || !cache->slots)
+		return 0;
+
+	const uint32_t path_length = (uint32_t)strlen(path);
+	for (uint64_t slot = private__symbols_cache_path_hash(path, path_length) & cache->mask;; slot = (slot + 1) & cache->mask) {
+		const uint32_t file_idx = cache->slots[slot];
+		if (!file_idx)
+			return 0;
+
+		const tm_symbols_cache_file_t *file = cache->files + file_idx - 1;
+		if (file->path_length == path_length && !memcmp(file->path, path, path_length))
+			return file;
+	}
+}
+
+static int private__symbols_cache_file_compare(const void *a, const void *b)
+{
+	const tm_symbols_cache_file_t *file_a = a, *file_b = b;
+	const int result = memcmp(file_a->path, file_b->path, tm_min(file_a->path_length, file_b->path_length));
+	return result ? result : (int)file_a->path_length - (int)file_b->path_length;
+}
+
+// Writes the files sorted by path, so the cache doesn't depend on the order the files were searched in.
+// The cache is written next to `path` first and then moved in place, since `files` may point into the old cache.
+static void tm_symbols_cache_save(tm_allocator_i *a, const char *path, tm_symbols_cache_file_t *files, tm_symbols_cache_t *old_cache)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const uint64_t file_count = tm_carray_size(files);
+	qsort(files, file_count, sizeof(tm_symbols_cache_file_t), private__symbols_cache_file_compare);
+
+	uint64_t size = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+	for (uint64_t i = 0; i < file_count; ++i)
+		size += tm_symbols_cache__file_header_size + files[i].path_length + files[i].literals_size;
+
+	char *buffer = tm_alloc(a, size);
+	const uint32_t magic = TM_SYMBOLS_CACHE_MAGIC, version = TM_SYMBOLS_CACHE_VERSION;
+	memcpy(buffer, &magic, sizeof(uint32_t));
+	memcpy(buffer + sizeof(uint32_t), &version, sizeof(uint32_t));
+	memcpy(buffer + sizeof(uint32_t) * 2, &file_count, sizeof(uint64_t));
+
+	uint64_t offset = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+	for (uint64_t i = 0; i < file_count; ++i) {
+		const tm_symbols_cache_file_t *file = files + i;
+		memcpy(buffer + offset, &file->size, sizeof(uint64_t));
+		memcpy(buffer + offset + 8, &file->modified_time, sizeof(uint64_t));
+		memcpy(buffer + offset + 16, &file->content_hash, sizeof(uint64_t));
+		memcpy(buffer + offset + 24, &file->literals_size, sizeof(uint64_t));
+		memcpy(buffer + offset + 32, &file->path_length, sizeof(uint32_t));
+		memcpy(buffer + offset + 36, &file->literal_count, sizeof(uint32_t));
+		offset += tm_symbols_cache__file_header_size;
+
+		memcpy(buffer + offset, file->path, file->path_length);
+		memcpy(buffer + offset + file->path_length, file->literals, file->literals_size);
+		offset += file->path_length + file->literals_size;
+	}
+
+	const char *temp_path = tm_temp_allocator_api->printf(ta, "%s.tmp", path);
+	tm_file_o file = tm_os_api->file_io->open_output(temp_path, false);
+	if (file.valid) {
+		const bool written = tm_os_api->file_io->write(file, buffer, size);
+		tm_os_api->file_io->close(file);
+
+		// The old cache has to be unmapped before it can be replaced on Windows.
+		tm_symbols_cache_close(a, old_cache);
+		tm_os_api->file_system->remove_file(path);
+		if (!written || !tm_os_api->file_system->rename(temp_path, path))
+			tm_os_api->file_system->remove_file(temp_path);
+	}
+
+	tm_free(a, buffer, size);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
\ No newline at end of file
@@ -1,188 +1,260 @@
-static const char *tm_symbol_dump_decode(const tm_huffman_tree_t *tree, const tm_symbol_node_t *node, tm_file_o file, tm_temp_allocator_i *ta)
+typedef enum tm_symbols_dump_format_t
 {
+	// [0x<hash>] "<string>", meant to be read by people.
+	TM_SYMBOLS_DUMP_FORMAT_TEXT,
+	// hash,string with a header line, strings quoted as in RFC 4180.
+	TM_SYMBOLS_DUMP_FORMAT_CSV,
+	// hash<tab>string with a header line, tabs, newlines and backslashes in strings are escaped with backslashes.
+	TM_SYMBOLS_DUMP_FORMAT_TSV,
+	// One {"hash": ..., "string": ...} object per line. Hashes are strings since they don't fit in a double.
+	TM_SYMBOLS_DUMP_FORMAT_JSONL,
+} tm_symbols_dump_format_t;
+
+static const char *tm_symbols_dump_format_names[] = { "text", "csv", "tsv", "jsonl" };
+
+// Lines are formatted into a large buffer that's written to the file or logged in one go.
+#define TM_SYMBOLS_DUMP_BUFFER_SIZE (1024 * 1024)
+
+typedef struct tm_symbols_dump_output_t
+{
+	tm_allocator_i *a;
+	// Invalid when dumping to the user.
+	tm_file_o file;
 	char *buffer;
-	uint64_t string_length;
-
-	if (tree) {
-		const uint64_t encoded_end = (node->string_start & 7) + node->string_length;
-		const uint64_t encoded_length = (node->string_length >> 3) + 1ull;
-
-		char *code_buffer = tm_temp_alloc(ta, encoded_length);
-		tm_os_api->file_io->read_at(file, node->string_start >> 3, code_buffer, encoded_length);
-
-		uint64_t offset = node->string_start & 7;
-		buffer = tm_temp_alloc(ta, encoded_length);
-		for (string_length = 0; offset < encoded_end; ++string_length)
-			buffer[string_length] = tm_huffman_tree_decode(tree, code_buffer, &offset);
-
-		ta->realloc(ta->inst, code_buffer, encoded_length, 0);
-		ta->realloc(ta->inst, buffer, encoded_length, string_length);
-	} else {
-		string_length = node->string_length;
-		buffer = tm_temp_alloc(ta, string_length + 1);
-		tm_os_api->file_io->read_at(file, node->string_start, buffer, string_length);
+	uint64_t buffer_size;
+	uint64_t used;
+	tm_symbols_dump_format_t format;
+	uint32_t page_count;
+} tm_symbols_dump_output_t;
+
+static void tm_symbols_dump_output_flush(tm_symbols_dump_output_t *output)
+{
+	if (!output->used)
+		return;
+
+	if (output->file.valid)
+		tm_os_api->file_io->write(output->file, output->buffer, output->used);
+	else {
+		output->buffer[output->used] = '\0';
+		tm_logger_api->print(TM_LOG_TYPE_INFO, output->buffer);
 	}
 
-	buffer[string_length] = '\0';
-	return buffer;
+	output->used = 0;
 }
 
-static void tm_symbol_dump_node_to_user(const tm_symbol_tree_t *tree, const tm_huffman_tree_t *decoding, uint32_t root_idx, tm_file_o file, uint32_t *page_count)
+// Returns space for `size` more characters, leaving room for the null terminator needed to log the buffer.
+static char *private__dump_reserve(tm_symbols_dump_output_t *output, uint64_t size)
 {
-	const tm_symbol_node_t *node = tree->nodes + root_idx;
-	
-	if (node->left)
-		tm_symbol_dump_node_to_user(tree, decoding, node->left, file, page_count);
+	if (output->used + size + 1 > output->buffer_size)
+		tm_symbols_dump_output_flush(output);
 
-	if (page_threshold && (*page_count)++ == page_threshold) {
-		*page_count = 0;
-		tm_logger_api->print(TM_LOG_TYPE_INFO, "press any key to load more...");
-		getchar();
+	if (size + 1 > output->buffer_size) {
+		output->buffer = tm_realloc(output->a, output->buffer, output->buffer_size, size + 1);
+		output->buffer_size = size + 1;
 	}
 
-	TM_INIT_TEMP_ALLOCATOR(ta);
-	const char *string = tm_symbol_dump_decode(decoding, node, file, ta);
-	tm_logger_api->printf(TM_LOG_TYPE_INFO, "[0x%llx] \"%s\"\n", node->hash, string);
-	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
-
-	if (node->right)
-		tm_symbol_dump_node_to_user(tree, decoding, node->right, file, page_count);
+	return output->buffer + output->used;
 }
 
-static void tm_symbol_dump_node_to_file(const tm_symbol_tree_t *tree, const tm_huffman_tree_t *decoding, uint32_t root_idx, tm_file_o input_file, tm_file_o output_file)
+static inline char *private__dump_append(char *dst, const char *s, uint64_t length)
 {
-	const tm_symbol_node_t *node = tree->nodes + root_idx;
+	memcpy(dst, s, length);
+	return dst + length;
+}
 
-	if (node->left)
-		tm_symbol_dump_node_to_file(tree, decoding, node->left, input_file, output_file);
+// Same digits as "%llx".
+static inline char *private__dump_hex(char *dst, uint64_t hash)
+{
+	uint32_t digits = 1;
+	while (digits < 16 && hash >> (digits << 2))
+		++digits;
 
-	TM_INIT_TEMP_ALLOCATOR(ta);
-	const char *string = tm_symbol_dump_decode(decoding, node, input_file, ta);
-	const char *line = tm_temp_allocator_api->printf(ta, "[0x%llx] \"%s\"\n", node->hash, string);
-	tm_os_api->file_io->write(output_file, line, strlen(line));
-	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	for (uint32_t i = digits; i--;)
+		*dst++ = "0123456789abcdef"[(hash >> (i << 2)) & 0xF];
 
-	if (node->right)
-		tm_symbol_dump_node_to_file(tree, decoding, node->right, input_file, output_file);
+	return dst;
 }
 
-static void tm_symbols_dump_file_to_user(tm_allocator_i *a, const char *input)
+// Writes the header line of the format, if it has one.
+static void tm_symbols_dump_output_begin(tm_symbols_dump_output_t *output)
 {
-	tm_file_o file = tm_os_api->file_io->open_input(input);
-	uint32_t page_count = 0;
-
-	uint32_t flags;
-	tm_symbol_tree_t tree = { 0 };
-	tm_os_api->file_io->read(file, &flags, sizeof(uint32_t));
-	tm_os_api->file_io->read(file, &tree.node_count, sizeof(uint32_t));
-	tree.nodes = tm_alloc(a, tree.node_count * sizeof(tm_symbol_node_t));
-	tm_os_api->file_io->read(file, tree.nodes, tree.node_count * sizeof(tm_symbol_node_t));
-
-	if (flags & TM_HDB_FLAGS_COMPRESSED) {
-		tm_huffman_tree_t decoding = { 0 };
-		tm_os_api->file_io->read(file, &decoding.node_count, sizeof(uint32_t));
-		decoding.nodes = tm_alloc(a, decoding.node_count * sizeof(tm_huffman_node_t));
-		tm_os_api->file_io->read(file, decoding.nodes, decoding.node_count * sizeof(tm_huffman_node_t));
-
-		tm_symbol_dump_node_to_user(&tree, &decoding, 0, file, &page_count);
-		tm_huffman_tree_free(a, &decoding);
-	} else
-		tm_symbol_dump_node_to_user(&tree, 0, 0, file, &page_count);
-
-	tm_symbol_tree_free(a, &tree);
-	tm_os_api->file_io->close(file);
+	const char *header = output->format == TM_SYMBOLS_DUMP_FORMAT_CSV ? "hash,string\n" : output->format == TM_SYMBOLS_DUMP_FORMAT_TSV ? "hash\tstring\n" : "";
+	const uint64_t length = strlen(header);
+	private__dump_append(private__dump_reserve(output, length), header, length);
+	output->used += length;
 }
 
-static void tm_symbols_dump_file_to_file(tm_allocator_i *a, const char *input, const char *output)
+static void tm_symbols_dump_output_entry(tm_symbols_dump_output_t *output, uint64_t hash, const char *string, uint32_t length)
 {
-	tm_file_o input_file = tm_os_api->file_io->open_input(input);
-	tm_file_o output_file = tm_os_api->file_io->open_output(output, true);
-
-	uint32_t flags;
-	tm_symbol_tree_t tree = { 0 };
-	tm_os_api->file_io->read(input_file, &flags, sizeof(uint32_t));
-	tm_os_api->file_io->read(input_file, &tree.node_count, sizeof(uint32_t));
-	tree.nodes = tm_alloc(a, tree.node_count * sizeof(tm_symbol_node_t));
-	tm_os_api->file_io->read(input_file, tree.nodes, tree.node_count * sizeof(tm_symbol_node_t));
-
-	if (flags & TM_HDB_FLAGS_COMPRESSED) {
-		tm_huffman_tree_t decoding = { 0 };
-		tm_os_api->file_io->read(input_file, &decoding.node_count, sizeof(uint32_t));
-		decoding.nodes = tm_alloc(a, decoding.node_count * sizeof(tm_huffman_node_t));
-		tm_os_api->file_io->read(input_file, decoding.nodes, decoding.node_count * sizeof(tm_huffman_node_t));
-
-		tm_symbol_dump_node_to_file(&tree, &decoding, 0, input_file, output_file);
-		tm_huffman_tree_free(a, &decoding);
-	} else
-		tm_symbol_dump_node_to_file(&tree, 0, 0, input_file, output_file);
-
-	tm_symbol_tree_free(a, &tree);
-	tm_os_api->file_io->close(input_file);
-	tm_os_api->file_io->close(output_file);
+	if (!output->file.valid && page_threshold && output->page_count++ == page_threshold) {
+		output->page_count = 0;
+		tm_symbols_dump_output_flush(output);
+		tm_logger_api->print(TM_LOG_TYPE_INFO, "press any key to load more...");
+		getchar();
+	}
+
+	// Escaping grows a character to at most six, the rest of the line takes less than 64 characters.
+	char *const start = private__dump_reserve(output, length * 6ull + 64);
+	char *dst = start;
+
+	switch (output->format) {
+	case TM_SYMBOLS_DUMP_FORMAT_TEXT:
+		dst = private__dump_append(dst, "[0x", 3);
+		dst = private__dump_hex(dst, hash);
+		dst = private__dump_append(dst, "] \"", 3);
+		dst = private__dump_append(dst, string, length);
+		dst = private__dump_append(dst, "\"\n", 2);
+		break;
+	case TM_SYMBOLS_DUMP_FORMAT_CSV:
+		dst = private__dump_append(dst, "0x", 2);
+		dst = private__dump_hex(dst, hash);
+		dst = private__dump_append(dst, ",\"", 2);
+		for (uint32_t i = 0; i < length; ++i) {
+			if (string[i] == '"')
+				*dst++ = '"';
+			*dst++ = string[i];
+		}
+		dst = private__dump_append(dst, "\"\n", 2);
+		break;
+	case TM_SYMBOLS_DUMP_FORMAT_TSV:
+		dst = private__dump_append(dst, "0x", 2);
+		dst = private__dump_hex(dst, hash);
+		*dst++ = '\t';
+		for (uint32_t i = 0; i < length; ++i) {
+			const char c = string[i];
+			if (c == '\t' || c == '\n' || c == '\r' || c == '\\') {
+				*dst++ = '\\';
+				*dst++ = c == '\t' ? 't' : c == '\n' ? 'n' : c == '\r' ? 'r' : '\\';
+			} else
+				*dst++ = c;
+		}
+		*dst++ = '\n';
+		break;
+	case TM_SYMBOLS_DUMP_FORMAT_JSONL:
+		dst = private__dump_append(dst, "{\"hash\":\"0x", 11);
+		dst = private__dump_hex(dst, hash);
+		dst = private__dump_append(dst, "\",\"string\":\"", 12);
+		for (uint32_t i = 0; i < length; ++i) {
+			const uint8_t c = (uint8_t)string[i];
+			if (c == '"' || c == '\\') {
+				*dst++ = '\\';
+				*dst++ = (char)c;
+			} else if (c < 0x20) {
+				dst = private__dump_append(dst, "\\u00", 4);
+				*dst++ = "0123456789abcdef"[c >> 4];
+				*dst++ = "0123456789abcdef"[c & 0xF];
+			} else
+				*dst++ = (char)c;
+		}
+		dst = private__dump_append(dst, "\"}\n", 3);
+		break;
+	}
+
+	output->used += dst - start;
 }
 
-static void tm_symbols_dump_file_or_dir_to_user(tm_allocator_i *a, const char *input)
+// Dumps all entries of the database in index order. Generated databases store their strings in the same order,
+// so the string data is decoded front to back in a single pass over the mapping.
+static bool tm_symbols_dump_file(tm_allocator_i *a, const char *input, tm_symbols_dump_output_t *output)
 {
-	tm_file_stat_t stat = tm_os_api->file_system->stat(input);
-	if (!stat.exists)
-		return;
-	else if (stat.is_directory) {
-		TM_INIT_TEMP_ALLOCATOR(ta);
-		tm_strings_t *entries = tm_os_api->file_system->directory_entries(input, ta);
-		char *s = (char *)entries + sizeof(tm_strings_t);
-		for (uint32_t i = 0; i < entries->count; ++i) {
-			char *cur = s;
-			s += strlen(s) + 1;
-
-			if (cur[0] == '.') continue;
-			if (!strcmp(input, "."))
-				tm_symbols_dump_file_or_dir_to_user(a, cur);
-			else {
-				char *joined = tm_temp_allocator_api->printf(ta, "%s/%s", input, cur);
-				tm_symbols_dump_file_or_dir_to_user(a, joined);
-				ta->realloc(ta->inst, joined, strlen(joined + 1), 0);
-			}
-		}
+	tm_symbol_database_t db;
+	if (!tm_symbol_database_open(a, input, &db))
+		return false;
 
-		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	const tm_symbol_index_t *index = &db.index;
+	char *buffer = 0;
+	uint32_t buffer_size = 0;
+	if (db.decoding.node_count || (db.flags & (TM_HDB_FLAGS_FRONT_CODED | TM_HDB_FLAGS_FSST))) {
+		// Every character takes at least one bit, so no string is longer than its encoded length.
+		// Front coded databases store the number of characters, FSST codes decode to at most eight.
+		const uint64_t characters_per_unit = db.symbol_table && !(db.flags & TM_HDB_FLAGS_FRONT_CODED) ? TM_FSST_MAX_SYMBOL_LENGTH : 1;
+		for (uint32_t i = 0; i < index->entry_count; ++i)
+			buffer_size = (uint32_t)tm_min(UINT32_MAX, tm_max(buffer_size, index->string_lengths[i] * characters_per_unit));
+		buffer = tm_alloc(a, buffer_size);
 	}
-	else {
-		const char *ext = 0;
-		tm_path_api->split(input, &ext);
-		if (!strcmp(ext, ".hdb"))
-			tm_symbols_dump_file_to_user(a, input);
+
+	for (uint32_t i = 0; i < index->entry_count; ++i) {
+		uint32_t length;
+		const char *string = tm_symbol_database_view(&db, i, &length);
+		if (!string) {
+			length = tm_symbol_database_decode(&db, i, buffer, buffer_size);
+			string = buffer;
+		}
+
+		tm_symbols_dump_output_entry(output, index->hashes[i], string, length);
 	}
+
+	if (buffer)
+		tm_free(a, buffer, buffer_size);
+	tm_symbol_database_close(a, &db);
+	return true;
 }
 
-static void tm_symbols_dump_file_or_dir_to_file(tm_allocator_i *a, const char *input, const char *output)
+// Returns a carray of the .hdb files at or below `input`, in the order their directories list them.
+// Directories are walked with an explicit stack, so deep trees don't use any more call stack.
+static const char **tm_symbols_database_paths(const char *input, tm_temp_allocator_i *ta)
 {
-	tm_file_stat_t stat = tm_os_api->file_system->stat(input);
-	if (!stat.exists)
-		return;
-	else if (stat.is_directory) {
-		TM_INIT_TEMP_ALLOCATOR(ta);
-		tm_strings_t *entries = tm_os_api->file_system->directory_entries(input, ta);
-		char *s = (char *)entries + sizeof(tm_strings_t);
-		for (uint32_t i = 0; i < entries->count; ++i) {
-			char *cur = s;
-			s += strlen(s) + 1;
-
-			if (cur[0] == '.') continue;
-			if (!strcmp(input, "."))
-				tm_symbols_dump_file_or_dir_to_file(a, cur, output);
-			else {
-				char *joined = tm_temp_allocator_api->printf(ta, "%s/%s", input, cur);
-				tm_symbols_dump_file_or_dir_to_file(a, joined, output);
-				ta->realloc(ta->inst, joined, strlen(joined + 1), 0);
+	const char **paths = 0, **databases = 0;
+	tm_carray_temp_push(paths, input, ta);
+	while (tm_carray_size(paths)) {
+		const char *path = tm_carray_pop(paths);
+		tm_file_stat_t stat = tm_os_api->file_system->stat(path);
+		if (!stat.exists)
+			continue;
+		else if (stat.is_directory) {
+			tm_strings_t *entries = tm_os_api->file_system->directory_entries(path, ta);
+			const char *s = (const char *)entries + sizeof(tm_strings_t);
+			// Pushed in reverse, so the entries are visited in the order they are listed.
+			const char **children = 0;
+			for (uint32_t i = 0; i < entries->count; ++i, s += strlen(s) + 1) {
+				if (s[0] != '.')
+					tm_carray_temp_push(children, !strcmp(path, ".") ? s : tm_temp_allocator_api->printf(ta, "%s/%s", path, s), ta);
 			}
+			for (uint64_t i = tm_carray_size(children); i--;)
+				tm_carray_temp_push(paths, children[i], ta);
+		}
+		else {
+			const char *ext = 0;
+			tm_path_api->split(path, &ext);
+			if (!strcmp(ext, ".hdb"))
+				tm_carray_temp_push(databases, path, ta);
 		}
+	}
 
-		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return databases;
+}
+
+// Dumps every .hdb file at or below `input` to `output_path`, or to the user if it's null.
+static void tm_symbols_dump_file_or_dir(tm_allocator_i *a, const char *input, const char *output_path, tm_symbols_dump_format_t format)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	tm_symbols_dump_output_t output = {
+		.a = a,
+		.buffer = tm_alloc(a, TM_SYMBOLS_DUMP_BUFFER_SIZE),
+		.buffer_size = TM_SYMBOLS_DUMP_BUFFER_SIZE,
+		.format = format,
+	};
+
+	if (output_path) {
+		output.file = tm_os_api->file_io->open_output(output_path, true);
+		if (!output.file.valid)
+			tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to open '%s' for writing\n", output_path);
 	}
-	else {
-		const char *ext = 0;
-		tm_path_api->split(input, &ext);
-		if (!strcmp(ext, ".hdb"))
-			tm_symbols_dump_file_to_file(a, input, output);
+
+	if (!output_path || output.file.valid) {
+		tm_symbols_dump_output_begin(&output);
+
+		const char **paths = tm_symbols_database_paths(input, ta);
+		for (uint64_t i = 0; i < tm_carray_size(paths); ++i) {
+			if (!tm_symbols_dump_file(a, paths[i], &output))
+				tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to read '%s'\n", paths[i]);
+		}
+
+		tm_symbols_dump_output_flush(&output);
 	}
+
+	if (output.file.valid)
+		tm_os_api->file_io->close(output.file);
+	tm_free(a, output.buffer, output.buffer_size);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
 }
\ No newline at end of file
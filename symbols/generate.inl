@@ -1,151 +1,1433 @@
-#define TM_FILE_SEARCH_BLOCK_SIZE (1 << 12)
+// A string found by the generator.
+typedef struct tm_symbols_entry_t
+{
+	uint64_t hash;
+	const char *string;
+	uint32_t length;
+	TM_PAD(4);
+} tm_symbols_entry_t;
+
+// Strings found by one scanning thread, deduplicated by hash.
+typedef struct tm_symbols_set_t
+{
+	// carray
+	tm_symbols_entry_t *entries;
+	// Open addressing table of entry indices + 1, zero marks an empty slot.
+	uint32_t *slots;
+	uint64_t mask;
+	tm_string_arena_t strings;
+	// Bytes allocated from `strings`, used to enforce the memory limit.
+	uint64_t string_bytes;
+} tm_symbols_set_t;
+
+static void private__symbols_set_grow(tm_allocator_i *a, tm_symbols_set_t *set)
+{
+	const uint64_t old_capacity = set->slots ? set->mask + 1 : 0;
+	const uint64_t capacity = tm_max(1024, old_capacity << 1);
+	tm_free(a, set->slots, old_capacity * sizeof(uint32_t));
+
+	set->slots = tm_alloc(a, capacity * sizeof(uint32_t));
+	memset(set->slots, 0, capacity * sizeof(uint32_t));
+	set->mask = capacity - 1;
+
+	const uint32_t entry_count = (uint32_t)tm_carray_size(set->entries);
+	for (uint32_t i = 0; i < entry_count; ++i) {
+		uint64_t slot = set->entries[i].hash & set->mask;
+		while (set->slots[slot])
+			slot = (slot + 1) & set->mask;
+		set->slots[slot] = i + 1;
+	}
+}
+
+static void tm_symbols_set_add(tm_allocator_i *a, tm_symbols_set_t *set, const char *string, uint32_t length)
+{
+	if (!set->slots || (tm_carray_size(set->entries) + 1) << 1 > set->mask + 1)
+		private__symbols_set_grow(a, set);
+
+	const uint64_t hash = tm_murmur_hash_inline(string, (int)length, 0);
+	for (uint64_t slot = hash & set->mask;; slot = (slot + 1) & set->mask) {
+		const uint32_t entry_idx = set->slots[slot];
+		if (!entry_idx) {
+			char *copy = tm_string_arena_alloc(&set->strings, a, length + 1ull);
+			set->string_bytes += length + 1ull;
+			memcpy(copy, string, length);
+			copy[length] = '\0';
+
+			const tm_symbols_entry_t entry = { .hash = hash, .string = copy, .length = length };
+			tm_carray_push(set->entries, entry, a);
+			set->slots[slot] = (uint32_t)tm_carray_size(set->entries);
+
+			printf_loud("%s\n", copy);
+			return;
+		}
+
+		if (set->entries[entry_idx - 1].hash == hash)
+			return;
+	}
+}
+
+static void tm_symbols_set_free(tm_allocator_i *a, tm_symbols_set_t *set)
+{
+	tm_carray_free(set->entries, a);
+	tm_free(a, set->slots, set->slots ? (set->mask + 1) * sizeof(uint32_t) : 0);
+	tm_string_arena_free(&set->strings, a);
+	*set = (tm_symbols_set_t) { 0 };
+}
+
+// Memory used by the set, including the scratch array needed to sort it when it's spilled to a run.
+static inline uint64_t tm_symbols_set_memory(const tm_symbols_set_t *set)
+{
+	return set->string_bytes + (tm_carray_capacity(set->entries) << 1) * sizeof(tm_symbols_entry_t) + (set->slots ? (set->mask + 1) * sizeof(uint32_t) : 0);
+}
+
+// LSD radix sort on the hashes, one byte per pass. Returns whichever of the two arrays holds the result.
+static tm_symbols_entry_t *private__symbols_sort_entries(tm_symbols_entry_t *entries, tm_symbols_entry_t *scratch, uint64_t count)
+{
+	uint64_t offsets[8][256] = { 0 };
+	for (uint64_t i = 0; i < count; ++i) {
+		for (uint32_t pass = 0; pass < 8; ++pass)
+			++offsets[pass][(entries[i].hash >> (pass << 3)) & 0xFF];
+	}
+
+	for (uint32_t pass = 0; pass < 8; ++pass) {
+		const uint32_t shift = pass << 3;
+		// All hashes share this byte, so the pass wouldn't change the order.
+		if (count && offsets[pass][(entries[0].hash >> shift) & 0xFF] == count)
+			continue;
+
+		for (uint32_t i = 0, sum = 0; i < 256; ++i) {
+			const uint64_t bucket_size = offsets[pass][i];
+			offsets[pass][i] = sum;
+			sum += (uint32_t)bucket_size;
+		}
+
+		for (uint64_t i = 0; i < count; ++i)
+			scratch[offsets[pass][(entries[i].hash >> shift) & 0xFF]++] = entries[i];
+
+		tm_symbols_entry_t *tmp = entries;
+		entries = scratch;
+		scratch = tmp;
+	}
+
+	return entries;
+}
+
+// Merges the sets into one carray sorted by hash. For colliding hashes the lexicographically first string is kept,
+// so the result only depends on the strings found, not on which thread found them or in which order.
+static tm_symbols_entry_t *tm_symbols_merge(tm_allocator_i *a, const tm_symbols_set_t *sets, uint32_t set_count)
+{
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < set_count; ++i)
+		total += tm_carray_size(sets[i].entries);
+
+	tm_symbols_entry_t *entries = 0, *scratch = 0;
+	tm_carray_resize(entries, total, a);
+	tm_carray_resize(scratch, total, a);
+	uint64_t offset = 0;
+	for (uint32_t i = 0; i < set_count; ++i) {
+		const uint64_t size = tm_carray_size(sets[i].entries);
+		if (size)
+			memcpy(entries + offset, sets[i].entries, size * sizeof(tm_symbols_entry_t));
+		offset += size;
+	}
+
+	const tm_symbols_entry_t *sorted = private__symbols_sort_entries(entries, scratch, total);
+	tm_symbols_entry_t *result = sorted == entries ? entries : scratch;
+	tm_symbols_entry_t *unused = sorted == entries ? scratch : entries;
+
+	uint32_t unique = 0;
+	for (uint64_t i = 0; i < total; ++i) {
+		if (!unique || result[unique - 1].hash != result[i].hash)
+			result[unique++] = result[i];
+		else if (strcmp(result[i].string, result[unique - 1].string) < 0)
+			result[unique - 1] = result[i];
+	}
+
+	tm_carray_free(unused, a);
+	tm_carray_shrink(result, unique);
+	return result;
+}
+
+// How the generator stores the strings of a database.
+typedef enum tm_symbols_strings_t
+{
+	// Every string on its own, in the order of the hashes.
+	TM_SYMBOLS_STRINGS_PLAIN,
+	// Strings that are the end of another string are stored as part of it. Only the string starts differ
+	// from a plain database, so any version 2 reader can read it.
+	TM_SYMBOLS_STRINGS_SUFFIXES,
+	// Sorted strings share their prefixes with the previous string, see `TM_HDB_FLAGS_FRONT_CODED`.
+	TM_SYMBOLS_STRINGS_FRONT_CODED,
+} tm_symbols_strings_t;
+
+static const char *tm_symbols_strings_names[] = { "plain", "suffixes", "front" };
+
+// How the generator compresses the strings of a database.
+typedef enum tm_symbols_compression_t
+{
+	TM_SYMBOLS_COMPRESSION_NONE,
+	// Canonical Huffman code over the bytes of the strings, see `TM_HDB_FLAGS_CANONICAL`.
+	TM_SYMBOLS_COMPRESSION_HUFFMAN,
+	// Table of multi byte symbols, see `TM_HDB_FLAGS_FSST`.
+	TM_SYMBOLS_COMPRESSION_FSST,
+} tm_symbols_compression_t;
+
+static const char *tm_symbols_compression_names[] = { "none", "huffman", "fsst" };
+
+// The string of an entry, for sorting the strings without moving the entries.
+typedef struct private__symbols_string_ref_t
+{
+	const char *string;
+	uint32_t length;
+	uint32_t entry_idx;
+} private__symbols_string_ref_t;
+
+// Ties are broken by entry so the order of equal strings doesn't depend on the sort.
+static int private__symbols_string_compare(const void *a, const void *b)
+{
+	const private__symbols_string_ref_t *ref_a = a, *ref_b = b;
+	const int result = memcmp(ref_a->string, ref_b->string, tm_min(ref_a->length, ref_b->length));
+	if (result)
+		return result;
+
+	if (ref_a->length != ref_b->length)
+		return ref_a->length < ref_b->length ? -1 : 1;
+
+	return (ref_a->entry_idx > ref_b->entry_idx) - (ref_a->entry_idx < ref_b->entry_idx);
+}
+
+// Compares the strings from their last character backwards.
+static int private__symbols_reversed_string_compare(const void *a, const void *b)
+{
+	const private__symbols_string_ref_t *ref_a = a, *ref_b = b;
+	const uint8_t *string_a = (const uint8_t *)ref_a->string + ref_a->length;
+	const uint8_t *string_b = (const uint8_t *)ref_b->string + ref_b->length;
+	for (uint32_t i = tm_min(ref_a->length, ref_b->length); i; --i) {
+		const int result = *--string_a - *--string_b;
+		if (result)
+			return result;
+	}
+
+	if (ref_a->length != ref_b->length)
+		return ref_a->length < ref_b->length ? -1 : 1;
+
+	return (ref_a->entry_idx > ref_b->entry_idx) - (ref_a->entry_idx < ref_b->entry_idx);
+}
+
+static private__symbols_string_ref_t *private__symbols_sort_strings(tm_temp_allocator_i *ta, const tm_symbols_entry_t *entries, uint32_t count, bool reversed)
+{
+	private__symbols_string_ref_t *refs = tm_temp_alloc(ta, count * sizeof(private__symbols_string_ref_t));
+	for (uint32_t i = 0; i < count; ++i)
+		refs[i] = (private__symbols_string_ref_t) { .string = entries[i].string, .length = entries[i].length, .entry_idx = i };
+
+	qsort(refs, count, sizeof(private__symbols_string_ref_t), reversed ? private__symbols_reversed_string_compare : private__symbols_string_compare);
+	return refs;
+}
+
+// Returns for every entry the entry its string is stored in: either the entry itself or the longest entry its string is the end of.
+static uint32_t *private__symbols_suffix_owners(tm_temp_allocator_i *ta, const tm_symbols_entry_t *entries, uint32_t count)
+{
+	// Sorted by their reversed strings, the strings that end with a string directly follow it.
+	const private__symbols_string_ref_t *refs = private__symbols_sort_strings(ta, entries, count, true);
+	uint32_t *owners = tm_temp_alloc(ta, count * sizeof(uint32_t));
+	for (uint32_t i = count; i-- > 0;) {
+		const private__symbols_string_ref_t *ref = refs + i, *next = refs + i + 1;
+		const bool is_suffix = i + 1 < count && next->length >= ref->length && !memcmp(ref->string, next->string + next->length - ref->length, ref->length);
+		owners[ref->entry_idx] = is_suffix ? owners[next->entry_idx] : ref->entry_idx;
+	}
+
+	return owners;
+}
+
+static inline uint32_t private__symbols_shared_prefix(const private__symbols_string_ref_t *a, const private__symbols_string_ref_t *b)
+{
+	const uint32_t max_shared = tm_min(a->length, b->length);
+	uint32_t shared = 0;
+	while (shared < max_shared && a->string[shared] == b->string[shared])
+		++shared;
+
+	return shared;
+}
+
+// Characters of the sorted string that are stored, the ones it doesn't share with the previous string of its block.
+static inline uint32_t private__symbols_front_coded_suffix(const private__symbols_string_ref_t *sorted, uint32_t i)
+{
+	return i & (TM_HDB_FRONT_CODING_BLOCK_SIZE - 1) ? private__symbols_shared_prefix(sorted + i - 1, sorted + i) : 0;
+}
+
+// Bound on the size of front coded strings: two bytes per character for compressed suffixes, two varints per string,
+// the count and the padding of every block and the slack for appending bits.
+static inline uint64_t private__symbols_front_coded_capacity(uint64_t character_count, uint32_t count)
+{
+	return (character_count << 1) + count * 20ull + ((count / TM_HDB_FRONT_CODING_BLOCK_SIZE + 1) << 1) + sizeof(uint64_t);
+}
+
+// Appends the Huffman codes of the string to `buffer`, which needs two bytes per character plus eight bytes of slack.
+static inline void private__symbols_encode(const uint32_t *code_lut, const uint8_t *string, uint32_t length, char *buffer, uint64_t *bit_offset)
+{
+	uint32_t i = 0;
+	// Up to four codes of at most 12 bits are gathered before they are appended to the buffer.
+	for (; i + 4 <= length; i += 4) {
+		uint64_t bits = 0;
+		uint32_t bit_count = 0;
+		for (uint32_t j = 0; j < 4; ++j) {
+			const uint32_t code = code_lut[string[i + j]];
+			bits |= (uint64_t)tm_huffman_code__code_word(code) << bit_count;
+			bit_count += tm_huffman_code__bit_count(code);
+		}
+		tm_binary_handler_append_bits(buffer, bit_offset, bits, bit_count);
+	}
+	for (; i < length; ++i)
+		tm_binary_handler_append_bits(buffer, bit_offset, tm_huffman_code__code_word(code_lut[string[i]]), tm_huffman_code__bit_count(code_lut[string[i]]));
+}
+
+static inline uint64_t private__symbols_encoded_bits(const uint32_t *code_lut, const uint8_t *string, uint32_t length)
+{
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < length; ++i)
+		bits += tm_huffman_code__bit_count(code_lut[string[i]]);
+
+	return bits;
+}
+
+// Front codes the sorted strings into `buffer`, which has to be zeroed if `code_lut` is set to Huffman code the suffixes.
+// With `fsst` set the suffixes are compressed with its symbol table instead.
+// Sets the string starts of the entries for strings written at `data_start` in the file and returns the size of the strings.
+static uint64_t private__symbols_front_code(const private__symbols_string_ref_t *sorted, uint32_t count, const uint32_t *code_lut, const tm_fsst_encoder_t *fsst,
+	uint64_t data_start, char *buffer, uint64_t *string_starts, uint32_t *string_lengths)
+{
+	uint64_t size = 0;
+	for (uint32_t block = 0; block < count; block += TM_HDB_FRONT_CODING_BLOCK_SIZE) {
+		const uint32_t block_count = tm_min(count - block, TM_HDB_FRONT_CODING_BLOCK_SIZE);
+		const uint64_t block_start = data_start + size;
+		buffer[size++] = (char)block_count;
+
+		uint32_t shared[TM_HDB_FRONT_CODING_BLOCK_SIZE];
+		for (uint32_t i = 0; i < block_count; ++i) {
+			const private__symbols_string_ref_t *ref = sorted + block + i;
+			shared[i] = private__symbols_front_coded_suffix(sorted, block + i);
+			const uint32_t suffix_length = ref->length - shared[i];
+			const uint8_t *suffix = (const uint8_t *)ref->string + shared[i];
+			const uint64_t suffix_size = code_lut ? private__symbols_encoded_bits(code_lut, suffix, suffix_length)
+				: fsst ? tm_fsst_encode(fsst, suffix, suffix_length, 0) : suffix_length;
+			tm_binary_handler_write_varint(buffer, &size, shared[i]);
+			tm_binary_handler_write_varint(buffer, &size, suffix_size);
+
+			string_starts[ref->entry_idx] = (block_start << TM_HDB_FRONT_CODING_BLOCK_SHIFT) | i;
+			string_lengths[ref->entry_idx] = ref->length;
+		}
+
+		uint64_t bit_offset = size << 3;
+		for (uint32_t i = 0; i < block_count; ++i) {
+			const private__symbols_string_ref_t *ref = sorted + block + i;
+			if (code_lut)
+				private__symbols_encode(code_lut, (const uint8_t *)ref->string + shared[i], ref->length - shared[i], buffer, &bit_offset);
+			else if (fsst)
+				size += tm_fsst_encode(fsst, (const uint8_t *)ref->string + shared[i], ref->length - shared[i], (uint8_t *)buffer + size);
+			else {
+				memcpy(buffer + size, ref->string + shared[i], ref->length - shared[i]);
+				size += ref->length - shared[i];
+			}
+		}
+
+		if (code_lut)
+			size = (bit_offset + 7) >> 3;
+	}
+
+	return size;
+}
+
+// Trains the symbol table of an FSST compressed database on the strings at the start of the hash order. They are a random
+// sample of all strings and the same for `tm_symbols_save_runs()`, which sees the strings in the same order.
+static void private__symbols_fsst_train(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, tm_fsst_table_t *table)
+{
+	tm_fsst_sample_t *sample = tm_alloc(a, sizeof(tm_fsst_sample_t));
+	sample->size = sample->count = 0;
+	for (uint32_t i = 0; i < count && sample->size < TM_FSST_SAMPLE_SIZE; ++i)
+		tm_fsst_sample_add(sample, entries[i].string, entries[i].length);
+
+	tm_fsst_train(a, sample, table);
+	tm_free(a, sample, sizeof(tm_fsst_sample_t));
+}
+
+// Trigram of the search index while it's built, keyed by the trigram plus one so that zero marks empty slots.
+typedef struct private__symbols_trigram_t
+{
+	// Bytes of postings in the first pass, where the next posting is written in the second.
+	uint64_t offset;
+	uint32_t key;
+	// Position plus one of the last string the trigram was found in.
+	uint32_t last;
+} private__symbols_trigram_t;
+
+typedef struct private__symbols_trigram_map_t
+{
+	private__symbols_trigram_t *slots;
+	uint32_t mask;
+	uint32_t count;
+} private__symbols_trigram_map_t;
+
+static inline private__symbols_trigram_t *private__symbols_trigram_probe(const private__symbols_trigram_map_t *map, uint32_t key)
+{
+	uint32_t slot = (key * 0x9E3779B1u) & map->mask;
+	while (map->slots[slot].key && map->slots[slot].key != key)
+		slot = (slot + 1) & map->mask;
+	return map->slots + slot;
+}
+
+static private__symbols_trigram_t *private__symbols_trigram_insert(tm_allocator_i *a, private__symbols_trigram_map_t *map, uint32_t key)
+{
+	private__symbols_trigram_t *trigram = private__symbols_trigram_probe(map, key);
+	if (trigram->key)
+		return trigram;
+
+	// At most half of the slots are used.
+	if ((map->count + 1) * 2 > map->mask + 1) {
+		const private__symbols_trigram_map_t old = *map;
+		map->mask = old.mask * 2 + 1;
+		map->slots = tm_alloc(a, (map->mask + 1ull) * sizeof(private__symbols_trigram_t));
+		memset(map->slots, 0, (map->mask + 1ull) * sizeof(private__symbols_trigram_t));
+		for (uint64_t i = 0; i <= old.mask; ++i) {
+			if (old.slots[i].key)
+				*private__symbols_trigram_probe(map, old.slots[i].key) = old.slots[i];
+		}
+		tm_free(a, old.slots, (old.mask + 1ull) * sizeof(private__symbols_trigram_t));
+		trigram = private__symbols_trigram_probe(map, key);
+	}
+
+	trigram->key = key;
+	++map->count;
+	return trigram;
+}
+
+static int private__symbols_trigram_compare(const void *a, const void *b)
+{
+	const uint32_t key_a = (*(const private__symbols_trigram_t *const *)a)->key, key_b = (*(const private__symbols_trigram_t *const *)b)->key;
+	return (key_a > key_b) - (key_a < key_b);
+}
+
+static inline uint32_t private__symbols_varint_size(uint64_t value)
+{
+	uint32_t size = 1;
+	for (; value >= 0x80; value >>= 7)
+		++size;
+	return size;
+}
 
-static void tm_symbols_save(tm_symbol_tree_t *tree, const char **strings, const char *path)
+// Builds the search index of the entries, see search_index.inl. Returns the section without its padding, starting with
+// its size, in a buffer of `*buffer_size` bytes allocated with `a`. Postings are sized in a first pass over the strings
+// and written in a second one.
+static char *private__symbols_search_index(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, uint64_t *buffer_size)
 {
 	TM_INIT_TEMP_ALLOCATOR(ta);
-	const uint32_t flags = TM_HDB_FLAGS_VERSION;
+	const private__symbols_string_ref_t *sorted = private__symbols_sort_strings(ta, entries, count, false);
+	private__symbols_trigram_map_t map = { .mask = 1023 };
+	map.slots = tm_alloc(a, (map.mask + 1ull) * sizeof(private__symbols_trigram_t));
+	memset(map.slots, 0, (map.mask + 1ull) * sizeof(private__symbols_trigram_t));
 
-	const uint64_t adder = (sizeof(uint32_t) << 1) + tree->node_count * sizeof(tm_symbol_node_t);
-	for (tm_symbol_node_t *node = tree->nodes; node != tree->nodes + tree->node_count; ++node)
-		node->string_start += adder;
+	for (uint32_t i = 0; i < count; ++i) {
+		for (uint32_t j = 0; j + 3 <= sorted[i].length; ++j) {
+			private__symbols_trigram_t *trigram = private__symbols_trigram_insert(a, &map, tm_symbol_search__trigram(sorted[i].string + j) + 1);
+			if (trigram->last != i + 1) {
+				trigram->offset += private__symbols_varint_size(i - (trigram->last ? trigram->last - 1 : 0));
+				trigram->last = i + 1;
+			}
+		}
+	}
 
-	const char *path_with_extension = tm_temp_allocator_api->printf(ta, "%s.hdb", path);
-	tm_file_o file = tm_os_api->file_io->open_output(path_with_extension, false);
+	private__symbols_trigram_t **trigrams = tm_temp_alloc(ta, (map.count + 1ull) * sizeof(private__symbols_trigram_t *));
+	uint32_t trigram_count = 0;
+	for (uint64_t i = 0; i <= map.mask; ++i) {
+		if (map.slots[i].key)
+			trigrams[trigram_count++] = map.slots + i;
+	}
+	qsort(trigrams, trigram_count, sizeof(private__symbols_trigram_t *), private__symbols_trigram_compare);
+
+	uint64_t postings_size = 0;
+	for (uint32_t i = 0; i < trigram_count; ++i) {
+		const uint64_t size = trigrams[i]->offset;
+		trigrams[i]->offset = postings_size;
+		trigrams[i]->last = 0;
+		postings_size += size;
+	}
 
-	tm_os_api->file_io->write(file, &flags, sizeof(uint32_t));
-	tm_os_api->file_io->write(file, &tree->node_count, sizeof(uint32_t));
-	tm_os_api->file_io->write(file, tree->nodes, tree->node_count * sizeof(tm_symbol_node_t));
+	const uint64_t section_size = tm_symbol_search_index_arrays_size(trigram_count, count) + postings_size;
+	*buffer_size = sizeof(uint64_t) + section_size;
+	char *buffer = tm_alloc(a, *buffer_size);
+	uint64_t *header = (uint64_t *)buffer;
+	header[0] = section_size;
+	header[1] = trigram_count;
+	uint64_t *posting_starts = header + 2;
+	uint32_t *trigram_keys = (uint32_t *)(posting_starts + trigram_count + 1);
+	uint32_t *sorted_entries = trigram_keys + trigram_count;
+	char *postings = (char *)(sorted_entries + count);
+	for (uint32_t i = 0; i < trigram_count; ++i) {
+		posting_starts[i] = trigrams[i]->offset;
+		trigram_keys[i] = trigrams[i]->key - 1;
+	}
+	posting_starts[trigram_count] = postings_size;
 
-	const size_t size = tm_carray_size(strings);
-	for (size_t i = 0; i < size; ++i)
-		tm_os_api->file_io->write(file, strings[i], strlen(strings[i]));
+	for (uint32_t i = 0; i < count; ++i) {
+		sorted_entries[i] = sorted[i].entry_idx;
+		for (uint32_t j = 0; j + 3 <= sorted[i].length; ++j) {
+			private__symbols_trigram_t *trigram = private__symbols_trigram_probe(&map, tm_symbol_search__trigram(sorted[i].string + j) + 1);
+			if (trigram->last != i + 1) {
+				tm_binary_handler_write_varint(postings, &trigram->offset, i - (trigram->last ? trigram->last - 1 : 0));
+				trigram->last = i + 1;
+			}
+		}
+	}
 
-	tm_os_api->file_io->close(file);
+	tm_free(a, map.slots, (map.mask + 1ull) * sizeof(private__symbols_trigram_t));
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return buffer;
+}
+
+// Writes the search index section after the first `offset` bytes of a database, padded to 8 bytes.
+static bool private__symbols_write_search_index(tm_file_o file, uint64_t offset, const char *section, uint64_t section_size)
+{
+	const uint64_t zero = 0;
+	return tm_os_api->file_io->write(file, &zero, (0 - offset) & (sizeof(uint64_t) - 1))
+		&& tm_os_api->file_io->write(file, section, section_size);
+}
+
+// Size of the search index section after the first `offset` bytes of a database, including its padding.
+static inline uint64_t private__symbols_search_index_size(uint64_t offset, uint64_t section_size)
+{
+	return section_size ? ((0 - offset) & (sizeof(uint64_t) - 1)) + section_size : 0;
+}
+
+// Outputs are written to a temporary file next to them that's renamed over them once it's complete, so processes that have
+// the old output mapped keep reading it intact and nobody ever finds a half written one.
+static inline const char *private__symbols_temp_path(tm_temp_allocator_i *ta, const char *path)
+{
+	return tm_temp_allocator_api->printf(ta, "%s.tmp", path);
+}
+
+// Moves the temporary file over the output if it was `written`, otherwise removes it. Returns true if the output was replaced.
+static bool private__symbols_replace_output(const char *temp_path, const char *path, bool written)
+{
+	// Renaming replaces the old output atomically on POSIX. Where it can't replace it, it's removed first like the cache is.
+	if (written && (tm_os_api->file_system->rename(temp_path, path)
+		|| (tm_os_api->file_system->remove_file(path) && tm_os_api->file_system->rename(temp_path, path))))
+		return true;
+
+	tm_os_api->file_system->remove_file(temp_path);
+	return false;
+}
+
+// Saves the strings as they are or, if `symbol_table` is set, compressed with it.
+static void tm_symbols_save(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, const char *path, tm_symbols_strings_t strings,
+	const tm_fsst_table_t *symbol_table, bool search_index)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const bool version_3 = strings == TM_SYMBOLS_STRINGS_FRONT_CODED || symbol_table;
+	const uint32_t flags = TM_HDB_FLAGS_FILTER | (version_3 ? TM_HDB_FLAGS_VERSION_3 : TM_HDB_FLAGS_VERSION)
+		| (strings == TM_SYMBOLS_STRINGS_FRONT_CODED ? TM_HDB_FLAGS_FRONT_CODED : 0) | (symbol_table ? TM_HDB_FLAGS_FSST : 0)
+		| (search_index ? TM_HDB_FLAGS_SEARCH_INDEX : 0);
+
+	tm_fsst_encoder_t fsst;
+	if (symbol_table)
+		tm_fsst_encoder_create(symbol_table, &fsst);
+	const uint64_t table_size = symbol_table ? tm_fsst_table_size(symbol_table) : 0;
+
+	const uint64_t block_size = count * tm_symbol_index__entry_size;
+	char *block = tm_alloc(a, block_size);
+	tm_symbol_index_t index;
+	tm_symbol_index_set_block(&index, block, count);
+	uint64_t *string_starts = (uint64_t *)index.string_starts;
+	uint32_t *string_lengths = (uint32_t *)index.string_lengths;
+
+	uint64_t character_count = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		character_count += entries[i].length;
+
+	// Escaped characters take two bytes.
+	const uint64_t buffer_size = strings == TM_SYMBOLS_STRINGS_FRONT_CODED ? private__symbols_front_coded_capacity(character_count, count)
+		: symbol_table ? character_count << 1 : character_count;
+	char *buffer = tm_alloc(a, buffer_size);
+	uint64_t buffer_offset = 0;
+	uint64_t section_size = 0;
+	char *section = search_index ? private__symbols_search_index(a, entries, count, &section_size) : 0;
+	const uint64_t header_size = (sizeof(uint32_t) << 1) + block_size + table_size;
+	const uint64_t data_start = header_size + private__symbols_search_index_size(header_size, section_size);
+	tm_symbol_filter_t filter = tm_symbol_filter_create(a, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		((uint64_t *)index.hashes)[i] = entries[i].hash;
+		tm_symbol_filter_insert(&filter, entries[i].hash);
+	}
+
+	if (strings == TM_SYMBOLS_STRINGS_FRONT_CODED)
+		buffer_offset = private__symbols_front_code(private__symbols_sort_strings(ta, entries, count, false), count, 0, symbol_table ? &fsst : 0,
+			data_start, buffer, string_starts, string_lengths);
+	else {
+		const uint32_t *owners = strings == TM_SYMBOLS_STRINGS_SUFFIXES ? private__symbols_suffix_owners(ta, entries, count) : 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (owners && owners[i] != i)
+				continue;
+
+			string_starts[i] = data_start + buffer_offset;
+			if (symbol_table)
+				string_lengths[i] = tm_fsst_encode(&fsst, (const uint8_t *)entries[i].string, entries[i].length, (uint8_t *)buffer + buffer_offset);
+			else {
+				string_lengths[i] = entries[i].length;
+				memcpy(buffer + buffer_offset, entries[i].string, entries[i].length);
+			}
+			buffer_offset += string_lengths[i];
+		}
+
+		// Merged strings are the end of the string of their owner. Compressed, that only holds if a symbol of the owner
+		// starts where they do, the others are stored on their own.
+		for (uint32_t i = 0; owners && i < count; ++i) {
+			const uint32_t owner = owners[i];
+			if (owner == i)
+				continue;
+
+			const uint64_t skipped = entries[owner].length - entries[i].length;
+			uint64_t code_offset = skipped;
+			if (!symbol_table) {
+				string_starts[i] = string_starts[owner] + skipped;
+				string_lengths[i] = entries[i].length;
+			}
+			else if (tm_fsst_code_offset(symbol_table, (const uint8_t *)buffer + string_starts[owner] - data_start, string_lengths[owner], skipped, &code_offset)) {
+				string_starts[i] = string_starts[owner] + code_offset;
+				string_lengths[i] = (uint32_t)(string_lengths[owner] - code_offset);
+			}
+			else {
+				string_starts[i] = data_start + buffer_offset;
+				string_lengths[i] = tm_fsst_encode(&fsst, (const uint8_t *)entries[i].string, entries[i].length, (uint8_t *)buffer + buffer_offset);
+				buffer_offset += string_lengths[i];
+			}
+		}
+	}
+
+	if (character_count > buffer_offset)
+		printf_loud("\ndbgutils: storing %s strings%s saved %llu bytes.\n", tm_symbols_strings_names[strings], symbol_table ? " with FSST" : "",
+			(unsigned long long)(character_count - buffer_offset));
+
+	const char *path_with_extension = tm_temp_allocator_api->printf(ta, "%s.hdb", path);
+	const char *temp_path = private__symbols_temp_path(ta, path_with_extension);
+	tm_file_o file = tm_os_api->file_io->open_output(temp_path, false);
+
+	bool written = file.valid && tm_os_api->file_io->write(file, &flags, sizeof(uint32_t))
+		&& tm_os_api->file_io->write(file, &count, sizeof(uint32_t))
+		&& tm_os_api->file_io->write(file, block, block_size);
+	if (written && symbol_table) {
+		char *table = tm_temp_alloc(ta, table_size);
+		tm_fsst_table_write(symbol_table, table);
+		written = tm_os_api->file_io->write(file, table, table_size);
+	}
+	written = written && (!section || private__symbols_write_search_index(file, header_size, section, section_size))
+		&& tm_os_api->file_io->write(file, buffer, buffer_offset)
+		&& tm_symbol_filter_write(file, data_start + buffer_offset, &filter);
+
+	tm_symbol_filter_free(a, &filter);
+	tm_free(a, section, section_size);
+	tm_free(a, buffer, buffer_size);
+	tm_free(a, block, block_size);
+	if (file.valid)
+		tm_os_api->file_io->close(file);
+	if (!private__symbols_replace_output(temp_path, path_with_extension, written))
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to write '%s'\n", path_with_extension);
 	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
 }
 
-static void tm_symbols_save_compressed(tm_allocator_i *a, tm_symbol_tree_t *tree, const char **strings, const char *path)
+static void tm_symbols_save_compressed(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, const char *path, tm_symbols_strings_t strings,
+	bool search_index)
 {
 	TM_INIT_TEMP_ALLOCATOR(ta);
-	const uint32_t flags = TM_HDB_FLAGS_VERSION | TM_HDB_FLAGS_COMPRESSED;
+	const uint32_t flags = TM_HDB_FLAGS_COMPRESSED | TM_HDB_FLAGS_CANONICAL | TM_HDB_FLAGS_FILTER
+		| (strings == TM_SYMBOLS_STRINGS_FRONT_CODED ? TM_HDB_FLAGS_VERSION_3 | TM_HDB_FLAGS_FRONT_CODED : TM_HDB_FLAGS_VERSION)
+		| (search_index ? TM_HDB_FLAGS_SEARCH_INDEX : 0);
 
+	const private__symbols_string_ref_t *sorted = strings == TM_SYMBOLS_STRINGS_FRONT_CODED ? private__symbols_sort_strings(ta, entries, count, false) : 0;
+	const uint32_t *owners = strings == TM_SYMBOLS_STRINGS_SUFFIXES ? private__symbols_suffix_owners(ta, entries, count) : 0;
+
+	// Counted with unsigned characters in order to handle unicode strings. Only the characters that are stored are counted.
+	uint32_t frequencies[256] = { 0 };
 	size_t buffer_capacity = 0;
-	const size_t string_count = tm_carray_size(strings);
-	for (size_t i = 0; i < string_count; ++i)
-		buffer_capacity += strlen(strings[i]);
+	for (uint32_t i = 0; i < count; ++i) {
+		buffer_capacity += entries[i].length;
+		if (owners && owners[i] != i)
+			continue;
+
+		const uint8_t *uni_str = (const uint8_t *)(sorted ? sorted[i].string : entries[i].string);
+		const uint32_t length = sorted ? sorted[i].length : entries[i].length;
+		for (uint32_t j = sorted ? private__symbols_front_coded_suffix(sorted, i) : 0; j < length; ++j)
+			++frequencies[uni_str[j]];
+	}
+
+	uint8_t code_lengths[256];
+	tm_huffman_code_lengths(frequencies, code_lengths);
+	tm_huffman_tree_t encoding = tm_huffman_tree_create_from_code_lengths(a, code_lengths);
+
+	const uint64_t block_size = count * tm_symbol_index__entry_size;
+	char *block = tm_alloc(a, block_size);
+	tm_symbol_index_t index;
+	tm_symbol_index_set_block(&index, block, count);
+	uint64_t *string_starts = (uint64_t *)index.string_starts;
+	uint32_t *string_lengths = (uint32_t *)index.string_lengths;
+
+	uint64_t section_size = 0;
+	char *section = search_index ? private__symbols_search_index(a, entries, count, &section_size) : 0;
+	const uint64_t header_size = (sizeof(uint32_t) << 1) + block_size + sizeof(code_lengths);
+	const uint64_t data_start = header_size + private__symbols_search_index_size(header_size, section_size);
+	const size_t string_buffer_start = data_start << 3;
+	// Codes are at most 12 bits, so every character fits in two bytes, plus the slack for appending whole words.
+	const size_t buffer_size = sorted ? private__symbols_front_coded_capacity(buffer_capacity, count) : (buffer_capacity << 1) + sizeof(uint64_t);
+	char *buffer = tm_alloc(a, buffer_size);
+	memset(buffer, 0, buffer_size);
+
+	uint64_t buffer_offset_bits = 0;
+	tm_symbol_filter_t filter = tm_symbol_filter_create(a, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		((uint64_t *)index.hashes)[i] = entries[i].hash;
+		tm_symbol_filter_insert(&filter, entries[i].hash);
+	}
+
+	if (sorted)
+		buffer_offset_bits = private__symbols_front_code(sorted, count, encoding.code_lut, 0, data_start, buffer, string_starts, string_lengths) << 3;
+	else {
+		for (uint32_t i = 0; i < count; ++i) {
+			if (owners && owners[i] != i)
+				continue;
 
-	tm_huffman_tree_t encoding = tm_huffman_tree_create(a, strings);
-	const size_t string_buffer_start = (sizeof(uint32_t) * 3 + tree->node_count * sizeof(tm_symbol_node_t) + encoding.node_count * sizeof(tm_huffman_node_t)) << 3;
-	char *buffer = tm_alloc(a, buffer_capacity << 1);
-	memset(buffer, 0, buffer_capacity << 1);
+			string_starts[i] = string_buffer_start + buffer_offset_bits;
 
-	size_t buffer_offset_bits = 0;
-	for (size_t i = 0, j = 0; i < string_count; ++i, j = 0) {
-		const uint32_t node_idx = tm_symbol_tree_search(tree, tm_murmur_hash_string_inline(strings[i]));
-		tree->nodes[node_idx].string_start = string_buffer_start + buffer_offset_bits;
+			// The entries are in hash order, so their strings are scattered over the arenas.
+			if (i + 8 < count)
+				_mm_prefetch(entries[i + 8].string, _MM_HINT_T0);
 
-		const uint8_t *uni_str = (const uint8_t *)strings[i];
-		for (uint8_t c = *uni_str; c != '\0'; c = uni_str[++j]) {
-			const uint32_t bit_count = tm_huffman_code__bit_count(encoding.code_lut[c]);
-			const uint32_t code_word = tm_huffman_code__code_word(encoding.code_lut[c]);
-			tm_binary_handler_write_bits(buffer, &buffer_offset_bits, code_word, bit_count);
+			const uint64_t string_start_bits = buffer_offset_bits;
+			private__symbols_encode(encoding.code_lut, (const uint8_t *)entries[i].string, entries[i].length, buffer, &buffer_offset_bits);
+
+			string_lengths[i] = (uint32_t)(buffer_offset_bits - string_start_bits);
 		}
 
-		tree->nodes[node_idx].string_length = (uint32_t)(buffer_offset_bits - (tree->nodes[node_idx].string_start - string_buffer_start));
+		// Merged strings start after the codes of the characters of their owner that precede them.
+		for (uint32_t i = 0; owners && i < count; ++i) {
+			const uint32_t owner = owners[i];
+			if (owner != i) {
+				const uint64_t prefix_bits = private__symbols_encoded_bits(encoding.code_lut, (const uint8_t *)entries[owner].string, entries[owner].length - entries[i].length);
+				string_starts[i] = string_starts[owner] + prefix_bits;
+				string_lengths[i] = (uint32_t)(string_lengths[owner] - prefix_bits);
+			}
+		}
 	}
 
 	if (buffer_capacity > buffer_offset_bits >> 3)
-		printf_loud("\ndbgutils: compression saved %zu bytes.\n", buffer_capacity - (buffer_offset_bits >> 3));
+		printf_loud("\ndbgutils: compression saved %zu bytes.\n", buffer_capacity - (size_t)(buffer_offset_bits >> 3));
 
 	const char *path_with_extension = tm_temp_allocator_api->printf(ta, "%s.hdb", path);
-	tm_file_o file = tm_os_api->file_io->open_output(path_with_extension, false);
+	const char *temp_path = private__symbols_temp_path(ta, path_with_extension);
+	tm_file_o file = tm_os_api->file_io->open_output(temp_path, false);
 
-	tm_os_api->file_io->write(file, &flags, sizeof(uint32_t));
-	tm_os_api->file_io->write(file, &tree->node_count, sizeof(uint32_t));
-	tm_os_api->file_io->write(file, tree->nodes, tree->node_count * sizeof(tm_symbol_node_t));
-	tm_os_api->file_io->write(file, &encoding.node_count, sizeof(uint32_t));
-	tm_os_api->file_io->write(file, encoding.nodes, encoding.node_count * sizeof(tm_huffman_node_t));
-
-	tm_os_api->file_io->write(file, buffer, buffer_offset_bits >> 3);
+	const bool written = file.valid && tm_os_api->file_io->write(file, &flags, sizeof(uint32_t))
+		&& tm_os_api->file_io->write(file, &count, sizeof(uint32_t))
+		&& tm_os_api->file_io->write(file, block, block_size)
+		&& tm_os_api->file_io->write(file, code_lengths, sizeof(code_lengths))
+		&& (!section || private__symbols_write_search_index(file, header_size, section, section_size))
+		&& tm_os_api->file_io->write(file, buffer, (buffer_offset_bits + 7) >> 3)
+		&& tm_symbol_filter_write(file, data_start + ((buffer_offset_bits + 7) >> 3), &filter);
+	tm_symbol_filter_free(a, &filter);
 	tm_huffman_tree_free(a, &encoding);
-	tm_free(a, buffer, buffer_capacity << 1);
+	tm_free(a, section, section_size);
+	tm_free(a, block, block_size);
+	tm_free(a, buffer, buffer_size);
+
+	if (file.valid)
+		tm_os_api->file_io->close(file);
+	if (!private__symbols_replace_output(temp_path, path_with_extension, written))
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to write '%s'\n", path_with_extension);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Buffered output to a fixed region of a file, the generator's temporary and output files can be much larger than the memory limit.
+typedef struct tm_symbols_file_writer_t
+{
+	tm_file_o file;
+	// File offset `buffer` is written to.
+	uint64_t offset;
+	char *buffer;
+	uint64_t used;
+	uint64_t capacity;
+	bool failed;
+	TM_PAD(7);
+} tm_symbols_file_writer_t;
+
+static void tm_symbols_file_writer_flush(tm_symbols_file_writer_t *writer)
+{
+	if (writer->used && !writer->failed)
+		writer->failed = !tm_os_api->file_io->write_at(writer->file, writer->offset, writer->buffer, writer->used);
+
+	writer->offset += writer->used;
+	writer->used = 0;
+}
+
+static void tm_symbols_file_writer_write(tm_symbols_file_writer_t *writer, const void *data, uint64_t size)
+{
+	if (!size)
+		return;
+	if (writer->used + size > writer->capacity)
+		tm_symbols_file_writer_flush(writer);
+
+	if (size > writer->capacity) {
+		if (!writer->failed)
+			writer->failed = !tm_os_api->file_io->write_at(writer->file, writer->offset, data, size);
+		writer->offset += size;
+		return;
+	}
+
+	memcpy(writer->buffer + writer->used, data, size);
+	writer->used += size;
+}
+
+// Runs are temporary files of (uint64_t hash, uint32_t length, char string[length]) records sorted by hash,
+// without duplicate hashes. They let the generator handle more strings than fit in the memory limit.
+#define TM_SYMBOLS_RUN_BUFFER_SIZE (256 * 1024)
+
+static const char *tm_symbols_run_path(tm_temp_allocator_i *ta, const char *output_path, uint32_t thread_idx, uint32_t run_idx)
+{
+	return tm_temp_allocator_api->printf(ta, "%s.hdb.%u.%u.run", output_path, thread_idx, run_idx);
+}
+
+// Writes the entries of the set to a run and empties the set, returns false if the run couldn't be written.
+static bool tm_symbols_set_spill(tm_allocator_i *a, tm_symbols_set_t *set, const char *run_path)
+{
+	tm_file_o file = tm_os_api->file_io->open_output(run_path, false);
+	if (!file.valid)
+		return false;
+
+	const uint64_t count = tm_carray_size(set->entries);
+	tm_symbols_entry_t *scratch = 0;
+	tm_carray_resize(scratch, count, a);
+	const tm_symbols_entry_t *sorted = private__symbols_sort_entries(set->entries, scratch, count);
 
+	tm_symbols_file_writer_t writer = { .file = file, .buffer = tm_alloc(a, TM_SYMBOLS_RUN_BUFFER_SIZE), .capacity = TM_SYMBOLS_RUN_BUFFER_SIZE };
+	for (uint64_t i = 0; i < count; ++i) {
+		tm_symbols_file_writer_write(&writer, &sorted[i].hash, sizeof(uint64_t));
+		tm_symbols_file_writer_write(&writer, &sorted[i].length, sizeof(uint32_t));
+		tm_symbols_file_writer_write(&writer, sorted[i].string, sorted[i].length);
+	}
+	tm_symbols_file_writer_flush(&writer);
 	tm_os_api->file_io->close(file);
+
+	tm_free(a, writer.buffer, TM_SYMBOLS_RUN_BUFFER_SIZE);
+	tm_carray_free(scratch, a);
+	tm_symbols_set_free(a, set);
+	return !writer.failed;
+}
+
+typedef struct tm_symbols_run_reader_t
+{
+	tm_file_o file;
+	char *buffer;
+	uint64_t buffer_capacity;
+	uint64_t buffer_size;
+	uint64_t buffer_offset;
+
+	// The current record, `string` is a null terminated carray that's reused for every record.
+	uint64_t hash;
+	char *string;
+
+	// Set if the reader decodes the entries of a database instead of reading a run, see `tm_symbols_merge_databases()`.
+	const tm_symbol_database_t *db;
+	// Entries of `db` in hash order, null if its index is sorted already.
+	uint32_t *order;
+	uint32_t next_entry;
+	uint32_t length;
+	bool done;
+	TM_PAD(7);
+} tm_symbols_run_reader_t;
+
+static bool private__symbols_run_read(tm_symbols_run_reader_t *reader, void *data, uint64_t size)
+{
+	char *dst = data;
+	while (size) {
+		if (reader->buffer_offset == reader->buffer_size) {
+			const int64_t bytes_read = tm_os_api->file_io->read(reader->file, reader->buffer, reader->buffer_capacity);
+			if (bytes_read <= 0)
+				return false;
+
+			reader->buffer_size = (uint64_t)bytes_read;
+			reader->buffer_offset = 0;
+		}
+
+		const uint64_t n = tm_min(size, reader->buffer_size - reader->buffer_offset);
+		memcpy(dst, reader->buffer + reader->buffer_offset, n);
+		reader->buffer_offset += n;
+		dst += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+// Decodes the next entry of the database of the reader into its string.
+static void private__symbols_run_reader_decode(tm_allocator_i *a, tm_symbols_run_reader_t *reader)
+{
+	if (reader->next_entry == reader->db->index.entry_count) {
+		reader->done = true;
+		return;
+	}
+
+	const uint32_t entry_idx = reader->order ? reader->order[reader->next_entry] : reader->next_entry;
+	++reader->next_entry;
+	reader->hash = reader->db->index.hashes[entry_idx];
+	uint32_t length = tm_symbol_database_decode(reader->db, entry_idx, reader->string, (uint32_t)tm_carray_size(reader->string));
+	if (length >= tm_carray_size(reader->string)) {
+		tm_carray_resize(reader->string, length + 1ull, a);
+		length = tm_symbol_database_decode(reader->db, entry_idx, reader->string, length);
+	}
+	reader->string[length] = '\0';
+	reader->length = length;
+}
+
+// Moves to the next record, sets `done` at the end of the run.
+static void tm_symbols_run_reader_next(tm_allocator_i *a, tm_symbols_run_reader_t *reader)
+{
+	if (reader->db) {
+		private__symbols_run_reader_decode(a, reader);
+		return;
+	}
+
+	uint32_t length;
+	if (!private__symbols_run_read(reader, &reader->hash, sizeof(uint64_t)) || !private__symbols_run_read(reader, &length, sizeof(uint32_t))) {
+		reader->done = true;
+		return;
+	}
+
+	tm_carray_resize(reader->string, length + 1ull, a);
+	reader->done = !private__symbols_run_read(reader, reader->string, length);
+	reader->string[length] = '\0';
+	reader->length = length;
+}
+
+// Merges runs into a single stream sorted by hash. Like `tm_symbols_merge()` it keeps the lexicographically
+// first string of colliding hashes, so both produce the same entries.
+typedef struct tm_symbols_run_merge_t
+{
+	tm_symbols_run_reader_t *readers;
+	// Binary min heap of indices of the readers that aren't done.
+	uint32_t *heap;
+	uint32_t heap_size;
+	uint32_t reader_count;
+	uint64_t buffer_size;
+	// The reader of the entry returned last, it's advanced on the next call to `tm_symbols_run_merge_next()`.
+	uint32_t last_reader;
+	bool has_last;
+	TM_PAD(3);
+	uint64_t last_hash;
+} tm_symbols_run_merge_t;
+
+static inline bool private__symbols_run_less(const tm_symbols_run_reader_t *a, const tm_symbols_run_reader_t *b)
+{
+	if (a->hash != b->hash)
+		return a->hash < b->hash;
+
+	return strcmp(a->string, b->string) < 0;
+}
+
+static void private__symbols_run_sift_down(tm_symbols_run_merge_t *merge, uint32_t i)
+{
+	for (;;) {
+		const uint32_t left = (i << 1) + 1, right = left + 1;
+		uint32_t smallest = i;
+		if (left < merge->heap_size && private__symbols_run_less(merge->readers + merge->heap[left], merge->readers + merge->heap[smallest]))
+			smallest = left;
+		if (right < merge->heap_size && private__symbols_run_less(merge->readers + merge->heap[right], merge->readers + merge->heap[smallest]))
+			smallest = right;
+		if (smallest == i)
+			return;
+
+		const uint32_t tmp = merge->heap[i];
+		merge->heap[i] = merge->heap[smallest];
+		merge->heap[smallest] = tmp;
+		i = smallest;
+	}
+}
+
+// Advances the reader at the top of the heap and restores the heap.
+static void private__symbols_run_advance_top(tm_allocator_i *a, tm_symbols_run_merge_t *merge)
+{
+	tm_symbols_run_reader_t *reader = merge->readers + merge->heap[0];
+	tm_symbols_run_reader_next(a, reader);
+	if (reader->done)
+		merge->heap[0] = merge->heap[--merge->heap_size];
+
+	private__symbols_run_sift_down(merge, 0);
+}
+
+typedef struct private__symbols_hash_order_t
+{
+	uint64_t hash;
+	uint32_t entry_idx;
+	TM_PAD(4);
+} private__symbols_hash_order_t;
+
+static int private__symbols_hash_order_compare(const void *a, const void *b)
+{
+	const private__symbols_hash_order_t *order_a = a, *order_b = b;
+	if (order_a->hash != order_b->hash)
+		return order_a->hash < order_b->hash ? -1 : 1;
+	return (order_a->entry_idx > order_b->entry_idx) - (order_a->entry_idx < order_b->entry_idx);
+}
+
+// Returns the entries of the database in hash order, or null if its index is sorted already, like the ones of generated databases.
+static uint32_t *private__symbols_database_order(tm_allocator_i *a, const tm_symbol_database_t *db)
+{
+	const uint32_t count = db->index.entry_count;
+	uint32_t sorted = 1;
+	while (sorted < count && db->index.hashes[sorted - 1] <= db->index.hashes[sorted])
+		++sorted;
+	if (sorted >= count)
+		return 0;
+
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	private__symbols_hash_order_t *entries = tm_temp_alloc(ta, count * sizeof(private__symbols_hash_order_t));
+	for (uint32_t i = 0; i < count; ++i)
+		entries[i] = (private__symbols_hash_order_t) { .hash = db->index.hashes[i], .entry_idx = i };
+	qsort(entries, count, sizeof(private__symbols_hash_order_t), private__symbols_hash_order_compare);
+
+	uint32_t *order = tm_alloc(a, count * sizeof(uint32_t));
+	for (uint32_t i = 0; i < count; ++i)
+		order[i] = entries[i].entry_idx;
 	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return order;
+}
+
+// Opens the runs at `run_paths` or, if it's null, the databases for merging. Returns false if any run can't be opened.
+// Each run gets a read buffer of `buffer_size` bytes, databases are read from their mapping.
+static bool tm_symbols_run_merge_open(tm_allocator_i *a, tm_symbols_run_merge_t *merge, const char **run_paths, const tm_symbol_database_t *databases,
+	uint32_t run_count, uint64_t buffer_size)
+{
+	*merge = (tm_symbols_run_merge_t) { .reader_count = run_count, .buffer_size = buffer_size };
+	merge->readers = tm_alloc(a, run_count * sizeof(tm_symbols_run_reader_t));
+	merge->heap = tm_alloc(a, run_count * sizeof(uint32_t));
+	if (run_count)
+		memset(merge->readers, 0, run_count * sizeof(tm_symbols_run_reader_t));
+
+	bool opened = true;
+	for (uint32_t i = 0; i < run_count; ++i) {
+		tm_symbols_run_reader_t *reader = merge->readers + i;
+		if (!run_paths) {
+			reader->db = databases + i;
+			reader->order = private__symbols_database_order(a, reader->db);
+			tm_symbols_run_reader_next(a, reader);
+			if (!reader->done)
+				merge->heap[merge->heap_size++] = i;
+			continue;
+		}
+
+		reader->file = tm_os_api->file_io->open_input(run_paths[i]);
+		if (!reader->file.valid) {
+			opened = false;
+			continue;
+		}
+
+		reader->buffer = tm_alloc(a, buffer_size);
+		reader->buffer_capacity = buffer_size;
+		tm_symbols_run_reader_next(a, reader);
+		if (!reader->done)
+			merge->heap[merge->heap_size++] = i;
+	}
+
+	for (uint32_t i = merge->heap_size >> 1; i--;)
+		private__symbols_run_sift_down(merge, i);
+
+	return opened;
 }
 
-static void tm_symbols_add_entry(tm_allocator_i *a, tm_symbol_tree_t *tree, const char ***string_buffer, uint64_t *offset, const char *string)
+// Returns the next entry, its string stays valid until the next call. Returns false once all runs are merged.
+static bool tm_symbols_run_merge_next(tm_allocator_i *a, tm_symbols_run_merge_t *merge, tm_symbols_entry_t *entry)
 {
-	const uint64_t hash = tm_murmur_hash_string_inline(string);
-	if (!tm_symbol_tree_contains(tree, hash)) {
-		const uint32_t string_length = (uint32_t)strlen(string);
-		tm_symbol_tree_insert(a, tree, hash, *offset, string_length);
+	if (merge->has_last) {
+		private__symbols_run_advance_top(a, merge);
+		while (merge->heap_size && merge->readers[merge->heap[0]].hash == merge->last_hash)
+			private__symbols_run_advance_top(a, merge);
+	}
 
-		char *string_copy = tm_alloc(a, string_length + 1);
-		strcpy(string_copy, string);
-		tm_carray_push(*string_buffer, string_copy, a);
+	if (!merge->heap_size)
+		return false;
 
-		printf_loud("%s\n", string);
-		*offset += string_length;
+	const tm_symbols_run_reader_t *reader = merge->readers + merge->heap[0];
+	*entry = (tm_symbols_entry_t) { .hash = reader->hash, .string = reader->string, .length = reader->length };
+	merge->has_last = true;
+	merge->last_hash = reader->hash;
+	return true;
+}
+
+static void tm_symbols_run_merge_close(tm_allocator_i *a, tm_symbols_run_merge_t *merge)
+{
+	for (uint32_t i = 0; i < merge->reader_count; ++i) {
+		tm_symbols_run_reader_t *reader = merge->readers + i;
+		if (reader->file.valid)
+			tm_os_api->file_io->close(reader->file);
+		if (reader->buffer)
+			tm_free(a, reader->buffer, reader->buffer_capacity);
+		if (reader->order)
+			tm_free(a, reader->order, reader->db->index.entry_count * sizeof(uint32_t));
+		tm_carray_free(reader->string, a);
 	}
+
+	tm_free(a, merge->readers, merge->reader_count * sizeof(tm_symbols_run_reader_t));
+	tm_free(a, merge->heap, merge->reader_count * sizeof(uint32_t));
+	*merge = (tm_symbols_run_merge_t) { 0 };
 }
 
-static void tm_symbols_search_file(tm_allocator_i *a, tm_symbol_tree_t *tree, const char ***string_buffer, uint64_t *offset, const char *path)
+// Number of index entries buffered before they are written to the database.
+#define TM_SYMBOLS_INDEX_BUFFER_ENTRIES (16 * 1024)
+
+// Merges the runs, or the databases if `run_paths` is null, into the database at `path`.hdb, producing the same file as
+// `tm_symbols_save()` or `tm_symbols_save_compressed()` with plain strings, the other ways of storing the strings need all
+// of them in memory. The runs are merged twice, once to count the entries and characters and once to write them, so memory
+// use doesn't depend on the number of entries. Returns false if a run couldn't be read or the database couldn't be written.
+static bool tm_symbols_save_runs(tm_allocator_i *a, const char **run_paths, const tm_symbol_database_t *databases, uint32_t run_count, const char *path,
+	tm_symbols_compression_t compression, uint64_t memory_limit)
 {
-	tm_file_o file = tm_os_api->file_io->open_input(path);
-	tm_symbols_add_entry(a, tree, string_buffer, offset, tm_path_api->split(path, NULL));
-	printf_loud("----------------------------%s----------------------------\n", path);
+	const bool compress = compression == TM_SYMBOLS_COMPRESSION_HUFFMAN;
+	const bool fsst = compression == TM_SYMBOLS_COMPRESSION_FSST;
+	TM_INIT_TEMP_ALLOCATOR(ta);
 
-	uint64_t memory[TM_FILE_SEARCH_BLOCK_SIZE / sizeof(uint64_t)];
-	char *buffer = (char *)memory;
+	// Half of the memory limit goes to the read buffers of the runs.
+	const uint64_t read_buffer_size = tm_max(4096, tm_min(TM_SYMBOLS_RUN_BUFFER_SIZE, (memory_limit >> 1) / tm_max(1, run_count)));
+	tm_symbols_run_merge_t merge;
+	tm_symbols_entry_t entry;
 
-	bool string_has_started = false;
-	int in_comment = false;
-	int64_t bytes_read;
-	size_t bytes_carried = 0;
-	while ((bytes_read = tm_os_api->file_io->read(file, buffer + bytes_carried, TM_FILE_SEARCH_BLOCK_SIZE - bytes_carried)) > 0) {
-		const size_t chunk_length = bytes_carried + bytes_read;
-		size_t string_start = 0;
+	uint32_t count = 0;
+	uint32_t frequencies[256] = { 0 };
+	uint64_t character_count = 0;
+	// Sampled the way `private__symbols_fsst_train()` samples the entries.
+	tm_fsst_sample_t *sample = fsst ? tm_alloc(a, sizeof(tm_fsst_sample_t)) : 0;
+	if (sample)
+		sample->size = sample->count = 0;
+	bool succeeded = tm_symbols_run_merge_open(a, &merge, run_paths, databases, run_count, read_buffer_size);
+	while (tm_symbols_run_merge_next(a, &merge, &entry)) {
+		++count;
+		character_count += entry.length;
+		if (compress) {
+			for (uint32_t i = 0; i < entry.length; ++i)
+				++frequencies[(uint8_t)entry.string[i]];
+		}
+		if (sample && sample->size < TM_FSST_SAMPLE_SIZE)
+			tm_fsst_sample_add(sample, entry.string, entry.length);
+	}
+	tm_symbols_run_merge_close(a, &merge);
 
-		for (size_t i = 0; i < chunk_length; ++i) {
-			// Skip anything in a comment.
-			if (in_comment) {
-				if ((in_comment == 1 && buffer[i] == '\n') || (in_comment == 2 && buffer[i] == '*' && buffer[i + 1] == '/'))
-					in_comment = false;
+	const uint32_t flags = TM_HDB_FLAGS_FILTER | (compress ? TM_HDB_FLAGS_VERSION | TM_HDB_FLAGS_COMPRESSED | TM_HDB_FLAGS_CANONICAL
+		: fsst ? TM_HDB_FLAGS_VERSION_3 | TM_HDB_FLAGS_FSST : TM_HDB_FLAGS_VERSION);
+	uint8_t code_lengths[256];
+	tm_huffman_tree_t encoding = { 0 };
+	if (compress) {
+		tm_huffman_code_lengths(frequencies, code_lengths);
+		encoding = tm_huffman_tree_create_from_code_lengths(a, code_lengths);
+	}
 
-				continue;
-			} else if (!string_has_started && buffer[i] == '/' && (buffer[i + 1] == '/' || buffer[i + 1] == '*')) {
-				in_comment = 1 + (buffer[i + 1] == '*');
+	tm_fsst_table_t symbol_table;
+	tm_fsst_encoder_t fsst_encoder;
+	char *table = 0;
+	uint64_t table_size = 0;
+	if (sample) {
+		tm_fsst_train(a, sample, &symbol_table);
+		tm_free(a, sample, sizeof(tm_fsst_sample_t));
+		tm_fsst_encoder_create(&symbol_table, &fsst_encoder);
+		table_size = tm_fsst_table_size(&symbol_table);
+		table = tm_temp_alloc(ta, table_size);
+		tm_fsst_table_write(&symbol_table, table);
+	}
+
+	const char *path_with_extension = tm_temp_allocator_api->printf(ta, "%s.hdb", path);
+	const char *temp_path = private__symbols_temp_path(ta, path_with_extension);
+	tm_file_o file = succeeded ? tm_os_api->file_io->open_output(temp_path, false) : (tm_file_o) { 0 };
+	succeeded = file.valid;
+
+	if (succeeded) {
+		const uint64_t header_size = sizeof(uint32_t) << 1;
+		const uint64_t block_size = count * tm_symbol_index__entry_size;
+		const uint64_t strings_offset = header_size + block_size + (compress ? sizeof(code_lengths) : table_size);
+		succeeded = tm_os_api->file_io->write_at(file, 0, &flags, sizeof(uint32_t))
+			&& tm_os_api->file_io->write_at(file, sizeof(uint32_t), &count, sizeof(uint32_t))
+			&& (!compress || tm_os_api->file_io->write_at(file, header_size + block_size, code_lengths, sizeof(code_lengths)))
+			&& (!table || tm_os_api->file_io->write_at(file, header_size + block_size, table, table_size));
+
+		// The three index arrays and the strings are written to their own regions of the file.
+		tm_symbols_file_writer_t hashes = { .file = file, .offset = header_size, .capacity = TM_SYMBOLS_INDEX_BUFFER_ENTRIES * sizeof(uint64_t) };
+		tm_symbols_file_writer_t starts = { .file = file, .offset = header_size + count * sizeof(uint64_t), .capacity = TM_SYMBOLS_INDEX_BUFFER_ENTRIES * sizeof(uint64_t) };
+		tm_symbols_file_writer_t lengths = { .file = file, .offset = header_size + count * sizeof(uint64_t) * 2, .capacity = TM_SYMBOLS_INDEX_BUFFER_ENTRIES * sizeof(uint32_t) };
+		tm_symbols_file_writer_t strings = { .file = file, .offset = strings_offset, .capacity = TM_SYMBOLS_RUN_BUFFER_SIZE };
+		tm_symbols_file_writer_t *writers[] = { &hashes, &starts, &lengths, &strings };
+		for (uint32_t i = 0; i < TM_ARRAY_COUNT(writers); ++i)
+			writers[i]->buffer = tm_alloc(a, writers[i]->capacity);
+
+		// Compressed strings are encoded into `bits` and flushed to `strings` a whole byte at a time.
+		const uint64_t bits_capacity = TM_SYMBOLS_RUN_BUFFER_SIZE;
+		char *bits = compress ? tm_alloc(a, bits_capacity + sizeof(uint64_t)) : 0;
+		if (bits)
+			memset(bits, 0, bits_capacity + sizeof(uint64_t));
+		uint64_t bit_offset = 0, flushed_bits = 0;
+
+		// FSST compressed strings are encoded whole into `codes`, which grows to two bytes per character of the longest string.
+		uint8_t *codes = 0;
+		uint64_t codes_capacity = 0;
+
+		// The filter takes two bytes per entry, it's the only part of the database that's kept in memory.
+		tm_symbol_filter_t filter = tm_symbol_filter_create(a, count);
+
+		succeeded &= tm_symbols_run_merge_open(a, &merge, run_paths, databases, run_count, read_buffer_size);
+		while (tm_symbols_run_merge_next(a, &merge, &entry)) {
+			tm_symbols_file_writer_write(&hashes, &entry.hash, sizeof(uint64_t));
+			tm_symbol_filter_insert(&filter, entry.hash);
+
+			if (fsst) {
+				if (codes_capacity < (uint64_t)entry.length << 1) {
+					codes = tm_realloc(a, codes, codes_capacity, (uint64_t)entry.length << 1);
+					codes_capacity = (uint64_t)entry.length << 1;
+				}
+
+				const uint64_t start = strings.offset + strings.used;
+				const uint32_t size = tm_fsst_encode(&fsst_encoder, (const uint8_t *)entry.string, entry.length, codes);
+				tm_symbols_file_writer_write(&starts, &start, sizeof(uint64_t));
+				tm_symbols_file_writer_write(&lengths, &size, sizeof(uint32_t));
+				tm_symbols_file_writer_write(&strings, codes, size);
 				continue;
 			}
 
-			if (buffer[i] != '"')
+			if (!compress) {
+				const uint64_t start = strings.offset + strings.used;
+				tm_symbols_file_writer_write(&starts, &start, sizeof(uint64_t));
+				tm_symbols_file_writer_write(&lengths, &entry.length, sizeof(uint32_t));
+				tm_symbols_file_writer_write(&strings, entry.string, entry.length);
 				continue;
+			}
 
-			// Skip any " characters that are in a literal char ('"') or are used within a literal string (\").
-			if (buffer[i] == '"' && ((buffer[i - 1] == '\\' && buffer[i - 2] != '\\') || (buffer[i - 1] == '\'' && buffer[i + 1] == '\'')))
-				continue;
+			const uint64_t start_bits = (strings_offset << 3) + flushed_bits + bit_offset;
+			tm_symbols_file_writer_write(&starts, &start_bits, sizeof(uint64_t));
+
+			// Long strings are encoded in chunks that fit in the bit buffer, at two bytes per character.
+			for (uint32_t i = 0; i < entry.length;) {
+				const uint32_t chunk = (uint32_t)tm_min(entry.length - i, bits_capacity >> 2);
+				if ((bit_offset >> 3) + (chunk << 1) > bits_capacity) {
+					const uint64_t whole_bytes = bit_offset >> 3;
+					tm_symbols_file_writer_write(&strings, bits, whole_bytes);
+					bits[0] = bits[whole_bytes];
+					memset(bits + 1, 0, whole_bytes);
+					flushed_bits += whole_bytes << 3;
+					bit_offset &= 7;
+				}
 
-			if (string_has_started) {
-				buffer[i] = '\0';
-				string_has_started = false;
-				tm_symbols_add_entry(a, tree, string_buffer, offset, buffer + string_start);
-			} else {
-				string_has_started = true;
-				string_start = i + 1;
+				private__symbols_encode(encoding.code_lut, (const uint8_t *)entry.string + i, chunk, bits, &bit_offset);
+				i += chunk;
 			}
+
+			const uint32_t length_bits = (uint32_t)(((strings_offset << 3) + flushed_bits + bit_offset) - start_bits);
+			tm_symbols_file_writer_write(&lengths, &length_bits, sizeof(uint32_t));
+		}
+		tm_symbols_run_merge_close(a, &merge);
+
+		if (compress) {
+			tm_symbols_file_writer_write(&strings, bits, (bit_offset + 7) >> 3);
+			if (character_count > (flushed_bits + bit_offset) >> 3)
+				printf_loud("\ndbgutils: compression saved %llu bytes.\n", (unsigned long long)(character_count - ((flushed_bits + bit_offset) >> 3)));
+			tm_free(a, bits, bits_capacity + sizeof(uint64_t));
 		}
 
-		if (string_has_started) {
-			bytes_carried = tm_max(1, chunk_length - string_start);
-			memcpy(buffer, buffer + string_start, bytes_carried);
+		if (fsst) {
+			const uint64_t strings_size = strings.offset + strings.used - strings_offset;
+			if (character_count > strings_size)
+				printf_loud("\ndbgutils: storing plain strings with FSST saved %llu bytes.\n", (unsigned long long)(character_count - strings_size));
+			tm_free(a, codes, codes_capacity);
 		}
+
+		for (uint32_t i = 0; i < TM_ARRAY_COUNT(writers); ++i) {
+			tm_symbols_file_writer_flush(writers[i]);
+			succeeded &= !writers[i]->failed;
+			tm_free(a, writers[i]->buffer, writers[i]->capacity);
+		}
+
+		succeeded &= tm_symbol_filter_write(file, strings.offset, &filter);
+		tm_symbol_filter_free(a, &filter);
+
+		tm_os_api->file_io->close(file);
+		succeeded = private__symbols_replace_output(temp_path, path_with_extension, succeeded);
 	}
 
-	tm_os_api->file_io->close(file);
+	if (compress)
+		tm_huffman_tree_free(a, &encoding);
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return succeeded;
+}
+
+// Adds the literals of a cached file to the set, returns false if they are corrupt.
+static bool tm_symbols_set_add_cached(tm_allocator_i *a, tm_symbols_set_t *set, const tm_symbols_cache_file_t *file)
+{
+	uint64_t offset = 0;
+	for (uint32_t i = 0; i < file->literal_count; ++i) {
+		uint32_t length;
+		if (offset + sizeof(uint32_t) > file->literals_size)
+			return false;
+		memcpy(&length, file->literals + offset, sizeof(uint32_t));
+		offset += sizeof(uint32_t);
+
+		if (offset + length > file->literals_size)
+			return false;
+		tm_symbols_set_add(a, set, file->literals + offset, length);
+		offset += length;
+	}
+
+	return true;
+}
+
+// Searches a file for literals, if the file is in the cache unchanged the cached literals are used instead.
+// The literals are recorded in `cache_files` unless it's null.
+static void tm_symbols_search_file(tm_allocator_i *a, tm_symbols_set_t *set, tm_symbols_scanner_t *scanner, const tm_symbols_cache_t *cache,
+	tm_symbols_cache_file_t **cache_files, const char *path, const tm_file_stat_t *stat)
+{
+	const char *file_name = tm_path_api->split(path, NULL);
+	tm_symbols_set_add(a, set, file_name, (uint32_t)strlen(file_name));
+	printf_loud("----------------------------%s----------------------------\n", path);
+
+	// A file with the same size and modification time is assumed to be unchanged without reading it.
+	const tm_symbols_cache_file_t *cached = tm_symbols_cache_find(cache, path);
+	if (cached && cached->size == stat->size && cached->modified_time == stat->last_modified_time.opaque && tm_symbols_set_add_cached(a, set, cached)) {
+		if (cache_files)
+			tm_carray_push(*cache_files, *cached, a);
+		return;
+	}
+
+	uint64_t size;
+	const char *data = tm_symbols_scanner_read_file(a, scanner, path, &size);
+	if (!data)
+		return;
+
+	tm_symbols_cache_file_t file = {
+		.size = size,
+		.modified_time = stat->last_modified_time.opaque,
+		.content_hash = tm_murmur_hash_inline(data, (int)size, 0),
+	};
+
+	// A touched file with the same contents only needs its modification time updated.
+	if (cached && cached->size == size && cached->content_hash == file.content_hash && tm_symbols_set_add_cached(a, set, cached)) {
+		file.literals = cached->literals;
+		file.literals_size = cached->literals_size;
+		file.literal_count = cached->literal_count;
+	}
+	else {
+		tm_carray_shrink(scanner->spans, 0);
+		tm_symbols_scan(a, data, size, &scanner->spans);
+
+		const uint64_t span_count = tm_carray_size(scanner->spans);
+		for (uint64_t i = 0; i < span_count; ++i)
+			tm_symbols_set_add(a, set, data + scanner->spans[i].start, (uint32_t)scanner->spans[i].length);
+
+		if (cache_files) {
+			for (uint64_t i = 0; i < span_count; ++i)
+				file.literals_size += sizeof(uint32_t) + scanner->spans[i].length;
+
+			char *literals = tm_string_arena_alloc(&set->strings, a, file.literals_size);
+			for (uint64_t i = 0, offset = 0; i < span_count; ++i) {
+				const uint32_t length = (uint32_t)scanner->spans[i].length;
+				memcpy(literals + offset, &length, sizeof(uint32_t));
+				memcpy(literals + offset + sizeof(uint32_t), data + scanner->spans[i].start, length);
+				offset += sizeof(uint32_t) + length;
+			}
+
+			file.literals = literals;
+			file.literal_count = (uint32_t)span_count;
+		}
+	}
+
+	if (cache_files) {
+		file.path_length = (uint32_t)strlen(path);
+		char *path_copy = tm_string_arena_alloc(&set->strings, a, file.path_length);
+		memcpy(path_copy, path, file.path_length);
+		file.path = path_copy;
+		tm_carray_push(*cache_files, file, a);
+	}
+}
+
+// Queue of paths that still have to be searched. The owning thread pushes and pops at the back,
+// so it works depth first, while other threads steal from the front, which holds the biggest directories.
+typedef struct tm_symbols_queue_t
+{
+	tm_critical_section_o lock;
+	// carray
+	char **paths;
+	uint64_t head;
+} tm_symbols_queue_t;
+
+typedef struct tm_symbols_search_t
+{
+	tm_allocator_i *a;
+	tm_symbols_queue_t *queues;
+	tm_symbols_set_t *sets;
+	tm_symbols_scanner_t *scanners;
+	// Cache of the previous run, or null.
+	const tm_symbols_cache_t *cache;
+	// carray per thread of the files searched, used to write the new cache. Null if no cache is written.
+	tm_symbols_cache_file_t **cache_files;
+	// Memory a thread's set may use before it's spilled to a run, zero if the set is never spilled.
+	uint64_t thread_memory_limit;
+	// Number of runs spilled by each thread, see `tm_symbols_run_path()`.
+	uint32_t *run_counts;
+	const char *output_path;
+	uint32_t thread_count;
+	// Set if a run couldn't be written, the database can't be generated then.
+	atomic_uint32_t spill_failed;
+	// Number of paths that were pushed but are not searched yet, the search is done once this reaches zero.
+	atomic_uint64_t pending;
+} tm_symbols_search_t;
+
+typedef struct tm_symbols_worker_t
+{
+	tm_symbols_search_t *search;
+	uint32_t thread_idx;
+	TM_PAD(4);
+} tm_symbols_worker_t;
+
+static void tm_symbols_queue_push(tm_symbols_search_t *search, uint32_t thread_idx, const char *path)
+{
+	const size_t path_size = strlen(path) + 1;
+	char *copy = tm_alloc(search->a, path_size);
+	memcpy(copy, path, path_size);
+
+	atomic_fetch_add_uint64_t(&search->pending, 1);
+	tm_symbols_queue_t *queue = search->queues + thread_idx;
+	tm_os_api->thread->enter_critical_section(&queue->lock);
+	tm_carray_push(queue->paths, copy, search->a);
+	tm_os_api->thread->leave_critical_section(&queue->lock);
 }
 
-static void tm_symbols_search_file_or_dir(tm_allocator_i *a, tm_symbol_tree_t *tree, const char ***string_buffer, uint64_t *offset, const char *path)
+static char *tm_symbols_queue_pop(tm_symbols_queue_t *queue, bool steal)
+{
+	char *path = 0;
+	tm_os_api->thread->enter_critical_section(&queue->lock);
+	if (tm_carray_size(queue->paths) > queue->head) {
+		path = steal ? queue->paths[queue->head++] : tm_carray_pop(queue->paths);
+		if (tm_carray_size(queue->paths) == queue->head) {
+			tm_carray_shrink(queue->paths, 0);
+			queue->head = 0;
+		}
+	}
+	tm_os_api->thread->leave_critical_section(&queue->lock);
+	return path;
+}
+
+static void tm_symbols_search_spill(tm_symbols_search_t *search, uint32_t thread_idx)
+{
+	if (!tm_carray_size(search->sets[thread_idx].entries) || atomic_load_uint32_t(&search->spill_failed))
+		return;
+
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const char *run_path = tm_symbols_run_path(ta, search->output_path, thread_idx, search->run_counts[thread_idx]++);
+	if (!tm_symbols_set_spill(search->a, search->sets + thread_idx, run_path)) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to write temporary file '%s'\n", run_path);
+		atomic_store_uint32_t(&search->spill_failed, 1);
+	}
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+static void tm_symbols_search_path(tm_symbols_search_t *search, uint32_t thread_idx, const char *path)
 {
 	tm_file_stat_t stat = tm_os_api->file_system->stat(path);
 	if (!stat.exists) 
@@ -160,12 +1442,9 @@ static void tm_symbols_search_file_or_dir(tm_allocator_i *a, tm_symbol_tree_t *t
 
 			if (cur[0] == '.') continue;
 			if (!strcmp(path, "."))
-				tm_symbols_search_file_or_dir(a, tree, string_buffer, offset, cur);
-			else {
-				char *joined = tm_temp_allocator_api->printf(ta, "%s/%s", path, cur);
-				tm_symbols_search_file_or_dir(a, tree, string_buffer, offset, joined);
-				ta->realloc(ta->inst, joined, strlen(joined + 1), 0);
-			}
+				tm_symbols_queue_push(search, thread_idx, cur);
+			else
+				tm_symbols_queue_push(search, thread_idx, tm_temp_allocator_api->printf(ta, "%s/%s", path, cur));
 		}
 
 		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
@@ -177,28 +1456,290 @@ static void tm_symbols_search_file_or_dir(tm_allocator_i *a, tm_symbol_tree_t *t
 		const char *valid_extensions[] = { ".c", ".cpp", ".h", ".hpp", ".inl", ".inc" };
 		for (size_t i = 0; i < TM_ARRAY_COUNT(valid_extensions); ++i) {
 			if (!strcmp(ext, valid_extensions[i])) {
-				tm_symbols_search_file(a, tree, string_buffer, offset, path);
+				tm_symbols_search_file(search->a, search->sets + thread_idx, search->scanners + thread_idx, search->cache,
+					search->cache_files ? search->cache_files + thread_idx : 0, path, &stat);
+
+				if (search->thread_memory_limit && tm_symbols_set_memory(search->sets + thread_idx) > search->thread_memory_limit)
+					tm_symbols_search_spill(search, thread_idx);
 				break;
 			}
 		}
 	}
 }
 
-static void tm_symbols_search_and_save(tm_allocator_i *a, const char *input_path, const char *output_path, bool compress)
+static void tm_symbols_search_worker(void *data)
 {
-	tm_symbol_tree_t tree = { 0 };
-	uint64_t offset = 0;
-	const char **string_buffer = 0;
+	const tm_symbols_worker_t *worker = data;
+	tm_symbols_search_t *search = worker->search;
 
-	tm_symbols_search_file_or_dir(a, &tree, &string_buffer, &offset, input_path);
+	for (;;) {
+		char *path = tm_symbols_queue_pop(search->queues + worker->thread_idx, false);
+		for (uint32_t i = 1; !path && i < search->thread_count; ++i)
+			path = tm_symbols_queue_pop(search->queues + (worker->thread_idx + i) % search->thread_count, true);
 
-	if (compress)
-		tm_symbols_save_compressed(a, &tree, string_buffer, output_path);
+		if (!path) {
+			// Other threads may still push the contents of the directories they are searching.
+			if (!atomic_load_uint64_t(&search->pending))
+				return;
+
+			tm_os_api->thread->yield_processor();
+			continue;
+		}
+
+		tm_symbols_search_path(search, worker->thread_idx, path);
+		tm_free(search->a, path, strlen(path) + 1);
+		atomic_fetch_add_uint64_t(&search->pending, (uint64_t)-1);
+	}
+}
+
+// Searches `input_path` on `thread_count` threads (0 uses all logical processors) and saves the strings found.
+// The output doesn't depend on the number of threads. With `use_cache` unchanged files are skipped using the
+// cache next to the output and the cache is updated afterwards.
+typedef struct tm_symbols_generate_settings_t
+{
+	const char *input_path;
+	const char *output_path;
+	// Approximate bound on the memory used for the found strings, zero for no limit. With a limit the strings are
+	// spilled to temporary runs next to the output and merged from there, which is slower and doesn't use the cache.
+	uint64_t memory_limit;
+	// Zero for the number of logical processors.
+	uint32_t thread_count;
+	// With a memory limit the strings are always stored plain.
+	tm_symbols_strings_t strings;
+	tm_symbols_compression_t compression;
+	// Splits the database into `1 << shard_bits` shards and a manifest if not zero, see manifest.inl. Not done with a memory limit.
+	uint32_t shard_bits;
+	bool use_cache;
+	// Stores a search index for prefix and substring queries, see search_index.inl. Not written with a memory limit.
+	bool search_index;
+	TM_PAD(6);
+} tm_symbols_generate_settings_t;
+
+// Saves the entries to a single database, ignoring `shard_bits`.
+static void private__symbols_save_database(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, const tm_symbols_generate_settings_t *settings)
+{
+	if (settings->compression == TM_SYMBOLS_COMPRESSION_HUFFMAN)
+		tm_symbols_save_compressed(a, entries, count, settings->output_path, settings->strings, settings->search_index);
+	else if (settings->compression == TM_SYMBOLS_COMPRESSION_FSST) {
+		tm_fsst_table_t symbol_table;
+		private__symbols_fsst_train(a, entries, count, &symbol_table);
+		tm_symbols_save(a, entries, count, settings->output_path, settings->strings, &symbol_table, settings->search_index);
+	}
+	else
+		tm_symbols_save(a, entries, count, settings->output_path, settings->strings, 0, settings->search_index);
+}
+
+typedef struct private__symbols_shard_writer_t
+{
+	tm_allocator_i *a;
+	const tm_symbols_entry_t *entries;
+	// Entry at which each shard starts, followed by the total count.
+	const uint32_t *shard_starts;
+	const tm_symbols_generate_settings_t *settings;
+	atomic_uint32_t next_shard;
+	TM_PAD(4);
+} private__symbols_shard_writer_t;
+
+// Saves shards until all of them are claimed, runs on every thread that writes shards.
+static void private__symbols_shard_worker(void *data)
+{
+	private__symbols_shard_writer_t *writer = data;
+	const uint32_t shard_count = 1u << writer->settings->shard_bits;
+	for (uint32_t shard; (shard = atomic_fetch_add_uint32_t(&writer->next_shard, 1)) < shard_count;) {
+		TM_INIT_TEMP_ALLOCATOR(ta);
+		tm_symbols_generate_settings_t settings = *writer->settings;
+		settings.output_path = tm_temp_allocator_api->printf(ta, "%s.%u", writer->settings->output_path, shard);
+		const uint32_t start = writer->shard_starts[shard];
+		private__symbols_save_database(writer->a, writer->entries + start, writer->shard_starts[shard + 1] - start, &settings);
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	}
+}
+
+// Saves the entries as shards, each on whichever thread claims it first, and writes their manifest last,
+// so readers never find a manifest whose shards are still being written.
+static void private__symbols_save_shards(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, const tm_symbols_generate_settings_t *settings)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const uint32_t shard_count = 1u << settings->shard_bits;
+	uint32_t *shard_starts = tm_temp_alloc(ta, (shard_count + 1ull) * sizeof(uint32_t));
+	// The entries are sorted by hash, so every shard is a range of them.
+	for (uint32_t shard = 0, i = 0; shard <= shard_count; ++shard) {
+		while (i < count && tm_symbol_manifest_shard(settings->shard_bits, entries[i].hash) < shard)
+			++i;
+		shard_starts[shard] = shard < shard_count ? i : count;
+	}
+
+	private__symbols_shard_writer_t writer = { .a = a, .entries = entries, .shard_starts = shard_starts, .settings = settings };
+	const uint32_t thread_count = tm_min(shard_count, settings->thread_count ? settings->thread_count : tm_max(1, tm_os_api->info->num_logical_processors()));
+	tm_thread_o *threads = tm_temp_alloc(ta, thread_count * sizeof(tm_thread_o));
+	for (uint32_t i = 1; i < thread_count; ++i)
+		threads[i] = tm_os_api->thread->create_thread(private__symbols_shard_worker, &writer, 256 * 1024, "symbols shards");
+	private__symbols_shard_worker(&writer);
+	for (uint32_t i = 1; i < thread_count; ++i)
+		tm_os_api->thread->wait_for_thread(threads[i]);
+
+	const uint64_t manifest_size = tm_symbol_manifest_size(settings->shard_bits);
+	char *manifest = tm_temp_alloc(ta, manifest_size);
+	const uint32_t magic = TM_HDB_MANIFEST_MAGIC;
+	memcpy(manifest, &magic, sizeof(uint32_t));
+	memcpy(manifest + sizeof(uint32_t), &settings->shard_bits, sizeof(uint32_t));
+	tm_symbol_manifest_shard_t *shards = (tm_symbol_manifest_shard_t *)(manifest + (sizeof(uint32_t) << 1));
+	for (uint32_t shard = 0; shard < shard_count; ++shard) {
+		const char *shard_path = tm_temp_allocator_api->printf(ta, "%s.%u.hdb", settings->output_path, shard);
+		shards[shard] = (tm_symbol_manifest_shard_t) {
+			.file_size = tm_os_api->file_system->stat(shard_path).size,
+			.entry_count = shard_starts[shard + 1] - shard_starts[shard],
+		};
+	}
+
+	const char *manifest_path = tm_temp_allocator_api->printf(ta, "%s.hdbm", settings->output_path);
+	const char *temp_path = private__symbols_temp_path(ta, manifest_path);
+	tm_file_o file = tm_os_api->file_io->open_output(temp_path, false);
+	const bool written = file.valid && tm_os_api->file_io->write(file, manifest, manifest_size);
+	if (file.valid)
+		tm_os_api->file_io->close(file);
+	if (!private__symbols_replace_output(temp_path, manifest_path, written))
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to write '%s'\n", manifest_path);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Removes what an earlier run left at the output that won't be overwritten, so readers don't load both: the database
+// if the output is sharded, otherwise the manifest, and the shards of the manifest that `shard_bits` doesn't write.
+static void private__symbols_remove_stale_output(const char *output_path, uint32_t shard_bits)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const char *database_path = tm_temp_allocator_api->printf(ta, "%s.hdb", output_path);
+	const char *manifest_path = tm_temp_allocator_api->printf(ta, "%s.hdbm", output_path);
+	if (shard_bits && tm_os_api->file_system->stat(database_path).exists)
+		tm_os_api->file_system->remove_file(database_path);
+
+	tm_symbol_manifest_t *manifest = tm_temp_alloc(ta, sizeof(tm_symbol_manifest_t));
+	if (tm_symbol_manifest_read(manifest_path, manifest)) {
+		for (uint32_t shard = shard_bits ? 1u << shard_bits : 0; shard < 1u << manifest->shard_bits; ++shard) {
+			const char *shard_path = tm_symbol_manifest_shard_path(ta, manifest_path, shard);
+			if (tm_os_api->file_system->stat(shard_path).exists)
+				tm_os_api->file_system->remove_file(shard_path);
+		}
+	}
+	if (!shard_bits && tm_os_api->file_system->stat(manifest_path).exists)
+		tm_os_api->file_system->remove_file(manifest_path);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Saves the entries, sorted by hash and without duplicates, the way the settings ask for.
+static void tm_symbols_save_entries(tm_allocator_i *a, const tm_symbols_entry_t *entries, uint32_t count, const tm_symbols_generate_settings_t *settings)
+{
+	private__symbols_remove_stale_output(settings->output_path, settings->shard_bits);
+	if (settings->shard_bits)
+		private__symbols_save_shards(a, entries, count, settings);
 	else
-		tm_symbols_save(&tree, string_buffer, output_path);
+		private__symbols_save_database(a, entries, count, settings);
+}
 
-	tm_symbol_tree_free(tm_allocator_api->system, &tree);
-	for (size_t i = 0; i < tm_carray_size(string_buffer); ++i)
-		tm_free(a, (char *)string_buffer[i], strlen(string_buffer[i]) + 1);
-	tm_carray_free(string_buffer, a);
+// Logs what a memory limit leaves out of the database, it's saved by `tm_symbols_save_runs()` instead.
+// Also removes a stale manifest and its shards, since that always saves a single database.
+static void private__symbols_log_memory_limit(const tm_symbols_generate_settings_t *settings)
+{
+	if (settings->strings != TM_SYMBOLS_STRINGS_PLAIN)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: storing %s strings needs all strings in memory, '%s.hdb' stores plain strings\n", tm_symbols_strings_names[settings->strings], settings->output_path);
+	if (settings->search_index)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: a search index needs all strings in memory, '%s.hdb' is saved without one\n", settings->output_path);
+	if (settings->shard_bits)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: shards need all strings in memory, '%s.hdb' is saved as a single database\n", settings->output_path);
+	private__symbols_remove_stale_output(settings->output_path, 0);
+}
+
+static void tm_symbols_search_and_save(tm_allocator_i *a, const tm_symbols_generate_settings_t *settings)
+{
+	const uint32_t thread_count = settings->thread_count ? settings->thread_count : tm_max(1, tm_os_api->info->num_logical_processors());
+	// The cache holds the literals of every file in memory, so it can't be used with a memory limit.
+	const bool use_cache = settings->use_cache && !settings->memory_limit;
+
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	tm_symbols_search_t search = {
+		.a = a,
+		.thread_count = thread_count,
+		.thread_memory_limit = settings->memory_limit / thread_count,
+		.output_path = settings->output_path,
+	};
+	search.queues = tm_temp_alloc(ta, thread_count * sizeof(tm_symbols_queue_t));
+	search.sets = tm_temp_alloc(ta, thread_count * sizeof(tm_symbols_set_t));
+	search.scanners = tm_temp_alloc(ta, thread_count * sizeof(tm_symbols_scanner_t));
+	search.run_counts = tm_temp_alloc(ta, thread_count * sizeof(uint32_t));
+	memset(search.run_counts, 0, thread_count * sizeof(uint32_t));
+	tm_symbols_worker_t *workers = tm_temp_alloc(ta, thread_count * sizeof(tm_symbols_worker_t));
+	tm_thread_o *threads = tm_temp_alloc(ta, thread_count * sizeof(tm_thread_o));
+
+	const char *cache_path = tm_temp_allocator_api->printf(ta, "%s.hdb.cache", settings->output_path);
+	tm_symbols_cache_t cache = { 0 };
+	if (use_cache) {
+		if (tm_symbols_cache_open(a, cache_path, &cache))
+			search.cache = &cache;
+
+		search.cache_files = tm_temp_alloc(ta, thread_count * sizeof(tm_symbols_cache_file_t *));
+		memset(search.cache_files, 0, thread_count * sizeof(tm_symbols_cache_file_t *));
+	}
+
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		search.queues[i] = (tm_symbols_queue_t) { 0 };
+		tm_os_api->thread->create_critical_section(&search.queues[i].lock);
+		search.sets[i] = (tm_symbols_set_t) { 0 };
+		search.scanners[i] = (tm_symbols_scanner_t) { 0 };
+		workers[i] = (tm_symbols_worker_t) { .search = &search, .thread_idx = i };
+	}
+
+	// The calling thread is worker 0.
+	tm_symbols_queue_push(&search, 0, settings->input_path);
+	for (uint32_t i = 1; i < thread_count; ++i)
+		threads[i] = tm_os_api->thread->create_thread(tm_symbols_search_worker, workers + i, 256 * 1024, "symbols search");
+	tm_symbols_search_worker(workers);
+	for (uint32_t i = 1; i < thread_count; ++i)
+		tm_os_api->thread->wait_for_thread(threads[i]);
+
+	if (settings->memory_limit) {
+		private__symbols_log_memory_limit(settings);
+
+		for (uint32_t i = 0; i < thread_count; ++i)
+			tm_symbols_search_spill(&search, i);
+
+		const char **run_paths = 0;
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			for (uint32_t j = 0; j < search.run_counts[i]; ++j)
+				tm_carray_temp_push(run_paths, tm_symbols_run_path(ta, settings->output_path, i, j), ta);
+		}
+
+		if (atomic_load_uint32_t(&search.spill_failed) || !tm_symbols_save_runs(a, run_paths, 0, (uint32_t)tm_carray_size(run_paths), settings->output_path, settings->compression, settings->memory_limit))
+			tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to generate '%s.hdb'\n", settings->output_path);
+
+		for (uint64_t i = 0; i < tm_carray_size(run_paths); ++i)
+			tm_os_api->file_system->remove_file(run_paths[i]);
+	}
+	else {
+		tm_symbols_entry_t *entries = tm_symbols_merge(a, search.sets, thread_count);
+		tm_symbols_save_entries(a, entries, (uint32_t)tm_carray_size(entries), settings);
+		tm_carray_free(entries, a);
+	}
+
+	if (use_cache) {
+		tm_symbols_cache_file_t *cache_files = 0;
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			const uint64_t size = tm_carray_size(cache_files), added = tm_carray_size(search.cache_files[i]);
+			tm_carray_resize(cache_files, size + added, a);
+			memcpy(cache_files + size, search.cache_files[i], added * sizeof(tm_symbols_cache_file_t));
+			tm_carray_free(search.cache_files[i], a);
+		}
+
+		tm_symbols_cache_save(a, cache_path, cache_files, &cache);
+		tm_carray_free(cache_files, a);
+	}
+
+	tm_symbols_cache_close(a, &cache);
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		tm_symbols_set_free(a, search.sets + i);
+		tm_symbols_scanner_free(a, search.scanners + i);
+		tm_carray_free(search.queues[i].paths, a);
+		tm_os_api->thread->destroy_critical_section(&search.queues[i].lock);
+	}
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
 }
\ No newline at end of file
@@ -0,0 +1,219 @@
+// Merges existing databases into one, so shipping installs only have to open and search a single file.
+// The databases are merged in hash order straight from their mappings with the run merge of the generator,
+// which also drops duplicate hashes the way the generator does, and the strings are stored again with the settings.
+
+// Merges the databases into a carray of entries sorted by hash, with their strings copied to `strings`.
+static tm_symbols_entry_t *private__symbols_merged_entries(tm_allocator_i *a, const tm_symbol_database_t *databases, uint32_t database_count, tm_string_arena_t *strings)
+{
+	// The strings of the merge stream only live until the next entry, so they are copied.
+	tm_symbols_entry_t *entries = 0;
+	tm_symbols_run_merge_t merge;
+	tm_symbols_entry_t entry;
+	tm_symbols_run_merge_open(a, &merge, 0, databases, database_count, 0);
+	while (tm_symbols_run_merge_next(a, &merge, &entry)) {
+		char *copy = tm_string_arena_alloc(strings, a, entry.length + 1ull);
+		memcpy(copy, entry.string, entry.length + 1ull);
+		entry.string = copy;
+		tm_carray_push(entries, entry, a);
+	}
+	tm_symbols_run_merge_close(a, &merge);
+	return entries;
+}
+
+// Merges the .hdb files at or below `settings->input_path` into `settings->output_path`.hdb, which is skipped if it's one of them,
+// as are the shards of `settings->output_path`.hdbm.
+// Takes the same settings as `tm_symbols_search_and_save()`, except for the thread count and the cache. Returns false if no
+// database could be read or the merged one couldn't be written.
+static bool tm_symbols_merge_databases(tm_allocator_i *a, const tm_symbols_generate_settings_t *settings)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	const char *output_path = tm_temp_allocator_api->printf(ta, "%s.hdb", settings->output_path);
+	const char *manifest_path = tm_temp_allocator_api->printf(ta, "%s.hdbm", settings->output_path);
+	const char **paths = tm_symbols_database_paths(settings->input_path, ta);
+	tm_symbol_database_t *databases = tm_temp_alloc(ta, (tm_carray_size(paths) + 1) * sizeof(tm_symbol_database_t));
+	uint32_t database_count = 0;
+	uint64_t entry_count = 0, input_size = 0;
+	for (uint64_t i = 0; i < tm_carray_size(paths); ++i) {
+		const char *shard_manifest_path = tm_symbol_manifest_of_shard(ta, paths[i]);
+		if (!strcmp(paths[i], output_path) || (shard_manifest_path && !strcmp(shard_manifest_path, manifest_path)))
+			continue;
+
+		if (tm_symbol_database_open(a, paths[i], databases + database_count)) {
+			entry_count += databases[database_count].index.entry_count;
+			input_size += databases[database_count].file.size;
+			++database_count;
+		}
+		else
+			tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to read '%s'\n", paths[i]);
+	}
+
+	bool succeeded = database_count > 0;
+	if (!succeeded)
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: found no databases to merge at '%s'\n", settings->input_path);
+	else if (settings->memory_limit) {
+		private__symbols_log_memory_limit(settings);
+		succeeded = tm_symbols_save_runs(a, 0, databases, database_count, settings->output_path, settings->compression, settings->memory_limit);
+		printf_loud("dbgutils: merged %u databases with %llu entries (%llu bytes)\n", database_count, (unsigned long long)entry_count, (unsigned long long)input_size);
+	}
+	else {
+		tm_string_arena_t strings = { 0 };
+		tm_symbols_entry_t *entries = private__symbols_merged_entries(a, databases, database_count, &strings);
+
+		printf_loud("dbgutils: merged %u databases with %llu entries (%llu bytes) into %llu unique entries\n", database_count,
+			(unsigned long long)entry_count, (unsigned long long)input_size, (unsigned long long)tm_carray_size(entries));
+		tm_symbols_save_entries(a, entries, (uint32_t)tm_carray_size(entries), settings);
+		tm_carray_free(entries, a);
+		tm_string_arena_free(&strings, a);
+	}
+
+	for (uint32_t i = 0; i < database_count; ++i)
+		tm_symbol_database_close(a, databases + i);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return succeeded;
+}
+
+// Paths of the database saved at `output_path` with the settings, which is either `output_path`.hdb or the shards of its manifest.
+static const char **private__symbols_output_paths(const char *output_path, tm_temp_allocator_i *ta)
+{
+	const char **paths = 0;
+	const char *database_path = tm_temp_allocator_api->printf(ta, "%s.hdb", output_path);
+	const char *manifest_path = tm_temp_allocator_api->printf(ta, "%s.hdbm", output_path);
+	tm_symbol_manifest_t *manifest = tm_temp_alloc(ta, sizeof(tm_symbol_manifest_t));
+	if (tm_os_api->file_system->stat(database_path).exists)
+		tm_carray_temp_push(paths, database_path, ta);
+	else if (tm_symbol_manifest_read(manifest_path, manifest)) {
+		for (uint32_t shard = 0; shard < 1u << manifest->shard_bits; ++shard)
+			tm_carray_temp_push(paths, tm_symbol_manifest_shard_path(ta, manifest_path, shard), ta);
+	}
+	return paths;
+}
+
+// Seconds `tm_symbols_compact_journal()` waits after renaming a journal before reading it. Processes open the journal for
+// every batch they append, so a batch that was being appended while the journal was renamed is complete by then.
+#define TM_SYMBOLS_JOURNAL_GRACE_PERIOD 0.5
+
+// Appends the records of the journal at `from_path` from `offset` on to the journal at `path` and removes it.
+static bool private__symbols_return_journal(const char *from_path, uint64_t offset, const char *path)
+{
+	bool returned = true;
+	tm_mapped_file_t from;
+	if (tm_mapped_file_open(from_path, &from)) {
+		returned = from.size <= offset || tm_symbol_journal_append(path, from.data + offset, from.size - offset);
+		tm_mapped_file_close(&from);
+	}
+	return returned && tm_os_api->file_system->remove_file(from_path);
+}
+
+// Moves the strings of a runtime journal of `tm_debug_utils_api` into the database at `settings->output_path`, together with
+// the strings already stored there. Takes the same settings as `tm_symbols_merge_databases()`, except for the memory limit.
+// The journal is renamed to `[PATH].compacting` before it's read, so processes that append to it meanwhile start a new
+// journal at the path. What was appended to the renamed journal after it was read, or all of it if it couldn't be compacted,
+// is moved to the new journal afterwards. Returns false if the journal couldn't be read or compacted.
+static bool tm_symbols_compact_journal(tm_allocator_i *a, const char *journal_path, const tm_symbols_generate_settings_t *settings)
+{
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	tm_mapped_file_t journal;
+	const bool valid = tm_mapped_file_open(journal_path, &journal) && tm_symbol_journal_valid_header(journal.data, journal.size);
+	tm_mapped_file_close(&journal);
+	if (!valid) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: '%s' isn't a runtime journal\n", journal_path);
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+		return false;
+	}
+
+	// A journal left renamed by a compaction that was stopped goes back first, so it isn't replaced by this one.
+	const char *aside_path = tm_temp_allocator_api->printf(ta, "%s.compacting", journal_path);
+	const bool moved = (!tm_os_api->file_system->stat(aside_path).exists || private__symbols_return_journal(aside_path, TM_HDB_JOURNAL_HEADER_SIZE, journal_path))
+		&& tm_os_api->file_system->rename(journal_path, aside_path);
+	if (moved)
+		tm_os_api->thread->sleep(TM_SYMBOLS_JOURNAL_GRACE_PERIOD);
+	if (!moved || !tm_mapped_file_open(aside_path, &journal)) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to move '%s' to '%s'\n", journal_path, aside_path);
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+		return false;
+	}
+
+	// The strings of the output and of the journal are merged like the strings found by two generator threads.
+	tm_symbols_set_t sets[2] = { 0 };
+	tm_string_arena_t strings = { 0 };
+	uint64_t offset = TM_HDB_JOURNAL_HEADER_SIZE, skipped = 0, hash;
+	const char *string;
+	uint32_t length, record_count = 0;
+	while (tm_symbol_journal_next(journal.data, journal.size, &offset, &skipped, &hash, &string, &length)) {
+		char *copy = tm_string_arena_alloc(&strings, a, length + 1ull);
+		memcpy(copy, string, length);
+		copy[length] = '\0';
+		const tm_symbols_entry_t entry = { .hash = hash, .string = copy, .length = length };
+		tm_carray_push(sets[1].entries, entry, a);
+		++record_count;
+	}
+	if (skipped)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: dropped %llu bytes of partially written records of '%s'\n", (unsigned long long)skipped, journal_path);
+	const uint64_t read_size = journal.size;
+	tm_mapped_file_close(&journal);
+
+	const char **paths = private__symbols_output_paths(settings->output_path, ta);
+	tm_symbol_database_t *databases = tm_temp_alloc(ta, (tm_carray_size(paths) + 1) * sizeof(tm_symbol_database_t));
+	uint32_t database_count = 0;
+	bool succeeded = true;
+	for (uint64_t i = 0; i < tm_carray_size(paths); ++i) {
+		if (tm_symbol_database_open(a, paths[i], databases + database_count))
+			++database_count;
+		else {
+			tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to read '%s'\n", paths[i]);
+			succeeded = false;
+		}
+	}
+	sets[0].entries = private__symbols_merged_entries(a, databases, database_count, &strings);
+	for (uint32_t i = 0; i < database_count; ++i)
+		tm_symbol_database_close(a, databases + i);
+
+	// A database that couldn't be read would lose its strings when it's saved again.
+	const bool empty = !tm_carray_size(sets[0].entries) && !tm_carray_size(sets[1].entries);
+	tm_symbols_entry_t *entries = succeeded && !empty ? tm_symbols_merge(a, sets, 2) : 0;
+	const uint32_t count = (uint32_t)tm_carray_size(entries);
+	if (succeeded) {
+		tm_symbols_save_entries(a, entries, count, settings);
+
+			uint64_t saved_count = 0;
+		const char **saved_paths = private__symbols_output_paths(settings->output_path, ta);
+		for (uint64_t i = 0; i < tm_carray_size(saved_paths); ++i) {
+			tm_symbol_database_t db;
+			if (tm_symbol_database_open(a, saved_paths[i], &db)) {
+				saved_count += db.index.entry_count;
+				tm_symbol_database_close(a, &db);
+			}
+		}
+
+		succeeded = saved_count == count;
+	}
+
+	// The renamed journal is only removed once all its strings can be read back from the saved database.
+	if (!private__symbols_return_journal(aside_path, succeeded ? read_size : TM_HDB_JOURNAL_HEADER_SIZE, journal_path)) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to move the records of '%s' back to '%s'\n", aside_path, journal_path);
+		succeeded = false;
+	}
+	if (!succeeded)
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to compact '%s' into '%s'\n", journal_path, settings->output_path);
+	else
+		printf_loud("dbgutils: compacted %u journal records into %u entries\n", record_count, count);
+
+	tm_carray_free(entries, a);
+	tm_carray_free(sets[0].entries, a);
+	tm_carray_free(sets[1].entries, a);
+	tm_string_arena_free(&strings, a);
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return succeeded;
+}
+
+// Compacts the journal whenever processes appended strings to it, checking every `interval` seconds until the process is stopped.
+static void tm_symbols_compact_journal_every(tm_allocator_i *a, const char *journal_path, const tm_symbols_generate_settings_t *settings, double interval)
+{
+	while (true) {
+		// Processes that open the journal append a header and an empty batch.
+		const tm_file_stat_t stat = tm_os_api->file_system->stat(journal_path);
+		if (stat.exists && stat.size > TM_HDB_JOURNAL_HEADER_SIZE + TM_HDB_JOURNAL_RECORD_HEADER_SIZE)
+			tm_symbols_compact_journal(a, journal_path, settings);
+		tm_os_api->thread->sleep(interval);
+	}
+}
\ No newline at end of file
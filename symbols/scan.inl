@@ -0,0 +1,166 @@
+#include <emmintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Zeroed bytes before and after the file data, so the scanners can look two characters back and a whole block
+// ahead without bounds checks.
+#define TM_SYMBOLS_SCAN_PADDING_BEFORE 8
+#define TM_SYMBOLS_SCAN_PADDING_AFTER 128
+
+// Position of a string literal in the scanned data, without the quotes.
+typedef struct tm_symbols_span_t
+{
+	uint64_t start;
+	uint64_t length;
+} tm_symbols_span_t;
+
+// Per thread buffers for reading and scanning files.
+typedef struct tm_symbols_scanner_t
+{
+	char *buffer;
+	uint64_t buffer_size;
+	// carray
+	tm_symbols_span_t *spans;
+} tm_symbols_scanner_t;
+
+static inline uint32_t private__scan_ctz(uint64_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long idx;
+	_BitScanForward64(&idx, mask);
+	return (uint32_t)idx;
+#else
+	return (uint32_t)__builtin_ctzll(mask);
+#endif
+}
+
+// Reads the whole file into the scanner buffer with the required padding and returns the data, or null on failure.
+static const char *tm_symbols_scanner_read_file(tm_allocator_i *a, tm_symbols_scanner_t *scanner, const char *path, uint64_t *size)
+{
+	tm_file_o file = tm_os_api->file_io->open_input(path);
+	if (!file.valid)
+		return 0;
+
+	*size = tm_os_api->file_io->size(file);
+	const uint64_t required = TM_SYMBOLS_SCAN_PADDING_BEFORE + *size + TM_SYMBOLS_SCAN_PADDING_AFTER;
+	if (required > scanner->buffer_size) {
+		tm_free(a, scanner->buffer, scanner->buffer_size);
+		scanner->buffer_size = tm_max(required, scanner->buffer_size << 1);
+		scanner->buffer = tm_alloc(a, scanner->buffer_size);
+	}
+
+	char *data = scanner->buffer + TM_SYMBOLS_SCAN_PADDING_BEFORE;
+	uint64_t offset = 0;
+	int64_t bytes_read;
+	while (offset < *size && (bytes_read = tm_os_api->file_io->read(file, data + offset, *size - offset)) > 0)
+		offset += bytes_read;
+	tm_os_api->file_io->close(file);
+
+	*size = offset;
+	memset(scanner->buffer, 0, TM_SYMBOLS_SCAN_PADDING_BEFORE);
+	memset(data + offset, 0, TM_SYMBOLS_SCAN_PADDING_AFTER);
+	return data;
+}
+
+static void tm_symbols_scanner_free(tm_allocator_i *a, tm_symbols_scanner_t *scanner)
+{
+	tm_free(a, scanner->buffer, scanner->buffer_size);
+	tm_carray_free(scanner->spans, a);
+	*scanner = (tm_symbols_scanner_t) { 0 };
+}
+
+// The scanner state machine for a single character, shared by both scanners so they agree exactly.
+// Returns true if `i` closed a string literal that started at `*string_start`.
+static inline bool private__scan_character(const char *data, uint64_t i, bool *string_has_started, uint32_t *in_comment, uint64_t *string_start)
+{
+	// Skip anything in a comment.
+	if (*in_comment) {
+		if ((*in_comment == 1 && data[i] == '\n') || (*in_comment == 2 && data[i] == '*' && data[i + 1] == '/'))
+			*in_comment = false;
+
+		return false;
+	} else if (!*string_has_started && data[i] == '/' && (data[i + 1] == '/' || data[i + 1] == '*')) {
+		*in_comment = 1 + (data[i + 1] == '*');
+		return false;
+	}
+
+	if (data[i] != '"')
+		return false;
+
+	// Skip any " characters that are in a literal char ('"') or are used within a literal string (\").
+	if ((data[i - 1] == '\\' && data[i - 2] != '\\') || (data[i - 1] == '\'' && data[i + 1] == '\''))
+		return false;
+
+	if (*string_has_started) {
+		*string_has_started = false;
+		return true;
+	}
+
+	*string_has_started = true;
+	*string_start = i + 1;
+	return false;
+}
+
+// Reference scanner that tests every character, `data` must be padded as by `tm_symbols_scanner_read_file()`.
+static void tm_symbols_scan_scalar(tm_allocator_i *a, const char *data, uint64_t size, tm_symbols_span_t **spans)
+{
+	bool string_has_started = false;
+	uint32_t in_comment = false;
+	uint64_t string_start = 0;
+
+	for (uint64_t i = 0; i < size; ++i) {
+		if (private__scan_character(data, i, &string_has_started, &in_comment, &string_start)) {
+			const tm_symbols_span_t span = { .start = string_start, .length = i - string_start };
+			tm_carray_push(*spans, span, a);
+		}
+	}
+}
+
+static inline uint64_t private__scan_mask(__m128i b0, __m128i b1, __m128i b2, __m128i b3, char c)
+{
+	const __m128i v = _mm_set1_epi8(c);
+	return (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b0, v))
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b1, v)) << 16
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b2, v)) << 32
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b3, v)) << 48;
+}
+
+// Same result as `tm_symbols_scan_scalar()`, but finds the characters the state machine can react to
+// (quotes, newlines, comment starts and ends) 64 at a time and only runs the state machine on those.
+static void tm_symbols_scan(tm_allocator_i *a, const char *data, uint64_t size, tm_symbols_span_t **spans)
+{
+	bool string_has_started = false;
+	uint32_t in_comment = false;
+	uint64_t string_start = 0;
+
+	for (uint64_t block = 0; block < size; block += 64) {
+		const char *p = data + block;
+		const __m128i b0 = _mm_loadu_si128((const __m128i *)p);
+		const __m128i b1 = _mm_loadu_si128((const __m128i *)(p + 16));
+		const __m128i b2 = _mm_loadu_si128((const __m128i *)(p + 32));
+		const __m128i b3 = _mm_loadu_si128((const __m128i *)(p + 48));
+
+		const uint64_t quotes = private__scan_mask(b0, b1, b2, b3, '"');
+		const uint64_t newlines = private__scan_mask(b0, b1, b2, b3, '\n');
+		const uint64_t slashes = private__scan_mask(b0, b1, b2, b3, '/');
+		const uint64_t stars = private__scan_mask(b0, b1, b2, b3, '*');
+
+		// Masks of the characters following each position, the first character of the next block comes from the padding at the end.
+		const uint64_t next_slashes = (slashes >> 1) | (uint64_t)(p[64] == '/') << 63;
+		const uint64_t next_stars = (stars >> 1) | (uint64_t)(p[64] == '*') << 63;
+
+		uint64_t events = quotes | newlines | (slashes & (next_slashes | next_stars)) | (stars & next_slashes);
+		if (size - block < 64)
+			events &= (1ull << (size - block)) - 1;
+
+		for (; events; events &= events - 1) {
+			const uint64_t i = block + private__scan_ctz(events);
+			if (private__scan_character(data, i, &string_has_started, &in_comment, &string_start)) {
+				const tm_symbols_span_t span = { .start = string_start, .length = i - string_start };
+				tm_carray_push(*spans, span, a);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -25,9 +25,21 @@ static uint32_t page_threshold = 0;
 
 #include "binary_handler.inl"
 #include "huffman.inl"
+#include "fsst.inl"
 #include "tree.inl"
+#include "mapped_file.inl"
+#include "filter.inl"
+#include "search_index.inl"
+#include "database.inl"
+#include "manifest.inl"
+#include "journal.inl"
+#include "intern_table.inl"
+#include "scan.inl"
+#include "cache.inl"
 #include "generate.inl"
 #include "dump.inl"
+#include "merge.inl"
+#include "benchmark.inl"
 
 static void print_usage()
 {
@@ -50,20 +62,77 @@ static void print_usage()
 		"	--decimal\n"
 		"		Uses a radix of 10 instead of 16 when converting --search inputs to numbers.\n"
 		"\n"
+		"	-f [QUERY]\n"
+		"	--find [QUERY]\n"
+		"		Lists the strings of the loaded databases that start with the query, or contain it if the query starts with '*'.\n"
+		"		A trailing '*' is ignored. Databases generated with --search-index answer without decoding all their strings.\n"
+		"\n"
 		"	-d\n"
 		"	--dump\n"
 		"		Logs a human readable version of the symbol database specified (with --input) or generated (with --generate).\n"
 		"\n"
+		"	--format [text|csv|tsv|jsonl]\n"
+		"		Format of the entries written by --dump, defaults to text. Hashes are written in hexadecimal.\n"
+		"\n"
 		"	--page [NUMBER]\n"
 		"		When dumping a file to the user, stops after every [NUMBER] entries and waits for user input.\n"
 		"\n"
+		"	--benchmark\n"
+		"		Measures the decoding throughput of the symbol database specified (with --input) or generated (with --generate),\n"
+		"		and compares the ratio and decoding throughput of Huffman and FSST compression of its strings.\n"
+		"		Also measures the scanning throughput of the source files found at the --input path. Before that, checks that the\n"
+		"		strings of a fixed corpus decode back to themselves with every combination of --compression and --strings.\n"
+		"\n"
 		"	-g\n"
 		"	--generate\n"
 		"		Generates a symbols file for the specified files or for all child files in the current directory.\n"
 		"		This file contains The Machinery specific debugging information, like a hash lookup table.\n"
 		"\n"
+		"	--merge\n"
+		"		Merges all symbols files at or below the --input path into one symbols file at --output, dropping duplicate hashes.\n"
+		"		The strings are stored again as --strings, --compression and --search-index ask for, whatever the inputs used.\n"
+		"\n"
+		"	--compact-journal [PATH]\n"
+		"		Moves the strings of the runtime journal at [PATH], written by tm_debug_utils_api->set_runtime_journal(), into the\n"
+		"		symbols file at --output together with the strings already stored there, and removes the journal. Takes the same\n"
+		"		options as --merge, except for --memory-limit. Processes that have the journal open start a new one at [PATH] and\n"
+		"		the strings they append while it's compacted are moved to it.\n"
+		"\n"
+		"	--compact-interval [SECONDS]\n"
+		"		With --compact-journal, keeps running and compacts the journal every [SECONDS] that processes appended strings to it.\n"
+		"\n"
 		"	--no-compression\n"
-		"		Disables the default string compression with --generate.\n"
+		"		Disables the default string compression with --generate, same as --compression none.\n"
+		"\n"
+		"	--compression [huffman|fsst|none]\n"
+		"		How --generate compresses the strings, defaults to huffman. With fsst, the strings are compressed with a table of up to\n"
+		"		255 symbols of one to eight bytes that is trained on the strings, which decodes faster. Only readers of version 3\n"
+		"		symbols files can read those.\n"
+		"\n"
+		"	--strings [plain|suffixes|front]\n"
+		"		How --generate stores the strings, defaults to plain. With suffixes, strings that end another string are stored as part\n"
+		"		of it, which any reader of version 2 symbols files can read. With front, the sorted strings are stored in blocks of 16\n"
+		"		that only store the characters they don't share with the previous string. Both are ignored with --memory-limit.\n"
+		"\n"
+		"	--search-index\n"
+		"		Stores an index of the sorted strings and of the strings containing every three characters with --generate,\n"
+		"		which makes --find queries fast. Older readers still read the strings. Ignored with --memory-limit.\n"
+		"\n"
+		"	--shards [NUMBER]\n"
+		"		Splits the symbols file of --generate or --merge into [NUMBER] files by hash, which has to be a power of two up to 256,\n"
+		"		and writes [OUTPUT].hdbm listing them. The plugin loads the files in parallel and only searches the one a hash belongs to.\n"
+		"		Ignored with --memory-limit.\n"
+		"\n"
+		"	--no-cache\n"
+		"		Searches all files with --generate, instead of only the ones that changed since the last run.\n"
+		"		The literals found in each file are cached in [OUTPUT].hdb.cache next to the symbols file.\n"
+		"\n"
+		"	--memory-limit [MEGABYTES]\n"
+		"		Bounds the memory used for the found strings with --generate, by writing them to temporary files next to the output\n"
+		"		and merging those into the symbols file. Slower than generating in memory and implies --no-cache.\n"
+		"\n"
+		"	--threads [NUMBER]\n"
+		"		Number of threads used to search files with --generate, defaults to the number of logical processors.\n"
 		"\n"
 		"	-i [STRING]\n"
 		"	--input [STRING]\n"
@@ -71,7 +140,7 @@ static void print_usage()
 		"\n"
 		"	-o [STRING]\n"
 		"	--output [STRING]\n"
-		"		Specifies the output path for the symbols file if --generate is active or for a dump file if --dump is active.\n"
+		"		Specifies the output path for the symbols file if --generate or --merge is active or for a dump file if --dump is active.\n"
 		"\n");
 }
 
@@ -80,6 +149,45 @@ static inline bool arg_eql(const char *arg, const char *opt_short, const char *o
 	return !(strcmp(arg, opt_short) && strcmp(arg, opt_long));
 }
 
+static int compare_strings(const void *a, const void *b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Logs the strings matching the query of --find in sorted order.
+static void find_strings(const char *query, tm_temp_allocator_i *ta)
+{
+	const tm_clock_o start_time = tm_os_api->time->now();
+	const bool substring = query[0] == '*';
+	char *pattern = tm_temp_allocator_api->printf(ta, "%s", query + substring);
+	const size_t length = strlen(pattern);
+	if (length && pattern[length - 1] == '*')
+		pattern[length - 1] = 0;
+
+	uint64_t *hashes = tm_temp_alloc(ta, 1024 * sizeof(uint64_t));
+	const uint32_t count = tm_debug_utils_api->find_hashes(pattern, substring, hashes, 1024);
+	if (count > 1024) {
+		hashes = tm_temp_alloc(ta, count * sizeof(uint64_t));
+		tm_debug_utils_api->find_hashes(pattern, substring, hashes, count);
+	}
+
+	const char **results = tm_temp_alloc(ta, (count + 1ull) * sizeof(const char *));
+	const uint32_t found = tm_debug_utils_api->decode_hashes(hashes, count, results, ta);
+	const double elapsed = tm_os_api->time->delta(tm_os_api->time->now(), start_time);
+
+	// Every hash that was found decodes, unless a database was unloaded in between.
+	uint32_t result_count = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (results[i])
+			results[result_count++] = results[i];
+	}
+	qsort(results, result_count, sizeof(const char *), compare_strings);
+	for (uint32_t i = 0; i < result_count; ++i)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "%s\n", results[i]);
+
+	printf_loud("dbgutils: %u strings %s '%s', took %.3f ms\n", found, substring ? "contain" : "start with", pattern, elapsed * 1000.0);
+}
+
 int main(int argc, char **argv)
 {
 #ifdef _WIN32
@@ -89,13 +197,25 @@ int main(int argc, char **argv)
 	TM_INIT_TEMP_ALLOCATOR(ta);
 	tm_logger_api->add_logger(tm_logger_api->default_logger);
 
-	bool compress = true;
+	tm_symbols_compression_t compression = TM_SYMBOLS_COMPRESSION_HUFFMAN;
+	tm_symbols_strings_t strings = TM_SYMBOLS_STRINGS_PLAIN;
+	bool use_cache = true;
 	bool generate = false;
+	bool merge = false;
 	bool dump = false;
+	tm_symbols_dump_format_t dump_format = TM_SYMBOLS_DUMP_FORMAT_TEXT;
+	bool benchmark = false;
 	int radix = 16;
+	uint32_t thread_count = 0;
+	uint64_t memory_limit = 0;
 	const char *path = tm_path_api_dir(argv[0], tm_path_api->split(argv[0], NULL), ta);
 	const char *output = 0;
 	const char **queries = 0;
+	const char **find_queries = 0;
+	bool search_index = false;
+	uint32_t shard_bits = 0;
+	const char *journal_path = 0;
+	double compact_interval = 0;
 
 	for (int i = 1; i < argc; ++i) {
 		if (arg_eql(argv[i], "-h", "--help")) {
@@ -105,9 +225,13 @@ int main(int argc, char **argv)
 		}
 		else if (arg_eql(argv[i], "-q", "--quiet")) loud = false;
 		else if (arg_eql(argv[i], "-g", "--generate")) generate = true;
-		else if (!strcmp(argv[i], "--no-compression")) compress = false;
+		else if (!strcmp(argv[i], "--merge")) merge = true;
+		else if (!strcmp(argv[i], "--no-compression")) compression = TM_SYMBOLS_COMPRESSION_NONE;
+		else if (!strcmp(argv[i], "--no-cache")) use_cache = false;
+		else if (!strcmp(argv[i], "--search-index")) search_index = true;
 		else if (arg_eql(argv[i], "-d", "--dump")) dump = true;
 		else if (!strcmp(argv[i], "--decimal")) radix = 10;
+		else if (!strcmp(argv[i], "--benchmark")) benchmark = true;
 		else if (arg_eql(argv[i], "-i", "--input")) {
 			if (i + 1 < argc) path = argv[++i];
 			else {
@@ -129,6 +253,88 @@ int main(int argc, char **argv)
 				return EXIT_FAILURE;
 			}
 		}
+		else if (arg_eql(argv[i], "-f", "--find")) {
+			if (i + 1 < argc) tm_carray_temp_push(find_queries, argv[++i], ta);
+			else {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: no query was specified after --find!\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--threads")) {
+			if (i + 1 < argc) thread_count = strtoul(argv[++i], NULL, 10);
+			else {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: no thread count was specified after --threads!\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--memory-limit")) {
+			if (i + 1 < argc) memory_limit = strtoull(argv[++i], NULL, 10) << 20;
+			else {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: no size was specified after --memory-limit!\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--compact-journal")) {
+			if (i + 1 < argc) journal_path = argv[++i];
+			else {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: no path was specified after --compact-journal!\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--compact-interval")) {
+			compact_interval = i + 1 < argc ? strtod(argv[++i], NULL) : 0;
+			if (compact_interval <= 0) {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: no interval was specified after --compact-interval!\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--shards")) {
+			const uint32_t shard_count = i + 1 < argc ? strtoul(argv[++i], NULL, 10) : 0;
+			for (shard_bits = 1; shard_bits <= TM_HDB_MANIFEST_MAX_SHARD_BITS && (1u << shard_bits) != shard_count; ++shard_bits);
+			if (shard_bits > TM_HDB_MANIFEST_MAX_SHARD_BITS) {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: --shards has to be followed by a power of two from 2 to 256!\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "--format")) {
+			uint32_t format = TM_ARRAY_COUNT(tm_symbols_dump_format_names);
+			if (i + 1 < argc) {
+				++i;
+				for (format = 0; format < TM_ARRAY_COUNT(tm_symbols_dump_format_names) && strcmp(argv[i], tm_symbols_dump_format_names[format]); ++format);
+			}
+
+			if (format == TM_ARRAY_COUNT(tm_symbols_dump_format_names)) {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: --format has to be followed by text, csv, tsv or jsonl!\n");
+				return EXIT_FAILURE;
+			}
+			dump_format = (tm_symbols_dump_format_t)format;
+		}
+		else if (!strcmp(argv[i], "--strings")) {
+			uint32_t storage = TM_ARRAY_COUNT(tm_symbols_strings_names);
+			if (i + 1 < argc) {
+				++i;
+				for (storage = 0; storage < TM_ARRAY_COUNT(tm_symbols_strings_names) && strcmp(argv[i], tm_symbols_strings_names[storage]); ++storage);
+			}
+
+			if (storage == TM_ARRAY_COUNT(tm_symbols_strings_names)) {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: --strings has to be followed by plain, suffixes or front!\n");
+				return EXIT_FAILURE;
+			}
+			strings = (tm_symbols_strings_t)storage;
+		}
+		else if (!strcmp(argv[i], "--compression")) {
+			uint32_t method = TM_ARRAY_COUNT(tm_symbols_compression_names);
+			if (i + 1 < argc) {
+				++i;
+				for (method = 0; method < TM_ARRAY_COUNT(tm_symbols_compression_names) && strcmp(argv[i], tm_symbols_compression_names[method]); ++method);
+			}
+
+			if (method == TM_ARRAY_COUNT(tm_symbols_compression_names)) {
+				tm_logger_api->print(TM_LOG_TYPE_ERROR, "dbgutils: --compression has to be followed by huffman, fsst or none!\n");
+				return EXIT_FAILURE;
+			}
+			compression = (tm_symbols_compression_t)method;
+		}
 		else if (!strcmp(argv[i], "--page")) {
 			if (i + 1 < argc) page_threshold = strtoul(argv[++i], NULL, 10);
 			else {
@@ -152,15 +358,40 @@ int main(int argc, char **argv)
 		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: %s = '%s'\n", queries[i], tm_debug_utils_api->decode_hash(strtoull(queries[i], NULL, radix), ta));
 	}
 
-	if (generate) {
+	for (size_t i = 0; i < tm_carray_size(find_queries); ++i)
+		find_strings(find_queries[i], ta);
+
+	if (generate || merge || journal_path) {
 		const tm_clock_o start_time = tm_os_api->time->now();
 
+		// A journal is compacted next to itself by default, `runtime.hdbj` into `runtime.hdb`.
+		const char *journal_ext = 0;
+		if (!output && journal_path && !generate && !merge) {
+			tm_path_api->split(journal_path, &journal_ext);
+			output = tm_temp_allocator_api->printf(ta, "%.*s", (int)(journal_ext - journal_path), journal_path);
+		}
 		if (!output) output = tm_temp_allocator_api->printf(ta, "%s/%s", tm_path_api_dir(argv[0], tm_path_api->split(argv[0], NULL), ta), tm_path_api->split(path, NULL));
-		tm_symbols_search_and_save(tm_allocator_api->system, path, output, compress);
+		const tm_symbols_generate_settings_t settings = {
+			.input_path = path,
+			.output_path = output,
+			.memory_limit = memory_limit,
+			.thread_count = thread_count,
+			.strings = strings,
+			.compression = compression,
+			.shard_bits = shard_bits,
+			.use_cache = use_cache,
+			.search_index = search_index,
+		};
+		if (generate)
+			tm_symbols_search_and_save(tm_allocator_api->system, &settings);
+		else if (!merge && compact_interval > 0)
+			tm_symbols_compact_journal_every(tm_allocator_api->system, journal_path, &settings, compact_interval);
+		else if (merge ? !tm_symbols_merge_databases(tm_allocator_api->system, &settings) : !tm_symbols_compact_journal(tm_allocator_api->system, journal_path, &settings))
+			return EXIT_FAILURE;
 
 		const tm_clock_o end_time = tm_os_api->time->now();
 		const float elapsed = (float)tm_os_api->time->delta(end_time, start_time);
-		printf_loud("dbgutils: done generating, took %.3f s\n", elapsed);
+		printf_loud("dbgutils: done %s, took %.3f s\n", generate ? "generating" : merge ? "merging" : "compacting", elapsed);
 	}
 
 	if (dump) {
@@ -168,11 +399,24 @@ int main(int argc, char **argv)
 		const char *input_file = generate ? output_dir : path;
 
 		if (output) {
-			const char *output_file = tm_temp_allocator_api->printf(ta, "%s\\%s.txt", output_dir, output);
-			tm_symbols_dump_file_or_dir_to_file(tm_allocator_api->system, input_file, output_file);
+			const char *extension = dump_format == TM_SYMBOLS_DUMP_FORMAT_TEXT ? "txt" : tm_symbols_dump_format_names[dump_format];
+			const char *output_file = tm_temp_allocator_api->printf(ta, "%s\\%s.%s", output_dir, output, extension);
+			tm_symbols_dump_file_or_dir(tm_allocator_api->system, input_file, output_file, dump_format);
 		}
 		else
-			tm_symbols_dump_file_or_dir_to_user(tm_allocator_api->system, input_file);
+			tm_symbols_dump_file_or_dir(tm_allocator_api->system, input_file, 0, dump_format);
+	}
+
+	if (benchmark) {
+		const char *output_dir = tm_path_api_dir(argv[0], tm_path_api->split(argv[0], NULL), ta);
+		if (!tm_symbols_benchmark_round_trip(tm_allocator_api->system, output_dir)) {
+			TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+			return EXIT_FAILURE;
+		}
+
+		tm_symbols_benchmark_file_or_dir(tm_allocator_api->system, path);
+		if (generate)
+			tm_symbols_benchmark_file_or_dir(tm_allocator_api->system, tm_temp_allocator_api->printf(ta, "%s.hdb", output));
 	}
 
 	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
@@ -0,0 +1,292 @@
+// Cache of strings decoded from compressed or front coded databases, so the hashes that are decoded over and over again,
+// like the ones in log and assert messages, only run through the decoder once.
+// Entries are found through an open addressing table keyed by hash and evicted with the CLOCK algorithm:
+// hits mark their entry as referenced and the hand sweeping the entries gives referenced ones a second chance.
+// The hand sweeps its own ring of entries rather than the table, so evictions are spread evenly over the table.
+// A cache that another thread holds is skipped rather than waited for, decoding a string again costs about as much as
+// waiting would. The table and the strings share one block of the budget that's allocated by `private__cache_reset()`,
+// the strings are stored in linked chunks of it, so neither lookups nor inserts allocate.
+
+// One slot per this many bytes of budget, at most half of the slots are used.
+#define private__cache_bytes_per_slot 64
+// Strings longer than this part of the budget would flush most of the cache, so they aren't cached.
+#define private__cache_max_string_part 8
+// Entries an insert evicts at most, a string that doesn't fit after that isn't cached.
+#define private__cache_max_evictions 8
+// Bytes per chunk, including the index of the next chunk of the string.
+#define private__cache_chunk_size 32
+
+typedef struct private__cache_slot_t
+{
+	// Zero for empty slots, zero hashes are never cached.
+	uint64_t hash;
+	// First chunk of the string, the following ones are linked through `private__cache_chunk_t::next`.
+	uint32_t chunk;
+	uint32_t length;
+	uint32_t referenced;
+	TM_PAD(4);
+} private__cache_slot_t;
+
+typedef struct private__cache_chunk_t
+{
+	uint32_t next;
+	char data[private__cache_chunk_size - sizeof(uint32_t)];
+} private__cache_chunk_t;
+
+typedef struct private__cache_t
+{
+	// Start of the block of `budget` bytes.
+	private__cache_slot_t *slots;
+	uint64_t mask;
+	// Hashes of the entries in the order the hand visits them, zero for free positions.
+	uint64_t *ring;
+	// One bit per hash that missed since the doorkeeper was last cleared, see `private__cache_admit()`.
+	uint64_t *doorkeeper;
+	uint32_t *free_positions;
+	// The rest of the block. Chunks are taken from the freed ones first and then in order from `fresh_chunk`,
+	// so the pages of the block are only touched once strings are stored in them.
+	private__cache_chunk_t *chunks;
+	uint32_t free_count;
+	// Number of positions of `ring`, half the number of slots.
+	uint32_t entry_capacity;
+	uint32_t hand;
+	uint32_t doorkeeper_count;
+	uint32_t chunk_count;
+	uint32_t fresh_chunk;
+	// First of the freed chunks, `UINT32_MAX` if there are none.
+	uint32_t free_chunk;
+	// Freed and fresh chunks.
+	uint32_t free_chunk_count;
+	uint64_t budget;
+	atomic_uint32_t lock;
+	TM_PAD(4);
+} private__cache_t;
+
+// Size of the part of the block holding the slots, the ring, the doorkeeper and the free positions.
+static inline uint64_t private__cache_table_size(uint64_t slot_count)
+{
+	return slot_count * sizeof(private__cache_slot_t) + (slot_count >> 1) * (sizeof(uint64_t) + sizeof(uint32_t)) + (slot_count >> 1);
+}
+
+// Number of slots for the budget, zero if it's too small for any.
+static uint64_t private__cache_slot_count(uint64_t budget)
+{
+	uint64_t slot_count = 16;
+	if (budget < slot_count * private__cache_bytes_per_slot)
+		return 0;
+
+	while (slot_count * 2 * private__cache_bytes_per_slot <= budget && slot_count < (1ull << 32))
+		slot_count *= 2;
+	return slot_count;
+}
+
+// Sets up an empty table in a block of `budget` bytes whose table part is zeroed, or no table if `block` is null.
+// Must hold the lock.
+static void private__cache_install(private__cache_t *cache, char *block, uint64_t slot_count, uint64_t budget)
+{
+	const uint64_t table_size = private__cache_table_size(slot_count);
+	cache->slots = (private__cache_slot_t *)block;
+	cache->mask = block ? slot_count - 1 : 0;
+	cache->entry_capacity = block ? (uint32_t)(slot_count >> 1) : 0;
+	cache->ring = block ? (uint64_t *)(cache->slots + slot_count) : 0;
+	cache->doorkeeper = block ? cache->ring + cache->entry_capacity : 0;
+	cache->free_positions = block ? (uint32_t *)(cache->doorkeeper + (slot_count >> 4)) : 0;
+	cache->chunks = block ? (private__cache_chunk_t *)(block + table_size) : 0;
+	for (uint32_t i = 0; i < cache->entry_capacity; ++i)
+		cache->free_positions[i] = cache->entry_capacity - 1 - i;
+	cache->free_count = cache->entry_capacity;
+	cache->hand = cache->doorkeeper_count = 0;
+	cache->chunk_count = block ? (uint32_t)tm_min((budget - table_size) / sizeof(private__cache_chunk_t), UINT32_MAX - 1) : 0;
+	cache->fresh_chunk = 0;
+	cache->free_chunk = UINT32_MAX;
+	cache->free_chunk_count = cache->chunk_count;
+	cache->budget = budget;
+}
+
+// Number of chunks a string of `length` bytes is stored in.
+static inline uint32_t private__cache_chunks_needed(uint32_t length)
+{
+	const uint32_t chunk_data = private__cache_chunk_size - sizeof(uint32_t);
+	return (length + chunk_data - 1) / chunk_data;
+}
+
+// Copies the first `size` bytes of the string stored from `chunk` on to `buffer`.
+static void private__cache_read(const private__cache_t *cache, uint32_t chunk, char *buffer, uint32_t size)
+{
+	const uint32_t chunk_data = private__cache_chunk_size - sizeof(uint32_t);
+	for (uint32_t offset = 0; offset < size; offset += chunk_data) {
+		const private__cache_chunk_t *c = cache->chunks + chunk;
+		memcpy(buffer + offset, c->data, tm_min(size - offset, chunk_data));
+		chunk = c->next;
+	}
+}
+
+// Stores the string in free chunks, of which there must be enough. Returns the first one.
+static uint32_t private__cache_write(private__cache_t *cache, const char *string, uint32_t length)
+{
+	const uint32_t chunk_data = private__cache_chunk_size - sizeof(uint32_t);
+	uint32_t first = 0, *link = &first;
+	for (uint32_t offset = 0; offset < length; offset += chunk_data) {
+		uint32_t chunk = cache->free_chunk;
+		if (chunk != UINT32_MAX)
+			cache->free_chunk = cache->chunks[chunk].next;
+		else
+			chunk = cache->fresh_chunk++;
+		memcpy(cache->chunks[chunk].data, string + offset, tm_min(length - offset, chunk_data));
+		*link = chunk;
+		link = &cache->chunks[chunk].next;
+	}
+	cache->free_chunk_count -= private__cache_chunks_needed(length);
+	return first;
+}
+
+// Returns the slot of the hash, or the empty slot it would be inserted into.
+static inline private__cache_slot_t *private__cache_probe(const private__cache_t *cache, uint64_t hash)
+{
+	uint64_t slot = hash & cache->mask;
+	while (cache->slots[slot].hash && cache->slots[slot].hash != hash)
+		slot = (slot + 1) & cache->mask;
+	return cache->slots + slot;
+}
+
+// Copies the cached string of the hash to `buffer` like `tm_symbol_database_decode()`, returns false if it isn't cached
+// or another thread holds the cache.
+static bool private__cache_find(private__cache_t *cache, uint64_t hash, char *buffer, uint32_t buffer_size, uint32_t *length)
+{
+	if (!private__spin_try_lock(&cache->lock))
+		return false;
+
+	private__cache_slot_t *slot = cache->slots && hash ? private__cache_probe(cache, hash) : 0;
+	const bool found = slot && slot->hash;
+	if (found) {
+		slot->referenced = 1;
+		*length = slot->length;
+		private__cache_read(cache, slot->chunk, buffer, tm_min(slot->length, buffer_size));
+	}
+	private__spin_unlock(&cache->lock);
+	return found;
+}
+
+// Empties the slot and moves the following entries of its cluster back, so lookups never have to skip deleted slots.
+// The chunks of the string go to the freed ones.
+static void private__cache_remove(private__cache_t *cache, uint64_t slot)
+{
+	private__cache_slot_t *slots = cache->slots;
+	const uint32_t chunk_count = private__cache_chunks_needed(slots[slot].length);
+	uint32_t last = slots[slot].chunk;
+	for (uint32_t i = 1; i < chunk_count; ++i)
+		last = cache->chunks[last].next;
+	cache->chunks[last].next = cache->free_chunk;
+	cache->free_chunk = slots[slot].chunk;
+	cache->free_chunk_count += chunk_count;
+
+	uint64_t hole = slot;
+	for (uint64_t next = (hole + 1) & cache->mask; slots[next].hash; next = (next + 1) & cache->mask) {
+		// The entry can only move back if the hole lies between its home slot and where it is now.
+		const uint64_t home = slots[next].hash & cache->mask;
+		if (((next - home) & cache->mask) >= ((next - hole) & cache->mask)) {
+			slots[hole] = slots[next];
+			hole = next;
+		}
+	}
+	slots[hole] = (private__cache_slot_t) { 0 };
+}
+
+// Advances the hand until it finds an entry that wasn't referenced since it last passed and evicts it.
+static void private__cache_evict(private__cache_t *cache)
+{
+	for (;; cache->hand = (cache->hand + 1) & (cache->entry_capacity - 1)) {
+		const uint64_t hash = cache->ring[cache->hand];
+		if (!hash)
+			continue;
+
+		private__cache_slot_t *slot = private__cache_probe(cache, hash);
+		if (slot->referenced) {
+			slot->referenced = 0;
+			continue;
+		}
+
+		private__cache_remove(cache, slot - cache->slots);
+		cache->ring[cache->hand] = 0;
+		cache->free_positions[cache->free_count++] = cache->hand;
+		cache->hand = (cache->hand + 1) & (cache->entry_capacity - 1);
+		return;
+	}
+}
+
+// Only hashes that already missed since the doorkeeper was last cleared are cached, so strings that are
+// decoded once don't evict the ones that are decoded over and over again. It's cleared after as many
+// misses as there are entries, which keeps its bits sparse enough to rarely admit a hash by mistake.
+static inline bool private__cache_admit(private__cache_t *cache, uint64_t hash)
+{
+	const uint64_t bit = (hash >> 32) & (((cache->mask + 1) << 2) - 1);
+	uint64_t *word = cache->doorkeeper + (bit >> 6);
+	if (*word & (1ull << (bit & 63)))
+		return true;
+
+	*word |= 1ull << (bit & 63);
+	if (++cache->doorkeeper_count == cache->entry_capacity) {
+		memset(cache->doorkeeper, 0, (cache->mask + 1) >> 1);
+		cache->doorkeeper_count = 0;
+	}
+	return false;
+}
+
+// Inserts a decoded string, evicting entries until it fits. Returns the number of entries that were evicted.
+// Does nothing if another thread holds the cache.
+static uint32_t private__cache_insert(private__cache_t *cache, uint64_t hash, const char *string, uint32_t length)
+{
+	if (!hash || !length || !private__spin_try_lock(&cache->lock))
+		return 0;
+
+	// The string may have been inserted by another thread while this one was decoding it. The doorkeeper is checked first,
+	// since it's small enough to stay in the cache, while most strings that are decoded once would miss on their slot.
+	uint32_t evicted = 0;
+	if (cache->slots && length <= cache->budget / private__cache_max_string_part && private__cache_admit(cache, hash) && !private__cache_probe(cache, hash)->hash) {
+		const uint32_t chunk_count = private__cache_chunks_needed(length);
+		while (evicted < private__cache_max_evictions && cache->free_count < cache->entry_capacity
+			&& (!cache->free_count || cache->free_chunk_count < chunk_count)) {
+			private__cache_evict(cache);
+			++evicted;
+		}
+
+		if (cache->free_count && cache->free_chunk_count >= chunk_count) {
+			cache->ring[cache->free_positions[--cache->free_count]] = hash;
+			const uint32_t chunk = private__cache_write(cache, string, length);
+			*private__cache_probe(cache, hash) = (private__cache_slot_t) { .hash = hash, .chunk = chunk, .length = length };
+		}
+	}
+	private__spin_unlock(&cache->lock);
+	return evicted;
+}
+
+// Replaces the table with an empty one for the budget, or none if `allocate` isn't set.
+// The new block is allocated before and the old one freed after holding the lock.
+static void private__cache_replace(private__cache_t *cache, uint64_t budget, bool allocate)
+{
+	const uint64_t slot_count = allocate ? private__cache_slot_count(budget) : 0;
+	char *block = slot_count ? tm_alloc(tm_allocator_api->system, budget) : 0;
+	if (block)
+		memset(block, 0, private__cache_table_size(slot_count));
+
+	private__spin_lock(&cache->lock);
+	char *old_block = (char *)cache->slots;
+	const uint64_t old_budget = cache->budget;
+	private__cache_install(cache, block, slot_count, budget);
+	private__spin_unlock(&cache->lock);
+
+	if (old_block)
+		tm_free(tm_allocator_api->system, old_block, old_budget);
+}
+
+// Empties the cache and changes the budget, allocating all the memory it uses. A budget of zero disables the cache.
+static void private__cache_reset(private__cache_t *cache, uint64_t budget)
+{
+	private__cache_replace(cache, budget, true);
+}
+
+// Frees the memory of the cache, it stays disabled until it's reset with its budget.
+static void private__cache_free(private__cache_t *cache)
+{
+	private__cache_replace(cache, cache->budget, false);
+}
\ No newline at end of file
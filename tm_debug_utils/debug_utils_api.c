@@ -11,28 +11,171 @@
 #include "tree.inl"
 #include "binary_handler.inl"
 #include "huffman.inl"
+#include "fsst.inl"
+#include "mapped_file.inl"
+#include "filter.inl"
+#include "search_index.inl"
+#include "database.inl"
+#include "manifest.inl"
+#include "global_index.inl"
+#include "intern_table.inl"
+#include "journal.inl"
+#include "spin_lock.inl"
+#include "stats.inl"
+#include "cache.inl"
+#include "runtime_journal.inl"
+#include "shared_index.inl"
 
-static tm_symbol_tree_t runtime_tree;
-static char *runtime_strings = 0;
-static size_t runtime_buffer_size = 0;
-
-static tm_symbol_tree_t *trees = 0;
-static tm_huffman_tree_t *decoding = 0;
-static char **files = 0;
+static tm_intern_table_t runtime_table;
+static private__cache_t decode_cache = { .budget = TM_DEBUG_UTILS_DECODE_CACHE_SIZE };
+static private__journal_t runtime_journal;
 
 #define allocator tm_allocator_api->system
 
-static char *private__string_copy(const char *str)
+// Shards of a manifest, see manifest.inl. Every shard has its own index, so a lookup only probes the shard its hash belongs to.
+typedef struct private__shard_set_t
 {
-	char *result = tm_alloc(allocator, strlen(str) + 1);
-	strcpy(result, str);
-	return result;
+	char *manifest_path;
+	tm_symbol_global_index_t *indices;
+	private__shared_segment_t *segments;
+	uint32_t shard_bits;
+	// Index of the database of the first shard, the others follow it.
+	uint32_t first_database;
+} private__shard_set_t;
+
+// Loaded databases and the index over them. Adding databases builds a new set that replaces the old one as a whole,
+// so lookups on other threads never see a partially built index. Replaced sets are retired, and freed by a later load
+// once no lookup that may have started on them is still running, see `private__symbols_enter()`.
+typedef struct private__symbols_t
+{
+	// The databases that aren't shards come first and are covered by `index`, the shards of every shard set follow them.
+	tm_symbol_database_t *databases;
+	uint32_t database_count;
+	uint32_t plain_database_count;
+	tm_symbol_global_index_t index;
+	private__shared_segment_t index_segment;
+	// The manifest paths and the indices are shared with the sets that replace this one.
+	private__shard_set_t *shard_sets;
+	uint32_t shard_set_count;
+	TM_PAD(4);
+	// Value of `symbols_epoch` after the set was replaced, and the next retired set.
+	uint64_t retired_epoch;
+	struct private__symbols_t *next_retired;
+} private__symbols_t;
+
+static private__symbols_t no_symbols;
+// (private__symbols_t *) Null until the first databases are loaded.
+static atomic_uint64_t loaded_symbols;
+// Bumped after every set that replaces the loaded one, starts at one since zero marks threads that aren't looking up.
+static atomic_uint64_t symbols_epoch = 1;
+// Replaced sets that weren't freed yet, only used while holding `load_lock`.
+static private__symbols_t *retired_symbols;
+
+static inline const private__symbols_t *private__symbols(void)
+{
+	const private__symbols_t *symbols = (const private__symbols_t *)atomic_load_uint64_t(&loaded_symbols);
+	return symbols ? symbols : &no_symbols;
+}
+
+// Returns the loaded set and keeps it from being freed until `private__symbols_leave()`. The thread announces the epoch
+// it saw before reading the set, so a set retired after that epoch may still be used while one retired before can't be.
+static inline const private__symbols_t *private__symbols_enter(private__stats_block_t *block)
+{
+	atomic_store_uint64_t(&block->symbols_epoch, atomic_load_uint64_t(&symbols_epoch));
+	return private__symbols();
+}
+
+static inline void private__symbols_leave(private__stats_block_t *block)
+{
+	atomic_store_uint64_t(&block->symbols_epoch, 0);
+}
+
+// A path passed to `add_symbol_database_async()`. It's searched by whichever thread claims it first, the thread started
+// for it or a thread waiting for it. Requests are only claimed and searched while holding `load_lock`,
+// so a thread that gets the lock after a request was claimed knows that its databases are loaded.
+typedef struct private__load_request_t
+{
+	char *path;
+	tm_thread_o thread;
+	bool claimed;
+	TM_PAD(7);
+} private__load_request_t;
+
+// Serializes searching for databases and publishing them, and opening and closing the runtime journal.
+static tm_critical_section_o load_lock;
+// Guards `load_requests`, which are only removed when the plugin is unloaded.
+static tm_critical_section_o requests_lock;
+static private__load_request_t **load_requests;
+// Manifests that couldn't be read or didn't match their shards, whose shards were loaded as separate databases.
+// Only used while holding `load_lock`, so searching their paths again doesn't load the shards again.
+static char **failed_manifests;
+// The locks are created by the first thread that needs them: 0 before, 1 while and 2 after they are created.
+static atomic_uint32_t locks_state;
+// Set once databases were added or searched for, so lookups only start searching the default path if nothing else was.
+static atomic_uint32_t search_started;
+// Set by `set_shared_index()`, only changed while holding `load_lock`.
+static bool shared_index;
+
+static void private__create_locks(void)
+{
+	uint32_t expected = 0;
+	if (atomic_compare_exchange_strong_uint32_t(&locks_state, &expected, 1)) {
+		tm_os_api->thread->create_critical_section(&load_lock);
+		tm_os_api->thread->create_critical_section(&requests_lock);
+		atomic_store_uint32_t(&locks_state, 2);
+	}
+
+	while (atomic_load_uint32_t(&locks_state) != 2)
+		tm_os_api->thread->yield_processor();
+}
+
+// Databases and manifests found by `private__search_symbols()`.
+typedef struct private__found_t
+{
+	tm_symbol_database_t *databases;
+	// Allocated with `allocator`.
+	char **manifest_paths;
+} private__found_t;
+
+static bool private__is_loaded(const char *path, const private__symbols_t *loaded, const tm_symbol_database_t *found)
+{
+	for (uint32_t i = 0; i < loaded->database_count; ++i) {
+		if (!strcmp(path, loaded->databases[i].path))
+			return true;
+	}
+	for (uint64_t i = 0; i < tm_carray_size(found); ++i) {
+		if (!strcmp(path, found[i].path))
+			return true;
+	}
+	return false;
+}
+
+// Remembers the manifest to load it with `private__load_shards()`, unless it's loaded, failed or found already.
+static void private__found_manifest(const char *manifest_path, const private__symbols_t *loaded, private__found_t *found)
+{
+	for (uint32_t i = 0; i < loaded->shard_set_count; ++i) {
+		if (!strcmp(manifest_path, loaded->shard_sets[i].manifest_path))
+			return;
+	}
+	for (uint64_t i = 0; i < tm_carray_size(failed_manifests); ++i) {
+		if (!strcmp(manifest_path, failed_manifests[i]))
+			return;
+	}
+	for (uint64_t i = 0; i < tm_carray_size(found->manifest_paths); ++i) {
+		if (!strcmp(manifest_path, found->manifest_paths[i]))
+			return;
+	}
+
+	const size_t path_size = strlen(manifest_path) + 1;
+	char *copy = tm_alloc(allocator, path_size);
+	memcpy(copy, manifest_path, path_size);
+	tm_carray_push(found->manifest_paths, copy, allocator);
 }
 
-static void api__search_symbols(const char *path)
+// Opens the databases at or below `path` that aren't loaded yet and pushes them to `found`. Shards are left to their manifest.
+static void private__search_symbols(const char *path, const private__symbols_t *loaded, private__found_t *found)
 {
 	const tm_file_stat_t stat = tm_os_api->file_system->stat(path);
-	const size_t old_symbols_size = tm_carray_size(trees);
 
 	if (!stat.exists) return;
 	else if (stat.is_directory) {
@@ -46,7 +189,7 @@ static void api__search_symbols(const char *path)
 				continue;
 
 			if (!strcmp(path, "."))
-				api__search_symbols(string);
+				private__search_symbols(string, loaded, found);
 			else {
 				const size_t string_len = strlen(string);
 				char *joined = ta->realloc(ta->inst, NULL, 0, path_len + string_len + 2);
@@ -54,7 +197,7 @@ static void api__search_symbols(const char *path)
 				joined[path_len] = '/';
 				strcpy(joined + path_len + 1, string);
 
-				api__search_symbols(joined);
+				private__search_symbols(joined, loaded, found);
 				ta->realloc(ta->inst, joined, path_len + string_len + 2, 0);
 			}
 		}
@@ -64,154 +207,880 @@ static void api__search_symbols(const char *path)
 	else {
 		const char *ext = 0;
 		tm_path_api->split(path, &ext);
-		if (!strcmp(ext, ".hdb")) {
-			size_t i = 0;
-			for (; i < old_symbols_size; ++i) {
-				if (!strcmp(path, files[i]))
-					break;
+		TM_INIT_TEMP_ALLOCATOR(ta);
+		const char *manifest_path = !strcmp(ext, ".hdbm") ? path : !strcmp(ext, ".hdb") ? tm_symbol_manifest_of_shard(ta, path) : 0;
+		const bool in_manifest = manifest_path != 0;
+		if (in_manifest)
+			private__found_manifest(manifest_path, loaded, found);
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+
+		if (!strcmp(ext, ".hdb") && !in_manifest) {
+			if (private__is_loaded(path, loaded, found->databases))
+				return;
+
+			const tm_clock_o start = tm_os_api->time->now();
+			tm_symbol_database_t db;
+			if (tm_symbol_database_open(allocator, path, &db)) {
+				tm_carray_push(found->databases, db, allocator);
+
+				tm_debug_utils_stats_t *stats = &private__stats_block()->counters;
+				++stats->loaded_databases;
+				stats->loaded_bytes += db.file.size;
+				private__stats_record(&stats->load_time, start);
 			}
+		}
+	}
+}
+
+// Loads the shards of a manifest on as many threads as there are shards or logical processors.
+typedef struct private__shard_loader_t
+{
+	const char *manifest_path;
+	const tm_symbol_manifest_t *manifest;
+	tm_symbol_database_t *databases;
+	tm_symbol_global_index_t *indices;
+	private__shared_segment_t *segments;
+	bool *opened;
+	atomic_uint32_t next_shard;
+	// Number of shards that couldn't be opened or don't match the manifest.
+	atomic_uint32_t failed_count;
+} private__shard_loader_t;
+
+// Opens shards and builds their indices until all of them are claimed.
+static void private__shard_load_worker(void *data)
+{
+	private__shard_loader_t *loader = data;
+	const uint32_t shard_count = 1u << loader->manifest->shard_bits;
+	for (uint32_t shard; (shard = atomic_fetch_add_uint32_t(&loader->next_shard, 1)) < shard_count;) {
+		TM_INIT_TEMP_ALLOCATOR(ta);
+		tm_symbol_database_t *db = loader->databases + shard;
+		loader->opened[shard] = tm_symbol_database_open(allocator, tm_symbol_manifest_shard_path(ta, loader->manifest_path, shard), db);
+		if (loader->opened[shard] && tm_symbol_manifest_matches(loader->manifest, shard, db))
+			loader->indices[shard] = private__shared_index_create(allocator, shared_index, true, db, 1, loader->segments + shard);
+		else
+			atomic_fetch_add_uint32_t(&loader->failed_count, 1);
+		TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	}
+}
 
-			if (i == old_symbols_size) {
-				tm_file_o file = tm_os_api->file_io->open_input(path);
+// Loads the shards of the manifest into `set` and pushes them to `shard_databases`. If the manifest can't be read
+// or doesn't match its shards, the shards that could be opened and aren't loaded yet are pushed to `databases` instead
+// and false is returned.
+static bool private__load_shards(const char *manifest_path, const private__symbols_t *loaded, tm_symbol_database_t **shard_databases,
+	tm_symbol_database_t **databases, private__shard_set_t *set)
+{
+	const tm_clock_o start = tm_os_api->time->now();
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	tm_symbol_manifest_t *manifest = tm_temp_alloc(ta, sizeof(tm_symbol_manifest_t));
+	const bool read = tm_symbol_manifest_read(manifest_path, manifest);
+	if (!read)
+		manifest->shard_bits = TM_HDB_MANIFEST_MAX_SHARD_BITS;
 
-				uint32_t flags;
-				tm_os_api->file_io->read(file, &flags, sizeof(uint32_t));
-				if ((flags & TM_HDB_FLAGS_VERSION_MASK) == TM_HDB_FLAGS_VERSION) {
+	const uint32_t shard_count = 1u << manifest->shard_bits;
+	private__shard_loader_t loader = {
+		.manifest_path = manifest_path,
+		.manifest = manifest,
+		.databases = tm_temp_alloc(ta, shard_count * sizeof(tm_symbol_database_t)),
+		.indices = tm_alloc(allocator, shard_count * sizeof(tm_symbol_global_index_t)),
+		.segments = tm_alloc(allocator, shard_count * sizeof(private__shared_segment_t)),
+		.opened = tm_temp_alloc(ta, shard_count * sizeof(bool)),
+	};
+	memset(loader.indices, 0, shard_count * sizeof(tm_symbol_global_index_t));
+	memset(loader.segments, 0, shard_count * sizeof(private__shared_segment_t));
 
-					tm_carray_push(files, private__string_copy(path), allocator);
+	if (read) {
+		const uint32_t thread_count = tm_min(shard_count, tm_max(1, tm_os_api->info->num_logical_processors()));
+		tm_thread_o *threads = tm_temp_alloc(ta, thread_count * sizeof(tm_thread_o));
+		for (uint32_t i = 1; i < thread_count; ++i)
+			threads[i] = tm_os_api->thread->create_thread(private__shard_load_worker, &loader, 256 * 1024, "tm_debug_utils shards");
+		private__shard_load_worker(&loader);
+		for (uint32_t i = 1; i < thread_count; ++i)
+			tm_os_api->thread->wait_for_thread(threads[i]);
+	}
+	else {
+		// Without the manifest the shard count is unknown, so the files next to it that are named like its shards are opened.
+		memset(loader.opened, 0, shard_count * sizeof(bool));
+		const char *manifest_name = tm_path_api->split(manifest_path, NULL);
+		const size_t directory_length = (size_t)(manifest_name - manifest_path), name_length = strlen(manifest_name) - 5;
+		const char *directory = directory_length ? tm_temp_allocator_api->printf(ta, "%.*s", (int)directory_length, manifest_path) : ".";
+		tm_strings_t *entries = tm_os_api->file_system->directory_entries(directory, ta);
+		const char *entry = (const char *)entries + sizeof(tm_strings_t);
+		for (uint32_t i = 0; i < entries->count; ++i, entry += strlen(entry) + 1) {
+			if (strncmp(entry, manifest_name, name_length) || entry[name_length] != '.')
+				continue;
 
-					tm_symbol_tree_t tree;
-					tm_os_api->file_io->read(file, &tree.node_count, sizeof(uint32_t));
+			const uint32_t shard = (uint32_t)strtoul(entry + name_length + 1, NULL, 10);
+			const char *shard_path = shard < shard_count ? tm_symbol_manifest_shard_path(ta, manifest_path, shard) : 0;
+			if (!shard_path || loader.opened[shard] || strcmp(tm_path_api->split(shard_path, NULL), entry))
+				continue;
 
-					tree.nodes = tm_alloc(allocator, tree.node_count * sizeof(tm_symbol_node_t));
-					tm_os_api->file_io->read(file, tree.nodes, tree.node_count * sizeof(tm_symbol_node_t));
-					tm_carray_push(trees, tree, allocator);
+			loader.opened[shard] = !private__is_loaded(shard_path, loaded, *databases)
+				&& tm_symbol_database_open(allocator, shard_path, loader.databases + shard);
+		}
+	}
 
-					if (flags & TM_HDB_FLAGS_COMPRESSED) {
-						tm_huffman_tree_t huffman;
-						tm_os_api->file_io->read(file, &huffman.node_count, sizeof(uint32_t));
-						huffman.nodes = tm_alloc(allocator, huffman.node_count * sizeof(tm_huffman_node_t));
-						tm_os_api->file_io->read(file, huffman.nodes, huffman.node_count * sizeof(tm_huffman_node_t));
-						tm_carray_push(decoding, huffman, allocator);
-					}
-					else {
-						tm_carray_push(decoding, (tm_huffman_tree_t) { 0 }, allocator);
-					}
-				}
+	const bool succeeded = read && !atomic_load_uint32_t(&loader.failed_count);
+	if (succeeded)
+		*set = (private__shard_set_t) { .manifest_path = (char *)manifest_path, .indices = loader.indices, .segments = loader.segments, .shard_bits = manifest->shard_bits, .first_database = (uint32_t)tm_carray_size(*shard_databases) };
+	else {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: '%s' %s, its shards are loaded as separate databases\n", manifest_path,
+			read ? "doesn't match its shards" : "isn't a valid manifest");
+		for (uint32_t shard = 0; shard < shard_count; ++shard)
+			private__shared_index_free(allocator, loader.indices + shard, loader.segments + shard);
+		tm_free(allocator, loader.indices, shard_count * sizeof(tm_symbol_global_index_t));
+		tm_free(allocator, loader.segments, shard_count * sizeof(private__shared_segment_t));
+	}
 
-				tm_os_api->file_io->close(file);
-			}
+	tm_debug_utils_stats_t *stats = &private__stats_block()->counters;
+	for (uint32_t shard = 0; shard < shard_count; ++shard) {
+		// Shards that were loaded as separate databases before, like the ones of a manifest that was written later, aren't loaded twice.
+		if (loader.opened[shard] && !succeeded && read && private__is_loaded(tm_symbol_manifest_shard_path(ta, manifest_path, shard), loaded, *databases)) {
+			tm_symbol_database_close(allocator, loader.databases + shard);
+			loader.opened[shard] = false;
+		}
+		if (loader.opened[shard]) {
+			tm_carray_push(*(succeeded ? shard_databases : databases), loader.databases[shard], allocator);
+			++stats->loaded_databases;
+			stats->loaded_bytes += loader.databases[shard].file.size;
+		}
+	}
+	private__stats_record(&stats->load_time, start);
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+	return succeeded;
+}
+
+// Frees the set, but not the databases and the shard sets, which are shared with the set that replaced it.
+static void private__symbols_free(private__symbols_t *symbols)
+{
+	private__shared_index_free(allocator, &symbols->index, &symbols->index_segment);
+	tm_free(allocator, symbols->databases, symbols->database_count * sizeof(tm_symbol_database_t));
+	if (symbols->shard_set_count)
+		tm_free(allocator, symbols->shard_sets, symbols->shard_set_count * sizeof(private__shard_set_t));
+	tm_free(allocator, symbols, sizeof(private__symbols_t));
+}
+
+// Frees the retired sets no thread can be using anymore. Must hold `load_lock`.
+static void private__free_retired_symbols(void)
+{
+	uint64_t oldest = UINT64_MAX;
+	for (private__stats_block_t *block = (private__stats_block_t *)atomic_load_uint64_t(&stats_blocks); block; block = block->next) {
+		const uint64_t epoch = atomic_load_uint64_t(&block->symbols_epoch);
+		if (epoch)
+			oldest = tm_min(oldest, epoch);
+	}
+
+	for (private__symbols_t **retired = &retired_symbols; *retired;) {
+		private__symbols_t *symbols = *retired;
+		if (symbols->retired_epoch <= oldest) {
+			*retired = symbols->next_retired;
+			private__symbols_free(symbols);
 		}
+		else
+			retired = &symbols->next_retired;
 	}
 }
 
-static const char *api__decode_hash(uint64_t hash, tm_temp_allocator_i *ta)
+// True if paths added with `add_symbol_database_async()` are still to be searched. Must hold `load_lock`.
+static bool private__requests_pending(void)
+{
+	bool pending = false;
+	tm_os_api->thread->enter_critical_section(&requests_lock);
+	for (uint64_t i = 0; i < tm_carray_size(load_requests) && !pending; ++i)
+		pending = !load_requests[i]->claimed;
+	tm_os_api->thread->leave_critical_section(&requests_lock);
+	return pending;
+}
+
+// Copies `count` databases from `first` on to `db` and returns the end of the copies. The arrays are null if they're empty.
+static tm_symbol_database_t *private__copy_databases(tm_symbol_database_t *db, const tm_symbol_database_t *databases, uint32_t first, uint32_t count)
+{
+	if (count)
+		memcpy(db, databases + first, count * sizeof(tm_symbol_database_t));
+	return db + count;
+}
+
+// Searches the path and publishes the databases that were found together with the loaded ones. Must hold `load_lock`.
+static void private__load_symbols(const char *path)
 {
-	if (!trees)
-		api__search_symbols("../../");
+	const private__symbols_t *loaded = private__symbols();
+	private__found_t found = { 0 };
+	private__search_symbols(path, loaded, &found);
 
-	uint32_t node_idx;
-	if (tm_symbol_tree_try_search(&runtime_tree, hash, &node_idx)) {
-		const tm_symbol_node_t *node = runtime_tree.nodes + node_idx;
-		char *buffer = tm_temp_alloc(ta, node->string_length + 1ull);
-		memcpy(buffer, runtime_strings + node->string_start, node->string_length);
-		buffer[node->string_length] = '\0';
-		return buffer;
+	tm_symbol_database_t *shards = 0;
+	private__shard_set_t *shard_sets = 0;
+	for (uint64_t i = 0; i < tm_carray_size(found.manifest_paths); ++i) {
+		private__shard_set_t set;
+		if (private__load_shards(found.manifest_paths[i], loaded, &shards, &found.databases, &set))
+			tm_carray_push(shard_sets, set, allocator);
+		else
+			tm_carray_push(failed_manifests, found.manifest_paths[i], allocator);
 	}
 
-	const size_t db_size = tm_carray_size(trees);
-	for (size_t i = 0; i < db_size; ++i) {
+	const uint32_t found_count = (uint32_t)tm_carray_size(found.databases);
+	const uint32_t shard_count = (uint32_t)tm_carray_size(shards), found_set_count = (uint32_t)tm_carray_size(shard_sets);
+	if (found_count || found_set_count) {
+		const tm_clock_o start = tm_os_api->time->now();
+		const uint32_t count = loaded->database_count + found_count + shard_count;
+		const uint32_t set_count = loaded->shard_set_count + found_set_count;
+		private__symbols_t *symbols = tm_alloc(allocator, sizeof(private__symbols_t));
+		*symbols = (private__symbols_t) {
+			.databases = tm_alloc(allocator, count * sizeof(tm_symbol_database_t)),
+			.database_count = count,
+			.plain_database_count = loaded->plain_database_count + found_count,
+			.shard_sets = set_count ? tm_alloc(allocator, set_count * sizeof(private__shard_set_t)) : 0,
+			.shard_set_count = set_count,
+		};
 
-		if (tm_symbol_tree_try_search(trees + i, hash, &node_idx))
-		{
-			tm_file_o file = tm_os_api->file_io->open_input(files[i]);
-			const tm_symbol_node_t *node = trees[i].nodes + node_idx;
+		// The found databases go after the loaded ones that aren't shards, which moves the loaded shards back.
+		const uint32_t loaded_shard_count = loaded->database_count - loaded->plain_database_count;
+		tm_symbol_database_t *db = symbols->databases;
+		db = private__copy_databases(db, loaded->databases, 0, loaded->plain_database_count);
+		db = private__copy_databases(db, found.databases, 0, found_count);
+		db = private__copy_databases(db, loaded->databases, loaded->plain_database_count, loaded_shard_count);
+		private__copy_databases(db, shards, 0, shard_count);
+		for (uint32_t i = 0; i < loaded->shard_set_count; ++i) {
+			symbols->shard_sets[i] = loaded->shard_sets[i];
+			symbols->shard_sets[i].first_database += found_count;
+		}
+		for (uint32_t i = 0; i < found_set_count; ++i) {
+			symbols->shard_sets[loaded->shard_set_count + i] = shard_sets[i];
+			symbols->shard_sets[loaded->shard_set_count + i].first_database += loaded->database_count + found_count;
+		}
 
-			char *buffer;
-			uint64_t string_length;
+		// The index over the databases found so far is only shared with other processes once no more searches are pending,
+		// the indices of the shards don't change as more databases are found.
+		if (symbols->plain_database_count)
+			symbols->index = private__shared_index_create(allocator, shared_index, !private__requests_pending(), symbols->databases, symbols->plain_database_count, &symbols->index_segment);
 
-			if (decoding[i].node_count) {
-				const uint64_t encoded_end = (node->string_start & 7) + node->string_length;
-				const uint64_t encoded_length = (node->string_length >> 3) + 1ull;
+		atomic_store_uint64_t(&loaded_symbols, (uint64_t)symbols);
+		if (loaded != &no_symbols) {
+			private__symbols_t *retired = (private__symbols_t *)loaded;
+			retired->retired_epoch = atomic_fetch_add_uint64_t(&symbols_epoch, 1) + 1;
+			retired->next_retired = retired_symbols;
+			retired_symbols = retired;
+		}
+		private__free_retired_symbols();
+		private__stats_record(&private__stats_block()->counters.index_time, start);
+	}
 
-				char *code_buffer = tm_temp_alloc(ta, encoded_length);
-				tm_os_api->file_io->read_at(file, node->string_start >> 3, code_buffer, encoded_length);
+	tm_carray_free(found.databases, allocator);
+	tm_carray_free(found.manifest_paths, allocator);
+	tm_carray_free(shards, allocator);
+	tm_carray_free(shard_sets, allocator);
+}
 
-				uint64_t offset = node->string_start & 7;
-				buffer = tm_temp_alloc(ta, encoded_length);
-				for (string_length = 0; offset < encoded_end; ++string_length)
-					buffer[string_length] = tm_huffman_tree_decode(decoding + i, code_buffer, &offset);
+static void api__add_symbol_database(const char *path)
+{
+	private__create_locks();
+	atomic_store_uint32_t(&search_started, 1);
 
-				ta->realloc(ta->inst, code_buffer, encoded_length, 0);
-				ta->realloc(ta->inst, buffer, encoded_length, string_length);
-			} else {
-				string_length = node->string_length;
-				buffer = tm_temp_alloc(ta, string_length + 1);
-				tm_os_api->file_io->read_at(file, node->string_start, buffer, string_length);
-			}
+	tm_os_api->thread->enter_critical_section(&load_lock);
+	private__load_symbols(path);
+	tm_os_api->thread->leave_critical_section(&load_lock);
+}
+
+// Searches the path of the request unless another thread already did, in which case it's done since this one got the lock.
+static void private__complete_request(private__load_request_t *request)
+{
+	tm_os_api->thread->enter_critical_section(&load_lock);
+	if (!request->claimed) {
+		request->claimed = true;
+		private__load_symbols(request->path);
+	}
+	tm_os_api->thread->leave_critical_section(&load_lock);
+}
+
+static void private__load_thread(void *user_data)
+{
+	private__complete_request(user_data);
+}
 
-			tm_os_api->file_io->close(file);
-			buffer[string_length] = '\0';
-			return buffer;
+static void api__add_symbol_database_async(const char *path)
+{
+	private__create_locks();
+	atomic_store_uint32_t(&search_started, 1);
+
+	private__load_request_t *request = tm_alloc(allocator, sizeof(private__load_request_t));
+	const size_t path_size = strlen(path) + 1;
+	*request = (private__load_request_t) { .path = tm_alloc(allocator, path_size) };
+	memcpy(request->path, path, path_size);
+
+	tm_os_api->thread->enter_critical_section(&requests_lock);
+	tm_carray_push(load_requests, request, allocator);
+	request->thread = tm_os_api->thread->create_thread(private__load_thread, request, 256 * 1024, "tm_debug_utils symbols");
+	tm_os_api->thread->leave_critical_section(&requests_lock);
+}
+
+static void api__wait_for_symbol_databases(const char *path)
+{
+	private__create_locks();
+
+	TM_INIT_TEMP_ALLOCATOR(ta);
+	private__load_request_t **requests = 0;
+	tm_os_api->thread->enter_critical_section(&requests_lock);
+	for (uint64_t i = 0; i < tm_carray_size(load_requests); ++i) {
+		if (!path || !strcmp(path, load_requests[i]->path))
+			tm_carray_temp_push(requests, load_requests[i], ta);
+	}
+	tm_os_api->thread->leave_critical_section(&requests_lock);
+
+	// Searching a path that wasn't claimed yet right away is faster than waiting for its thread to get to it.
+	for (uint64_t i = 0; i < tm_carray_size(requests); ++i)
+		private__complete_request(requests[i]);
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Starts searching the default path in the background, unless databases were added or searched for before.
+static void private__start_default_search(void)
+{
+	uint32_t expected = 0;
+	if (atomic_compare_exchange_strong_uint32_t(&search_started, &expected, 1) && *TM_DEBUG_UTILS_DEFAULT_SEARCH_PATH)
+		api__add_symbol_database_async(TM_DEBUG_UTILS_DEFAULT_SEARCH_PATH);
+}
+
+// Finds the hash through the global index, then in the shard it belongs to of every shard set. Databases that aren't
+// shards take precedence for duplicate hashes, then earlier shard sets.
+static inline bool private__symbols_search(const private__symbols_t *symbols, uint64_t hash, uint32_t *db_idx, uint32_t *entry_idx, uint32_t *probes)
+{
+	if (tm_symbol_global_index_try_search(&symbols->index, hash, db_idx, entry_idx, probes))
+		return true;
+
+	for (uint32_t i = 0; i < symbols->shard_set_count; ++i) {
+		const private__shard_set_t *set = symbols->shard_sets + i;
+		const uint32_t shard = tm_symbol_manifest_shard(set->shard_bits, hash);
+		if (tm_symbol_global_index_try_search(set->indices + shard, hash, db_idx, entry_idx, probes)) {
+			*db_idx = set->first_database + shard;
+			return true;
 		}
 	}
+	return false;
+}
+
+static inline void private__symbols_prefetch(const private__symbols_t *symbols, uint64_t hash)
+{
+	tm_symbol_global_index_prefetch(&symbols->index, hash);
+	for (uint32_t i = 0; i < symbols->shard_set_count; ++i)
+		tm_symbol_global_index_prefetch(symbols->shard_sets[i].indices + tm_symbol_manifest_shard(symbols->shard_sets[i].shard_bits, hash), hash);
+}
+
+// Result of looking up a hash, either in the runtime database (`db` is null) or in a loaded database.
+typedef struct private__hash_location_t
+{
+	uint64_t hash;
+	const tm_symbol_database_t *db;
+	// Used instead of `entry_idx` for strings from the runtime database.
+	const char *runtime_string;
+	uint32_t runtime_length;
+	uint32_t entry_idx;
+} private__hash_location_t;
+
+// The location points into the loaded set, so the caller must call `private__symbols_leave()` once it's done with it,
+// whether the hash was found or not.
+static bool private__find_hash(uint64_t hash, private__hash_location_t *location)
+{
+	if (!atomic_load_uint32_t(&search_started))
+		private__start_default_search();
+
+	private__stats_block_t *block = private__stats_block();
+	const private__symbols_t *symbols = private__symbols_enter(block);
+	const bool timed = private__stats_sample(&block->lookup_count);
+	const tm_clock_o start = timed ? tm_os_api->time->now() : (tm_clock_o) { 0 };
+
+	bool found = true;
+	uint32_t db_idx, probes = 0;
+	location->hash = hash;
+	if (tm_intern_table_find(&runtime_table, hash, &location->runtime_string, &location->runtime_length)) {
+		location->db = 0;
+		++block->counters.runtime_hits;
+	}
+	else if (private__symbols_search(symbols, hash, &db_idx, &location->entry_idx, &probes)) {
+		location->db = symbols->databases + db_idx;
+		private__stats_database_hit(&block->counters, db_idx);
+	}
+	else {
+		found = false;
+		++block->counters.misses;
+	}
 
-	return 0;
+	if (timed) {
+		private__stats_probes(&block->counters, probes);
+		private__stats_record(&block->counters.lookup_time, start);
+	}
+	return found;
+}
+
+// Returns the string in place if it's stored as is, otherwise null.
+static const char *private__view(const private__hash_location_t *location, uint32_t *length)
+{
+	if (!location->db) {
+		*length = location->runtime_length;
+		return location->runtime_string;
+	}
+
+	return tm_symbol_database_view(location->db, location->entry_idx, length);
+}
+
+static uint32_t private__decode(const private__hash_location_t *location, char *buffer, uint32_t buffer_size)
+{
+	uint32_t length;
+	const char *view = private__view(location, &length);
+	if (view) {
+		memcpy(buffer, view, tm_min(length, buffer_size));
+		return length;
+	}
+
+	private__stats_block_t *block = private__stats_block();
+	if (private__cache_find(&decode_cache, location->hash, buffer, buffer_size, &length)) {
+		++block->counters.cache_hits;
+		return length;
+	}
+
+	++block->counters.cache_misses;
+	const bool timed = private__stats_sample(&block->decode_count);
+	const tm_clock_o start = timed ? tm_os_api->time->now() : (tm_clock_o) { 0 };
+	length = tm_symbol_database_decode(location->db, location->entry_idx, buffer, buffer_size);
+	block->counters.decoded_bytes += tm_min(length, buffer_size);
+	if (timed)
+		private__stats_record(&block->counters.decode_time, start);
+
+	// Truncated strings can't be cached, `private__copy_string()` decodes long strings again with a large enough buffer.
+	if (length <= buffer_size)
+		block->counters.cache_evictions += private__cache_insert(&decode_cache, location->hash, buffer, length);
+	return length;
+}
+
+// Writes the hash in the same form as `printf("%llx")`, returns the number of characters.
+static uint32_t private__hash_to_hex(uint64_t hash, char *buffer)
+{
+	char digits[16];
+	uint32_t count = 0;
+	do {
+		digits[count++] = "0123456789abcdef"[hash & 0xF];
+		hash >>= 4;
+	} while (hash);
+
+	for (uint32_t i = 0; i < count; ++i)
+		buffer[i] = digits[count - i - 1];
+
+	return count;
+}
+
+// Copies the string into an allocation of the exact size.
+static const char *private__copy_string(const private__hash_location_t *location, tm_temp_allocator_i *ta)
+{
+	// Most strings are short, so decode on the stack first to allocate the exact size.
+	char scratch[256];
+	uint32_t length;
+	const char *source = private__view(location, &length);
+	if (!source) {
+		length = private__decode(location, scratch, sizeof(scratch));
+		source = scratch;
+	}
+
+	char *buffer = tm_temp_alloc(ta, length + 1ull);
+	if (length <= sizeof(scratch) || source != scratch)
+		memcpy(buffer, source, length);
+	else
+		private__decode(location, buffer, length);
+
+	buffer[length] = '\0';
+	return buffer;
+}
+
+static const char *api__decode_hash(uint64_t hash, tm_temp_allocator_i *ta)
+{
+	private__hash_location_t location;
+	const char *result = private__find_hash(hash, &location) ? private__copy_string(&location, ta) : 0;
+	private__symbols_leave(private__stats_block());
+	return result;
 }
 
 static const char *api__try_decode_hash(uint64_t hash, tm_temp_allocator_i *ta)
 {
 	const char *result = api__decode_hash(hash, ta);
-	if (!result) result = tm_temp_allocator_api->printf(ta, "%llx", hash);
+	if (!result) {
+		char *buffer = tm_temp_alloc(ta, 17);
+		buffer[private__hash_to_hex(hash, buffer)] = '\0';
+		result = buffer;
+	}
+
+	return result;
+}
+
+static uint32_t api__decode_hash_to_buffer(uint64_t hash, char *buffer, uint32_t buffer_size)
+{
+	if (!buffer_size)
+		return 0;
+
+	private__hash_location_t location;
+	const bool found = private__find_hash(hash, &location);
+	const uint32_t length = found ? private__decode(&location, buffer, buffer_size - 1) : 0;
+	private__symbols_leave(private__stats_block());
+	if (found)
+		buffer[tm_min(length, buffer_size - 1)] = '\0';
+	return length;
+}
+
+static uint32_t api__try_decode_hash_to_buffer(uint64_t hash, char *buffer, uint32_t buffer_size)
+{
+	const uint32_t length = api__decode_hash_to_buffer(hash, buffer, buffer_size);
+	if (length || !buffer_size)
+		return length;
+
+	char hex[16];
+	const uint32_t hex_length = private__hash_to_hex(hash, hex);
+	memcpy(buffer, hex, tm_min(hex_length, buffer_size - 1));
+	buffer[tm_min(hex_length, buffer_size - 1)] = '\0';
+	return hex_length;
+}
+
+static tm_debug_utils_string_view_t api__decode_hash_view(uint64_t hash)
+{
+	private__hash_location_t location;
+	tm_debug_utils_string_view_t result = { 0 };
+	if (private__find_hash(hash, &location))
+		result.data = private__view(&location, &result.size);
+	private__symbols_leave(private__stats_block());
+
+	if (!result.data)
+		result.size = 0;
+
 	return result;
 }
 
+// Number of lookups the batch functions keep in flight, their slots are prefetched before any of them is resolved.
+#define LOOKUP_BATCH_SIZE 16
+
+// Hits are sorted by database and then by the position of their string, packed into a single key.
+// The position is masked, so one that a corrupt database points past its file can't change the database of the key.
+typedef struct private__batch_hit_t
+{
+	uint64_t key;
+	uint32_t entry_idx;
+	uint32_t result_idx;
+} private__batch_hit_t;
+
+#define private__batch_key(db_idx, string_start)	(((uint64_t)(db_idx) << 48) | ((string_start) & ((1ull << 48) - 1)))
+#define private__batch_key__db(key)					((key) >> 48)
+
+// LSD radix sort on the keys, one byte per pass. Passes where all keys share the same byte are skipped,
+// so typically only the few bytes covering the string offsets are sorted.
+static private__batch_hit_t *private__sort_hits(private__batch_hit_t *hits, private__batch_hit_t *scratch, uint32_t count)
+{
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		uint32_t offsets[256] = { 0 };
+		for (uint32_t i = 0; i < count; ++i)
+			++offsets[(hits[i].key >> shift) & 0xFF];
+
+		if (count && offsets[(hits[0].key >> shift) & 0xFF] == count)
+			continue;
+
+		for (uint32_t i = 0, sum = 0; i < 256; ++i) {
+			const uint32_t bucket_size = offsets[i];
+			offsets[i] = sum;
+			sum += bucket_size;
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+			scratch[offsets[(hits[i].key >> shift) & 0xFF]++] = hits[i];
+
+		private__batch_hit_t *tmp = hits;
+		hits = scratch;
+		scratch = tmp;
+	}
+
+	return hits;
+}
+
+static uint32_t api__decode_hashes(const uint64_t *hashes, uint32_t count, const char **results, tm_temp_allocator_i *ta)
+{
+	if (!atomic_load_uint32_t(&search_started))
+		private__start_default_search();
+
+	private__stats_block_t *block = private__stats_block();
+	const private__symbols_t *symbols = private__symbols_enter(block);
+	tm_debug_utils_stats_t *stats = &block->counters;
+	TM_INIT_TEMP_ALLOCATOR(hits_ta);
+	private__batch_hit_t *hits = tm_temp_alloc(hits_ta, count * sizeof(private__batch_hit_t));
+	uint32_t hit_count = 0, found = 0;
+
+	// Advance the lookups in lockstep so the cache misses of a batch overlap instead of stalling one after another.
+	for (uint32_t batch = 0; batch < count; batch += LOOKUP_BATCH_SIZE) {
+		const uint32_t batch_end = tm_min(batch + LOOKUP_BATCH_SIZE, count);
+		for (uint32_t i = batch; i < batch_end; ++i)
+			private__symbols_prefetch(symbols, hashes[i]);
+
+		for (uint32_t i = batch; i < batch_end; ++i) {
+			results[i] = 0;
+			private__hash_location_t location;
+
+			if (tm_intern_table_find(&runtime_table, hashes[i], &location.runtime_string, &location.runtime_length)) {
+				location.db = 0;
+				results[i] = private__copy_string(&location, ta);
+				++found;
+				++stats->runtime_hits;
+			}
+			else {
+				uint32_t db_idx, probes = 0;
+				if (private__symbols_search(symbols, hashes[i], &db_idx, &location.entry_idx, &probes)) {
+					hits[hit_count++] = (private__batch_hit_t) {
+						.key = private__batch_key(db_idx, symbols->databases[db_idx].index.string_starts[location.entry_idx]),
+						.entry_idx = location.entry_idx,
+						.result_idx = i
+					};
+					private__stats_database_hit(stats, db_idx);
+				}
+				else
+					++stats->misses;
+			}
+		}
+	}
+
+	// Decode grouped by database and in file order, so each string blob is read in one sequential pass.
+	private__batch_hit_t *scratch = tm_temp_alloc(hits_ta, hit_count * sizeof(private__batch_hit_t));
+	const private__batch_hit_t *sorted = private__sort_hits(hits, scratch, hit_count);
+	for (uint32_t i = 0; i < hit_count; ++i) {
+		const private__hash_location_t location = {
+			.hash = hashes[sorted[i].result_idx],
+			.db = symbols->databases + private__batch_key__db(sorted[i].key),
+			.entry_idx = sorted[i].entry_idx
+		};
+		results[sorted[i].result_idx] = private__copy_string(&location, ta);
+	}
+	private__symbols_leave(block);
+
+	TM_SHUTDOWN_TEMP_ALLOCATOR(hits_ta);
+	return found + hit_count;
+}
+
 static uint64_t api__add_hash(const char *string)
 {
 	const uint64_t hash = tm_murmur_hash_string_inline(string);
+	const uint32_t length = (uint32_t)strlen(string);
+	if (tm_intern_table_insert(&runtime_table, allocator, hash, string, length))
+		private__journal_append(&runtime_journal, hash, string, length);
+	return hash;
+}
+
+static void api__add_hashes(const char **strings, uint32_t count, uint64_t *hashes)
+{
+	// Like `decode_hashes()`, hash a batch and prefetch its slots before inserting any of it.
+	uint64_t batch_hashes[LOOKUP_BATCH_SIZE];
+	uint32_t batch_lengths[LOOKUP_BATCH_SIZE];
+	for (uint32_t batch = 0; batch < count; batch += LOOKUP_BATCH_SIZE) {
+		const uint32_t batch_count = tm_min(LOOKUP_BATCH_SIZE, count - batch);
+		for (uint32_t i = 0; i < batch_count; ++i) {
+			batch_lengths[i] = (uint32_t)strlen(strings[batch + i]);
+			batch_hashes[i] = tm_murmur_hash_inline(strings[batch + i], (int)batch_lengths[i], 0);
+			tm_intern_table_prefetch(&runtime_table, batch_hashes[i]);
+		}
 
-	if (!tm_symbol_tree_contains(&runtime_tree, hash)) {
-		const uint32_t length = (uint32_t)strlen(string);
-		tm_symbol_tree_insert(allocator, &runtime_tree, hash, runtime_buffer_size, length);
+		for (uint32_t i = 0; i < batch_count; ++i) {
+			if (tm_intern_table_insert(&runtime_table, allocator, batch_hashes[i], strings[batch + i], batch_lengths[i]))
+				private__journal_append(&runtime_journal, batch_hashes[i], strings[batch + i], batch_lengths[i]);
+		}
 
-		const size_t new_size = runtime_buffer_size + length;
-		runtime_strings = tm_realloc(allocator, runtime_strings, runtime_buffer_size, new_size);
-		memcpy(runtime_strings + runtime_buffer_size, string, length);
-		runtime_buffer_size = new_size;
+		if (hashes)
+			memcpy(hashes + batch, batch_hashes, batch_count * sizeof(uint64_t));
 	}
+}
 
-	return hash;
+// Matches of `find_hashes()`. Lookups of a hash only ever return one string, so a hash is only reported for the runtime
+// database or the database lookups resolve it to, even if other loaded databases contain it too.
+typedef struct private__find_t
+{
+	const private__symbols_t *symbols;
+	const char *query;
+	uint32_t query_length;
+	bool substring;
+	TM_PAD(3);
+	uint64_t *hashes;
+	uint32_t max_hashes;
+	uint32_t count;
+} private__find_t;
+
+static inline void private__find_add(private__find_t *find, uint64_t hash)
+{
+	if (find->count < find->max_hashes)
+		find->hashes[find->count] = hash;
+	++find->count;
+}
+
+static void private__find_database_match(void *user_data, const tm_symbol_database_t *db, uint32_t entry_idx)
+{
+	private__find_t *find = user_data;
+	const uint64_t hash = db->index.hashes[entry_idx];
+	const char *string;
+	uint32_t length, db_idx, found_idx, probes = 0;
+	if (!tm_intern_table_find(&runtime_table, hash, &string, &length) && private__symbols_search(find->symbols, hash, &db_idx, &found_idx, &probes)
+		&& find->symbols->databases + db_idx == db)
+		private__find_add(find, hash);
+}
+
+static void private__find_runtime_match(void *user_data, uint64_t hash, const char *string, uint32_t length)
+{
+	private__find_t *find = user_data;
+	const bool matches = find->substring ? private__symbol_database_contains(string, length, find->query, find->query_length)
+		: length >= find->query_length && !memcmp(string, find->query, find->query_length);
+
+	// Only the copy lookups find is reported.
+	const char *found;
+	uint32_t found_length;
+	if (matches && tm_intern_table_find(&runtime_table, hash, &found, &found_length) && found == string)
+		private__find_add(find, hash);
+}
+
+static uint32_t api__find_hashes(const char *query, bool substring, uint64_t *hashes, uint32_t max_hashes)
+{
+	if (!atomic_load_uint32_t(&search_started))
+		private__start_default_search();
+
+	private__stats_block_t *block = private__stats_block();
+	private__find_t find = {
+		.symbols = private__symbols_enter(block),
+		.query = query,
+		.query_length = (uint32_t)strlen(query),
+		.substring = substring,
+		.hashes = hashes,
+		.max_hashes = max_hashes,
+	};
+
+	tm_intern_table_visit(&runtime_table, private__find_runtime_match, &find);
+	for (uint32_t i = 0; i < find.symbols->database_count; ++i)
+		tm_symbol_database_find(allocator, find.symbols->databases + i, find.query, find.query_length, substring, private__find_database_match, &find);
+	private__symbols_leave(block);
+	return find.count;
+}
+
+static void api__get_stats(tm_debug_utils_stats_t *stats, bool reset)
+{
+	private__stats_snapshot(stats, reset);
+	private__stats_block_t *block = private__stats_block();
+	stats->database_count = private__symbols_enter(block)->database_count;
+	private__symbols_leave(block);
+}
+
+static void api__set_decode_cache_size(uint64_t bytes)
+{
+	private__cache_reset(&decode_cache, bytes);
+}
+
+static bool api__set_runtime_journal(const char *path)
+{
+	private__create_locks();
+
+	tm_os_api->thread->enter_critical_section(&load_lock);
+	private__journal_close(&runtime_journal);
+	const bool opened = !path || private__journal_open(&runtime_journal, &runtime_table, path);
+	tm_os_api->thread->leave_critical_section(&load_lock);
+	return opened;
+}
+
+// Sharing needs POSIX shared memory, see shared_index.inl.
+static bool api__set_shared_index(bool shared)
+{
+#if defined(TM_OS_POSIX)
+	private__create_locks();
+
+	tm_os_api->thread->enter_critical_section(&load_lock);
+	shared_index = shared;
+	tm_os_api->thread->leave_critical_section(&load_lock);
+	return true;
+#else
+	return !shared;
+#endif
 }
 
 struct tm_debug_utils_api *tm_debug_utils_api = &(struct tm_debug_utils_api)
 {
-	.add_symbol_database = api__search_symbols,
+	.add_symbol_database = api__add_symbol_database,
+	.add_symbol_database_async = api__add_symbol_database_async,
+	.wait_for_symbol_databases = api__wait_for_symbol_databases,
 	.decode_hash = api__decode_hash,
 	.try_decode_hash = api__try_decode_hash,
-	.add_hash = api__add_hash
+	.add_hash = api__add_hash,
+	.decode_hash_to_buffer = api__decode_hash_to_buffer,
+	.try_decode_hash_to_buffer = api__try_decode_hash_to_buffer,
+	.decode_hash_view = api__decode_hash_view,
+	.decode_hashes = api__decode_hashes,
+	.find_hashes = api__find_hashes,
+	.add_hashes = api__add_hashes,
+	.get_stats = api__get_stats,
+	.set_decode_cache_size = api__set_decode_cache_size,
+	.set_runtime_journal = api__set_runtime_journal,
+	.set_shared_index = api__set_shared_index
 };
 
-TM_DLL_EXPORT void tm_load_plugin(struct tm_api_registry_api *reg, bool load)
+// Waits for the background searches, closes all databases and the runtime journal, empties the runtime database and
+// the decode cache and drops the statistics. No other thread may use the API while or after it's unloaded.
+static void private__unload(void)
 {
-	tm_set_or_remove_api(reg, load, TM_DEBUG_UTILS_API_NAME, tm_debug_utils_api);
+	private__journal_close(&runtime_journal);
 
-	if (!load) {
-		const size_t db_size = tm_carray_size(trees);
-		for (size_t i = 0; i < db_size; ++i) {
-			tm_free(allocator, files[i], strlen(files[i]) + 1);
-			tm_symbol_tree_free(allocator, trees + i);
-		}
+	for (uint64_t i = 0; i < tm_carray_size(load_requests); ++i) {
+		private__load_request_t *request = load_requests[i];
+		tm_os_api->thread->wait_for_thread(request->thread);
+		tm_free(allocator, request->path, strlen(request->path) + 1);
+		tm_free(allocator, request, sizeof(private__load_request_t));
+	}
+	tm_carray_free(load_requests, allocator);
+	load_requests = 0;
+	for (uint64_t i = 0; i < tm_carray_size(failed_manifests); ++i)
+		tm_free(allocator, failed_manifests[i], strlen(failed_manifests[i]) + 1);
+	tm_carray_free(failed_manifests, allocator);
+	failed_manifests = 0;
+
+	// The last set holds all databases, the retired ones hold copies of some of them.
+	private__symbols_t *symbols = (private__symbols_t *)atomic_load_uint64_t(&loaded_symbols);
+	for (uint32_t i = 0; symbols && i < symbols->database_count; ++i)
+		tm_symbol_database_close(allocator, symbols->databases + i);
+	for (uint32_t i = 0; symbols && i < symbols->shard_set_count; ++i) {
+		private__shard_set_t *set = symbols->shard_sets + i;
+		for (uint32_t shard = 0; shard < 1u << set->shard_bits; ++shard)
+			private__shared_index_free(allocator, set->indices + shard, set->segments + shard);
+		tm_free(allocator, set->indices, sizeof(tm_symbol_global_index_t) << set->shard_bits);
+		tm_free(allocator, set->segments, sizeof(private__shared_segment_t) << set->shard_bits);
+		tm_free(allocator, set->manifest_path, strlen(set->manifest_path) + 1);
+	}
+
+	if (symbols)
+		private__symbols_free(symbols);
+	while (retired_symbols) {
+		private__symbols_t *next = retired_symbols->next_retired;
+		private__symbols_free(retired_symbols);
+		retired_symbols = next;
+	}
+	atomic_store_uint64_t(&loaded_symbols, 0);
+	atomic_store_uint64_t(&symbols_epoch, 1);
 
-		tm_symbol_tree_free(allocator, &runtime_tree);
-		tm_free(allocator, runtime_strings, runtime_buffer_size);
-		runtime_strings = 0;
-		runtime_buffer_size = 0;
+	if (atomic_load_uint32_t(&locks_state) == 2) {
+		tm_os_api->thread->destroy_critical_section(&load_lock);
+		tm_os_api->thread->destroy_critical_section(&requests_lock);
+		atomic_store_uint32_t(&locks_state, 0);
+	}
+	atomic_store_uint32_t(&search_started, 0);
+	shared_index = false;
+
+	tm_intern_table_free(&runtime_table, allocator);
+	private__cache_free(&decode_cache);
+	private__stats_free();
+}
+
+TM_DLL_EXPORT void tm_load_plugin(struct tm_api_registry_api *reg, bool load)
+{
+	tm_set_or_remove_api(reg, load, TM_DEBUG_UTILS_API_NAME, tm_debug_utils_api);
 
-		tm_carray_free(files, allocator);
-		tm_carray_free(trees, allocator);
-		tm_carray_free(decoding, allocator);
-		files = 0;
-		trees = 0;
-		decoding = 0;
+	// Searching and loading the databases can take a while, so it's started right away instead of on the first lookup.
+	if (load) {
+		private__cache_reset(&decode_cache, decode_cache.budget);
+		if (*TM_DEBUG_UTILS_RUNTIME_JOURNAL_PATH)
+			api__set_runtime_journal(TM_DEBUG_UTILS_RUNTIME_JOURNAL_PATH);
+		if (TM_DEBUG_UTILS_SHARED_INDEX)
+			api__set_shared_index(true);
+		private__start_default_search();
 	}
+	else
+		private__unload();
 }
\ No newline at end of file
@@ -5,6 +5,88 @@
 
 struct tm_temp_allocator_i;
 
+// View into a string that is resident in the loaded symbol databases, `data` is not null terminated.
+typedef struct tm_debug_utils_string_view_t
+{
+	const char *data;
+	uint32_t size;
+	TM_PAD(4);
+} tm_debug_utils_string_view_t;
+
+// Number of buckets of a `tm_debug_utils_histogram_t`, bucket `i` counts the samples that took [2^i, 2^(i + 1)) nanoseconds.
+#define TM_DEBUG_UTILS_HISTOGRAM_BUCKETS 40
+// Only the first databases get their hits counted separately, hits in later ones are only counted in `database_hits`.
+#define TM_DEBUG_UTILS_STATS_MAX_DATABASES 32
+// Lookups that probe this many slots of the global index or more share the last bucket of `probe_depths`.
+#define TM_DEBUG_UTILS_STATS_MAX_PROBES 16
+// One in this many lookups and decodes is timed. Reading the clock stalls the lookups that are in flight,
+// so timing more of them would make lookups measurably slower.
+#define TM_DEBUG_UTILS_STATS_SAMPLE_RATE 256
+// Default budget in bytes of the cache of strings decoded from compressed or front coded databases, see `set_decode_cache_size()`.
+#define TM_DEBUG_UTILS_DECODE_CACHE_SIZE (256 * 1024)
+// Path searched for symbol databases in the background when the plugin is loaded, unless databases were added before.
+// Define it as an empty string to only use the databases added with `add_symbol_database()`.
+#ifndef TM_DEBUG_UTILS_DEFAULT_SEARCH_PATH
+#define TM_DEBUG_UTILS_DEFAULT_SEARCH_PATH "../../"
+#endif
+// Runtime journal replayed and opened when the plugin is loaded, see `set_runtime_journal()`. Empty to not keep one.
+#ifndef TM_DEBUG_UTILS_RUNTIME_JOURNAL_PATH
+#define TM_DEBUG_UTILS_RUNTIME_JOURNAL_PATH ""
+#endif
+// Set to 1 to share the indices over the loaded databases with other processes from the time the plugin is loaded,
+// see `set_shared_index()`.
+#ifndef TM_DEBUG_UTILS_SHARED_INDEX
+#define TM_DEBUG_UTILS_SHARED_INDEX 0
+#endif
+// Seconds between the appends of the strings added to the runtime database to the runtime journal.
+#define TM_DEBUG_UTILS_JOURNAL_FLUSH_INTERVAL 0.1
+
+typedef struct tm_debug_utils_histogram_t
+{
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t buckets[TM_DEBUG_UTILS_HISTOGRAM_BUCKETS];
+} tm_debug_utils_histogram_t;
+
+// Statistics of the lookups of all threads since the last reset, see `tm_debug_utils_api->get_stats()`.
+typedef struct tm_debug_utils_stats_t
+{
+	// Lookups that were found in the runtime database, found in a loaded database or not found at all.
+	uint64_t runtime_hits;
+	uint64_t database_hits;
+	uint64_t misses;
+	// Slots of the global index probed by the sampled lookups that reached it.
+	// `probe_depths[i]` counts the lookups that probed `i + 1` slots.
+	uint64_t probes;
+	uint64_t probe_depths[TM_DEBUG_UTILS_STATS_MAX_PROBES];
+	// Characters decoded from compressed or front coded databases.
+	uint64_t decoded_bytes;
+	// Strings of compressed or front coded databases that were copied from the decode cache or had to be decoded,
+	// and the cached strings that were evicted to make room for new ones.
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t cache_evictions;
+	// Databases opened by `add_symbol_database()` and their size on disk.
+	uint64_t loaded_databases;
+	uint64_t loaded_bytes;
+	// Indices mapped from the shared memory of another process and indices published to it, see `set_shared_index()`.
+	uint64_t attached_indices;
+	uint64_t published_indices;
+	// Searching the runtime database and the global index, sampled.
+	tm_debug_utils_histogram_t lookup_time;
+	// Decoding of compressed or front coded strings, sampled.
+	tm_debug_utils_histogram_t decode_time;
+	// Opening a database, including reading it from disk.
+	tm_debug_utils_histogram_t load_time;
+	// Rebuilding the global index after databases were added.
+	tm_debug_utils_histogram_t index_time;
+	// `hits_per_database[i]` counts the hits in the i:th loaded database.
+	uint64_t hits_per_database[TM_DEBUG_UTILS_STATS_MAX_DATABASES];
+	// Number of loaded databases, not reset.
+	uint32_t database_count;
+	TM_PAD(4);
+} tm_debug_utils_stats_t;
+
 struct tm_debug_utils_api
 {
 	// Reverses the specified hash into the string that generated it.
@@ -15,10 +97,59 @@ struct tm_debug_utils_api
 	// Result is allocated with the specified allocator or null if the hash was not found.
 	const char *(*try_decode_hash)(uint64_t hash, struct tm_temp_allocator_i *ta);
 	// Searches the specified path and sub directories for The Machinery symbols.
+	// Returns once they are loaded, databases that were already loaded are skipped.
+	// The index over the databases loaded before is freed by a later call once no lookup is using it anymore.
 	void (*add_symbol_database)(const char *path);
 	// Adds the specified string to a runtime database that shares its lifetime with the dll.
-	// Returns the hash generated.
+	// Can be called from any thread, also while other threads decode hashes. Returns the hash generated.
 	uint64_t(*add_hash)(const char *string);
+	// Reverses the specified hash into `buffer` without allocating any memory.
+	// The result is truncated to `buffer_size - 1` characters and always null terminated.
+	// Returns the full length of the string or 0 if the hash was not found.
+	uint32_t (*decode_hash_to_buffer)(uint64_t hash, char *buffer, uint32_t buffer_size);
+	// Same as `decode_hash_to_buffer()`, but writes the hash in string form if the string could not be found.
+	uint32_t (*try_decode_hash_to_buffer)(uint64_t hash, char *buffer, uint32_t buffer_size);
+	// Returns a view of the string that generated the hash, pointing straight into the loaded data.
+	// Only strings from uncompressed databases that aren't front coded or the runtime database can be viewed,
+	// the view is empty if the hash was not found or the string has to be decoded.
+	tm_debug_utils_string_view_t (*decode_hash_view)(uint64_t hash);
+	// Reverses `count` hashes at once, which is a lot faster than calling `decode_hash()` for each of them.
+	// `results[i]` is set to the string of `hashes[i]` allocated with the specified allocator or null if it was not found.
+	// Returns the number of hashes that were found.
+	uint32_t (*decode_hashes)(const uint64_t *hashes, uint32_t count, const char **results, struct tm_temp_allocator_i *ta);
+	// Adds `count` strings to the runtime database like `add_hash()`.
+	// The generated hashes are written to `hashes` unless it's null.
+	void (*add_hashes)(const char **strings, uint32_t count, uint64_t *hashes);
+	// Writes the statistics of all lookups since the last reset to `stats`, if `reset` is set the next call starts over.
+	// The counters are kept per thread and never synchronized, so this is cheap enough to call every frame.
+	void (*get_stats)(tm_debug_utils_stats_t *stats, bool reset);
+	// Sets the budget in bytes of the cache of recently decoded strings and empties it, 0 disables the cache. The budget is
+	// allocated right away, so lookups never allocate.
+	// Only strings that have to be decoded are cached, the others are copied straight from the loaded data.
+	// Defaults to `TM_DEBUG_UTILS_DECODE_CACHE_SIZE`, `cache_hits` and `cache_misses` in the statistics help tune it.
+	void (*set_decode_cache_size)(uint64_t bytes);
+	// Like `add_symbol_database()`, but searches the path on a background thread and returns right away.
+	// Lookups use the databases loaded so far, use `wait_for_symbol_databases()` to make sure the ones at a path are loaded.
+	void (*add_symbol_database_async)(const char *path);
+	// Waits until the databases of the paths passed to `add_symbol_database_async()` are loaded.
+	// Waits for the specified path or, if null, for all of them, including the `TM_DEBUG_UTILS_DEFAULT_SEARCH_PATH`.
+	void (*wait_for_symbol_databases)(const char *path);
+	// Finds the strings that start with `query` or, if `substring` is set, contain it and writes the hashes of the first
+	// `max_hashes` of them to `hashes`. Returns the number of strings found, which can be more than `max_hashes`.
+	// Databases generated with `symbols -g --search-index` answer without decoding all their strings, others are scanned.
+	uint32_t (*find_hashes)(const char *query, bool substring, uint64_t *hashes, uint32_t max_hashes);
+	// Adds the strings of the journal at `path` to the runtime database and appends the strings added from then on to it,
+	// so they can be decoded in later sessions and by other processes without being added again. Appends are batched on
+	// a background thread, `add_hash()` only queues them. `symbols --compact-journal` moves the journal into a database, also
+	// while processes append to it: the journal is reopened for every batch, so they start a new one when it's compacted.
+	// Closes the previous journal, a null path only closes it. Returns false if the journal couldn't be opened.
+	bool (*set_runtime_journal)(const char *path);
+	// Shares the indices built over the loaded databases with the other processes of the same user on this machine. The first
+	// process to load a list of databases publishes its index in shared memory and the later ones map it instead of building
+	// their own, so it's only kept in memory once and loading takes a fraction of the time. Only affects the databases loaded
+	// afterwards, and only once no `add_symbol_database_async()` searches are pending. The last process to unload a shared index
+	// removes it. Runtime strings can be shared with `set_runtime_journal()`. Only POSIX platforms can share, returns false elsewhere.
+	bool (*set_shared_index)(bool shared);
 };
 
 #if defined(TM_LINKS_DEBUG_UTILS)
@@ -0,0 +1,153 @@
+// Journal the strings added to the runtime database are appended to, see `set_runtime_journal()` and shared/journal.inl.
+// Adding a string only copies its record to `pending`, a writer thread appends the pending records to the file every
+// `TM_DEBUG_UTILS_JOURNAL_FLUSH_INTERVAL` seconds, so adding strings never waits for the disk. The file is opened for every
+// batch, so a journal that `symbols --compact-journal` renamed is replaced by a new one rather than written after it was read.
+
+typedef struct private__journal_t
+{
+	// Records that weren't handed to the writer thread yet, guarded by `lock`.
+	char *pending;
+	uint64_t pending_size;
+	uint64_t pending_capacity;
+	// Records the writer thread is writing, swapped with `pending` so neither buffer has to be reallocated.
+	char *writing;
+	uint64_t writing_capacity;
+	char *path;
+	tm_thread_o thread;
+	atomic_uint32_t lock;
+	// Set while a journal is open, only changed while holding `lock`.
+	atomic_uint32_t open;
+	atomic_uint32_t stop;
+	TM_PAD(4);
+} private__journal_t;
+
+// Queues the record of a string that was added to the runtime database, does nothing unless a journal is open.
+// A `pending` buffer that's too small is replaced by a larger one allocated without holding the lock.
+static void private__journal_append(private__journal_t *journal, uint64_t hash, const char *string, uint32_t length)
+{
+	if (!atomic_load_uint32_t(&journal->open))
+		return;
+
+	const uint64_t record_size = TM_HDB_JOURNAL_RECORD_HEADER_SIZE + length;
+	char *grown = 0, *dropped = 0;
+	uint64_t grown_capacity = 0, dropped_capacity = 0;
+	while (true) {
+		private__spin_lock(&journal->lock);
+		if (!atomic_load_uint32_t(&journal->open))
+			break;
+
+		const uint64_t needed = journal->pending_size + record_size;
+		if (needed > journal->pending_capacity && grown_capacity >= needed) {
+			if (journal->pending_size)
+				memcpy(grown, journal->pending, journal->pending_size);
+			dropped = journal->pending;
+			dropped_capacity = journal->pending_capacity;
+			journal->pending = grown;
+			journal->pending_capacity = grown_capacity;
+			grown = 0;
+			grown_capacity = 0;
+		}
+		if (needed <= journal->pending_capacity) {
+			tm_symbol_journal_write_record(journal->pending + journal->pending_size, hash, string, length);
+			journal->pending_size = needed;
+			break;
+		}
+
+		const uint64_t capacity = tm_max(journal->pending_capacity << 1, tm_max(needed, 4096));
+		private__spin_unlock(&journal->lock);
+		tm_free(tm_allocator_api->system, grown, grown_capacity);
+		grown = tm_alloc(tm_allocator_api->system, capacity);
+		grown_capacity = capacity;
+	}
+	private__spin_unlock(&journal->lock);
+
+	tm_free(tm_allocator_api->system, grown, grown_capacity);
+	tm_free(tm_allocator_api->system, dropped, dropped_capacity);
+}
+
+// Appends the pending records to the file. Only called by the writer thread, or once it's stopped.
+static void private__journal_flush(private__journal_t *journal)
+{
+	private__spin_lock(&journal->lock);
+	char *records = journal->pending;
+	const uint64_t size = journal->pending_size, capacity = journal->pending_capacity;
+	journal->pending = journal->writing;
+	journal->pending_capacity = journal->writing_capacity;
+	journal->pending_size = 0;
+	journal->writing = records;
+	journal->writing_capacity = capacity;
+	private__spin_unlock(&journal->lock);
+
+	if (size && !tm_symbol_journal_append(journal->path, records, size))
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to append %llu bytes to the runtime journal\n", (unsigned long long)size);
+}
+
+static void private__journal_writer(void *data)
+{
+	private__journal_t *journal = data;
+	while (!atomic_load_uint32_t(&journal->stop)) {
+		tm_os_api->thread->sleep(TM_DEBUG_UTILS_JOURNAL_FLUSH_INTERVAL);
+		private__journal_flush(journal);
+	}
+}
+
+// Adds the complete records of the journal at `path` to `table` and opens it for appending the strings added afterwards.
+// The journal is only ever appended to, since other processes may append to it too. Partially written records are
+// skipped by the readers, see shared/journal.inl. Returns false if there is a file at the path that isn't a journal
+// or the journal can't be written.
+static bool private__journal_open(private__journal_t *journal, tm_intern_table_t *table, const char *path)
+{
+	tm_mapped_file_t mapped;
+	const bool exists = tm_mapped_file_open(path, &mapped);
+	if (exists && !tm_symbol_journal_valid_header(mapped.data, mapped.size)) {
+		tm_mapped_file_close(&mapped);
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: '%s' isn't a runtime journal\n", path);
+		return false;
+	}
+
+	uint64_t offset = TM_HDB_JOURNAL_HEADER_SIZE, skipped = 0, hash;
+	const char *string;
+	uint32_t length;
+	while (exists && tm_symbol_journal_next(mapped.data, mapped.size, &offset, &skipped, &hash, &string, &length))
+		tm_intern_table_insert(table, tm_allocator_api->system, hash, string, length);
+	if (exists)
+		tm_mapped_file_close(&mapped);
+	if (skipped)
+		tm_logger_api->printf(TM_LOG_TYPE_INFO, "dbgutils: skipped %llu bytes of partially written records of '%s'\n", (unsigned long long)skipped, path);
+
+	if (!tm_symbol_journal_append(path, 0, 0)) {
+		tm_logger_api->printf(TM_LOG_TYPE_ERROR, "dbgutils: failed to open the runtime journal '%s'\n", path);
+		return false;
+	}
+
+	const size_t path_size = strlen(path) + 1;
+	journal->path = tm_alloc(tm_allocator_api->system, path_size);
+	memcpy(journal->path, path, path_size);
+
+	atomic_store_uint32_t(&journal->stop, 0);
+	journal->thread = tm_os_api->thread->create_thread(private__journal_writer, journal, 64 * 1024, "tm_debug_utils journal");
+	private__spin_lock(&journal->lock);
+	atomic_store_uint32_t(&journal->open, 1);
+	private__spin_unlock(&journal->lock);
+	return true;
+}
+
+// Writes the pending records and closes the journal, if one is open.
+static void private__journal_close(private__journal_t *journal)
+{
+	private__spin_lock(&journal->lock);
+	const bool was_open = atomic_load_uint32_t(&journal->open);
+	atomic_store_uint32_t(&journal->open, 0);
+	private__spin_unlock(&journal->lock);
+	if (!was_open)
+		return;
+
+	atomic_store_uint32_t(&journal->stop, 1);
+	tm_os_api->thread->wait_for_thread(journal->thread);
+	private__journal_flush(journal);
+	tm_free(tm_allocator_api->system, journal->path, strlen(journal->path) + 1);
+
+	tm_free(tm_allocator_api->system, journal->pending, journal->pending_capacity);
+	tm_free(tm_allocator_api->system, journal->writing, journal->writing_capacity);
+	*journal = (private__journal_t) { 0 };
+}
\ No newline at end of file
@@ -0,0 +1,236 @@
+// Global indices shared between the processes of a machine, see `set_shared_index()`.
+// The databases are mapped from the OS file cache, so every process uses the same physical memory for them already,
+// but each process builds its own indices over them. With sharing enabled the first process to build the index over
+// a list of databases publishes it in a POSIX shared memory segment and the later ones map it read only instead.
+// A segment is named after the user and the paths of its databases and holds the slots and the filter of the index:
+//   private__shared_index_header_t, padding to a page, tm_symbol_global_slot_t slots[slot_count], uint64_t filter[]
+// An index only depends on the hashes of its databases and their order, so the header keeps a hash of them as `key`.
+// A complete segment with another key was built for databases that changed since and is replaced.
+// The header counts the processes that map the segment and the last one to unmap it removes it. Only the header page is
+// writable for them. Segments of processes that crashed stay until they're replaced or removed from /dev/shm.
+
+#if defined(TM_OS_POSIX)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define private__shared_index_magic 0x58494448
+#define private__shared_index_version 2
+
+typedef struct private__shared_index_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t slot_count;
+	// Zero if the index uses the filter of its only database.
+	uint64_t filter_block_count;
+	uint32_t entry_count;
+	uint32_t duplicate_count;
+	// Process that publishes the index, so a segment it never completed can be told from one still being built.
+	uint32_t creator;
+	// Set once the index is complete.
+	atomic_uint32_t ready;
+	// Processes that map the segment. Zero once the last one unmapped it, after which it's removed and can't be mapped again.
+	atomic_uint32_t users;
+	TM_PAD(4);
+} private__shared_index_header_t;
+
+// Segment an index was published in or mapped from. Such an index is unmapped instead of freed.
+typedef struct private__shared_segment_t
+{
+	void *data;
+	uint64_t size;
+	// The name is only removed while it still refers to this segment rather than one that replaced it.
+	uint64_t inode;
+	char name[32];
+} private__shared_segment_t;
+
+#if defined(TM_OS_POSIX)
+
+// The header has a page of its own, so the index after it can be made read only.
+static uint64_t private__shared_index_header_size(void)
+{
+	return (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+static uint64_t private__shared_index_size(uint64_t slot_count, uint64_t filter_block_count)
+{
+	return private__shared_index_header_size() + slot_count * sizeof(tm_symbol_global_slot_t) + filter_block_count * tm_symbol_filter__block_size;
+}
+
+// The slots are a power of two of 16 bytes each, which keeps the filter aligned to its block size.
+static tm_symbol_global_index_t private__shared_index_view(const private__shared_index_header_t *header, const tm_symbol_database_t *databases)
+{
+	tm_symbol_global_index_t index = {
+		.slots = (tm_symbol_global_slot_t *)((char *)header + private__shared_index_header_size()),
+		.mask = header->slot_count - 1,
+		.entry_count = header->entry_count,
+		.duplicate_count = header->duplicate_count,
+	};
+	index.filter = header->filter_block_count ? (tm_symbol_filter_t) { .blocks = (const uint64_t *)(index.slots + header->slot_count), .block_count = header->filter_block_count }
+		: databases[0].filter;
+	return index;
+}
+
+// Counts this process as a user of the segment, fails if the last user already unmapped it.
+static bool private__shared_index_add_user(private__shared_index_header_t *header)
+{
+	uint32_t users = atomic_load_uint32_t(&header->users);
+	while (users && !atomic_compare_exchange_strong_uint32_t(&header->users, &users, users + 1));
+	return users != 0;
+}
+
+// Maps the segment if it holds the complete index for the databases. Sets `stale` if it's complete but was built for other
+// databases or is being removed, or if the process that created it is gone without completing it.
+static bool private__shared_index_attach(const char *name, const private__shared_index_header_t *expected, private__shared_segment_t *segment, bool *stale)
+{
+	const int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return false;
+
+	// Only segments of this user are trusted, the slots are used to index the databases without any checks.
+	struct stat st;
+	void *data = MAP_FAILED;
+	const uint64_t header_size = private__shared_index_header_size();
+	if (!fstat(fd, &st) && st.st_uid == geteuid() && (uint64_t)st.st_size >= header_size)
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	private__shared_index_header_t *header = data;
+	const bool matches = header->magic == private__shared_index_magic && header->version == private__shared_index_version
+		&& header->key == expected->key && header->slot_count == expected->slot_count && header->filter_block_count == expected->filter_block_count
+		&& (uint64_t)st.st_size == private__shared_index_size(expected->slot_count, expected->filter_block_count);
+	const bool ready = header->magic == private__shared_index_magic && atomic_load_uint32_t(&header->ready);
+	if (ready && matches && private__shared_index_add_user(header)) {
+		mprotect((char *)data + header_size, (size_t)(st.st_size - (off_t)header_size), PROT_READ);
+		*segment = (private__shared_segment_t) { .data = data, .size = (uint64_t)st.st_size, .inode = (uint64_t)st.st_ino };
+		snprintf(segment->name, sizeof(segment->name), "%s", name);
+		return true;
+	}
+
+	*stale = ready || (header->creator && kill((pid_t)header->creator, 0) && errno == ESRCH);
+	munmap(data, (size_t)st.st_size);
+	return false;
+}
+
+// Creates the segment and builds the index in it, fails if another process created it first.
+static bool private__shared_index_publish(const char *name, const private__shared_index_header_t *expected, const tm_symbol_database_t *databases,
+	uint32_t database_count, private__shared_segment_t *segment)
+{
+	const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+
+	// The pages of a segment are allocated as they're written and running out of them then raises SIGBUS,
+	// so on Linux they're allocated up front where that fails gracefully.
+	const uint64_t size = private__shared_index_size(expected->slot_count, expected->filter_block_count);
+#if defined(TM_OS_LINUX)
+	const bool allocated = !posix_fallocate(fd, 0, (off_t)size);
+#else
+	const bool allocated = !ftruncate(fd, (off_t)size);
+#endif
+	struct stat st;
+	void *data = allocated && !fstat(fd, &st) ? mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED) {
+		shm_unlink(name);
+		return false;
+	}
+
+	// New segments are zero filled, so the slots and the filter are empty.
+	private__shared_index_header_t *header = data;
+	*header = *expected;
+	header->creator = (uint32_t)getpid();
+	header->users = 1;
+	tm_symbol_global_index_t index = private__shared_index_view(header, databases);
+	tm_symbol_global_index_fill(&index, databases, database_count, expected->filter_block_count != 0);
+	header->entry_count = index.entry_count;
+	header->duplicate_count = index.duplicate_count;
+	atomic_store_uint32_t(&header->ready, 1);
+
+	const uint64_t header_size = private__shared_index_header_size();
+	mprotect((char *)data + header_size, (size_t)(size - header_size), PROT_READ);
+	*segment = (private__shared_segment_t) { .data = data, .size = size, .inode = (uint64_t)st.st_ino };
+	snprintf(segment->name, sizeof(segment->name), "%s", name);
+	return true;
+}
+
+#endif
+
+// Builds the index over the databases or, if `share` is set, maps it from the segment another process published it in.
+// If there is none yet and `publish` is set, the index is built in a new segment for the later processes. `segment` is set
+// if it's shared.
+static tm_symbol_global_index_t private__shared_index_create(tm_allocator_i *a, bool share, bool publish, const tm_symbol_database_t *databases,
+	uint32_t database_count, private__shared_segment_t *segment)
+{
+	*segment = (private__shared_segment_t) { 0 };
+#if defined(TM_OS_POSIX)
+	if (share) {
+		const uint64_t total = tm_symbol_global_index_total(databases, database_count);
+		private__shared_index_header_t expected = {
+			.magic = private__shared_index_magic,
+			.version = private__shared_index_version,
+			.key = database_count,
+			.slot_count = tm_symbol_global_index_capacity(total),
+			.filter_block_count = tm_symbol_global_index_builds_filter(databases, database_count) ? tm_symbol_filter_block_count(total) : 0,
+		};
+
+		const uid_t user = geteuid();
+		uint64_t name_hash = tm_murmur_hash_inline(&user, (int)sizeof(user), database_count);
+		for (uint32_t i = 0; i < database_count; ++i) {
+			name_hash = tm_murmur_hash_inline(databases[i].path, (int)strlen(databases[i].path), name_hash);
+			expected.key = tm_murmur_hash_inline(databases[i].index.hashes, (int)(databases[i].index.entry_count * sizeof(uint64_t)), expected.key);
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "/tmdbg-%016llx", (unsigned long long)name_hash);
+
+		tm_debug_utils_stats_t *stats = &private__stats_block()->counters;
+		bool stale = false;
+		if (private__shared_index_attach(name, &expected, segment, &stale)) {
+			++stats->attached_indices;
+			return private__shared_index_view(segment->data, databases);
+		}
+
+		// Processes that mapped the stale segment keep their mapping after it's unlinked.
+		if (stale)
+			shm_unlink(name);
+		if (publish && private__shared_index_publish(name, &expected, databases, database_count, segment)) {
+			++stats->published_indices;
+			return private__shared_index_view(segment->data, databases);
+		}
+	}
+#endif
+	return tm_symbol_global_index_create(a, databases, database_count);
+}
+
+static void private__shared_index_free(tm_allocator_i *a, tm_symbol_global_index_t *index, private__shared_segment_t *segment)
+{
+	if (!segment->data) {
+		tm_symbol_global_index_free(a, index);
+		return;
+	}
+
+#if defined(TM_OS_POSIX)
+	// Adding UINT32_MAX subtracts one.
+	private__shared_index_header_t *header = segment->data;
+	if (atomic_fetch_add_uint32_t(&header->users, UINT32_MAX) == 1) {
+		const int fd = shm_open(segment->name, O_RDONLY, 0);
+		struct stat st;
+		if (fd >= 0 && !fstat(fd, &st) && (uint64_t)st.st_ino == segment->inode)
+			shm_unlink(segment->name);
+		if (fd >= 0)
+			close(fd);
+	}
+	munmap(segment->data, (size_t)segment->size);
+#endif
+	*index = (tm_symbol_global_index_t) { 0 };
+	*segment = (private__shared_segment_t) { 0 };
+}
\ No newline at end of file
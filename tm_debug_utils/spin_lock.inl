@@ -0,0 +1,29 @@
+#include <xmmintrin.h>
+
+// Lock for the few short sections that guard state of the plugin which exists before any OS lock could be created,
+// like the decode cache and the statistics. Waiting threads pause between attempts, which leaves the core to its other
+// hardware thread, and yield after a while, so a holder that was preempted gets to finish. Holders never allocate.
+
+// Attempts that only pause before waiting threads start yielding.
+#define private__spin_count 64
+
+static inline bool private__spin_try_lock(atomic_uint32_t *lock)
+{
+	uint32_t unlocked = 0;
+	return !atomic_load_uint32_t(lock) && atomic_compare_exchange_strong_uint32_t(lock, &unlocked, 1);
+}
+
+static inline void private__spin_lock(atomic_uint32_t *lock)
+{
+	for (uint32_t attempts = 0; !private__spin_try_lock(lock); ++attempts) {
+		if (attempts < private__spin_count)
+			_mm_pause();
+		else
+			tm_os_api->thread->yield_processor();
+	}
+}
+
+static inline void private__spin_unlock(atomic_uint32_t *lock)
+{
+	atomic_store_uint32_t(lock, 0);
+}
\ No newline at end of file
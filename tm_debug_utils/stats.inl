@@ -0,0 +1,126 @@
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+#define private__thread_local __declspec(thread)
+#else
+#define private__thread_local _Thread_local
+#endif
+
+// Counters of a single thread. Only the owning thread writes `counters`, so counting is plain increments.
+// `get_stats()` sums the counters of all threads and subtracts what was `reported` at the last reset,
+// which resets the statistics without the owning threads ever having to know.
+typedef struct private__stats_block_t
+{
+	tm_debug_utils_stats_t counters;
+	tm_debug_utils_stats_t reported;
+	struct private__stats_block_t *next;
+	// Epoch of the loaded databases the thread is looking up hashes in, zero while it isn't, see `private__symbols_enter()`.
+	atomic_uint64_t symbols_epoch;
+	// Used to pick the lookups and decodes that are timed.
+	uint32_t lookup_count;
+	uint32_t decode_count;
+} private__stats_block_t;
+
+// Everything up to `database_count` is a counter.
+#define private__stats_counter_count (offsetof(tm_debug_utils_stats_t, database_count) / sizeof(uint64_t))
+
+// List of the blocks of all threads that ever counted anything, blocks are only freed when the plugin is unloaded.
+static atomic_uint64_t stats_blocks;
+static atomic_uint32_t stats_lock;
+// Bumped when the blocks are freed, so threads know their block is gone.
+static uint32_t stats_generation = 1;
+
+static private__thread_local private__stats_block_t *thread_stats_block;
+static private__thread_local uint32_t thread_stats_generation;
+
+static private__stats_block_t *private__stats_block_create(void)
+{
+	private__stats_block_t *block = tm_alloc(tm_allocator_api->system, sizeof(private__stats_block_t));
+	memset(block, 0, sizeof(private__stats_block_t));
+
+	uint64_t head = atomic_load_uint64_t(&stats_blocks);
+	do {
+		block->next = (private__stats_block_t *)head;
+	} while (!atomic_compare_exchange_strong_uint64_t(&stats_blocks, &head, (uint64_t)block));
+
+	thread_stats_block = block;
+	thread_stats_generation = stats_generation;
+	return block;
+}
+
+static inline private__stats_block_t *private__stats_block(void)
+{
+	return thread_stats_generation == stats_generation ? thread_stats_block : private__stats_block_create();
+}
+
+// Returns true for one in `TM_DEBUG_UTILS_STATS_SAMPLE_RATE` calls on the thread.
+static inline bool private__stats_sample(uint32_t *count)
+{
+	return !(++*count & (TM_DEBUG_UTILS_STATS_SAMPLE_RATE - 1));
+}
+
+static inline void private__stats_record(tm_debug_utils_histogram_t *histogram, tm_clock_o start)
+{
+	const double seconds = tm_os_api->time->delta(tm_os_api->time->now(), start);
+	const uint64_t ns = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+
+	uint32_t bucket = 0;
+	while (bucket + 1 < TM_DEBUG_UTILS_HISTOGRAM_BUCKETS && ns >> (bucket + 1))
+		++bucket;
+
+	++histogram->count;
+	histogram->total_ns += ns;
+	++histogram->buckets[bucket];
+}
+
+static inline void private__stats_database_hit(tm_debug_utils_stats_t *stats, uint32_t db_idx)
+{
+	++stats->database_hits;
+	if (db_idx < TM_DEBUG_UTILS_STATS_MAX_DATABASES)
+		++stats->hits_per_database[db_idx];
+}
+
+static inline void private__stats_probes(tm_debug_utils_stats_t *stats, uint32_t probes)
+{
+	if (!probes)
+		return;
+
+	stats->probes += probes;
+	++stats->probe_depths[tm_min(probes, TM_DEBUG_UTILS_STATS_MAX_PROBES) - 1];
+}
+
+// The counters of other threads are read while they may be counting, which at worst misses the lookups in flight.
+static void private__stats_snapshot(tm_debug_utils_stats_t *stats, bool reset)
+{
+	memset(stats, 0, sizeof(tm_debug_utils_stats_t));
+
+	private__spin_lock(&stats_lock);
+
+	uint64_t *sum = (uint64_t *)stats;
+	for (private__stats_block_t *block = (private__stats_block_t *)atomic_load_uint64_t(&stats_blocks); block; block = block->next) {
+		const volatile uint64_t *counters = (const volatile uint64_t *)&block->counters;
+		uint64_t *reported = (uint64_t *)&block->reported;
+		for (uint32_t i = 0; i < private__stats_counter_count; ++i) {
+			const uint64_t value = counters[i];
+			sum[i] += value - reported[i];
+			if (reset)
+				reported[i] = value;
+		}
+	}
+
+	private__spin_unlock(&stats_lock);
+}
+
+// Not thread safe, no other thread may count while or after the blocks are freed.
+static void private__stats_free(void)
+{
+	private__stats_block_t *block = (private__stats_block_t *)atomic_load_uint64_t(&stats_blocks);
+	while (block) {
+		private__stats_block_t *next = block->next;
+		tm_free(tm_allocator_api->system, block, sizeof(private__stats_block_t));
+		block = next;
+	}
+
+	atomic_store_uint64_t(&stats_blocks, 0);
+	++stats_generation;
+}
\ No newline at end of file